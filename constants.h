@@ -1,31 +1,15 @@
 #ifndef __MSI_EC_CONSTANTS__
 #define __MSI_EC_CONSTANTS__
 
+#include <linux/dmi.h>
 #include <linux/kernel.h>
 
 #define MSI_DRIVER_NAME "msi-ec"
 
-#define MSI_EC_FN_WIN_ADDRESS 0xbf
-#define MSI_EC_FN_WIN_BIT 4
-#define MSI_EC_FN_KEY_LEFT 1
-#define MSI_EC_FN_KEY_RIGHT 0
-#define MSI_EC_WIN_KEY_LEFT 0
-#define MSI_EC_WIN_KEY_RIGHT 1
-
-#define MSI_EC_BATTERY_MODE_ADDRESS 0xef	
-#define MSI_EC_BATTERY_MODE_MAX_CHARGE 0xe4
-#define MSI_EC_BATTERY_MODE_MEDIUM_CHARGE 0xd0
-#define MSI_EC_BATTERY_MODE_MIN_CHARGE 0xbc
-
-#define MSI_EC_COOLER_BOOST_ADDRESS 0x98
-#define MSI_EC_COOLER_BOOST_BIT 7
-
-#define MSI_EC_SHIFT_MODE_ADDRESS 0xf2
-#define MSI_EC_SHIFT_MODE_OVERCLOCK 0xc0
-#define MSI_EC_SHIFT_MODE_BALANCED 0xc1
-#define MSI_EC_SHIFT_MODE_ECO 0xc2
-#define MSI_EC_SHIFT_MODE_OFF 0x80
-
+/*
+ * Firmware identity lives at the same addresses on every supported EC and is
+ * used to pick the model configuration, so it is not part of the tables below.
+ */
 #define MSI_EC_FW_VERSION_ADDRESS 0xa0
 #define MSI_EC_FW_VERSION_LENGTH 12
 #define MSI_EC_FW_DATE_ADDRESS 0xac
@@ -33,75 +17,233 @@
 #define MSI_EC_FW_TIME_ADDRESS 0xb4
 #define MSI_EC_FW_TIME_LENGTH 8
 
-#define MSI_EC_CPU_REALTIME_TEMPERATURE_ADDRESS 0x68
-#define MSI_EC_CPU_REALTIME_FAN_SPEED_ADDRESS 0xcd
-#define MSI_EC_CPU_REALTIME_FAN_SPEED_BASE_MIN 0x19
-#define MSI_EC_CPU_REALTIME_FAN_SPEED_BASE_MAX 0x37
+#define MSI_EC_ADDR_UNSUPP 0xff01 /* register not implemented by this model */
+#define MSI_EC_BIT_UNSUPP -1 /* flag not implemented by this model */
+#define MSI_EC_VALUE_UNSUPP -1 /* preset value not known for this model */
 
-#define MSI_EC_GPU_REALTIME_TEMPERATURE_ADDRESS 0x80
-#define MSI_EC_GPU_REALTIME_FAN_SPEED_ADDRESS 0x89
+#define MSI_EC_KBD_BL_STATES 4
 
-#define MSI_EC_FAN_MODE_ADDRESS 0xd4
-#define MSI_EC_FAN_MODE_SILENT_BIT 4
-#define MSI_EC_FAN_MODE_BASIC_BIT 6 /* Modern 15: unused by MSI Center; useless due to unknown BASIC_FAN_SPEED_ADDRESS  */
-#define MSI_EC_FAN_MODE_ADVANCED_BIT 7
+#define MSI_EC_PRESET_SUPER_BATTERY 0
+#define MSI_EC_PRESET_SILENT 1
+#define MSI_EC_PRESET_BALANCED 2
+#define MSI_EC_PRESET_HIGH_PERFORMANCE 3
+#define MSI_EC_PRESET_COUNT 4
 
-#define MSI_EC_POWER_ADDRESS 0x30
-#define MSI_EC_POWER_LID_OPEN_BIT 1
-#define MSI_EC_POWER_AC_CONNECTED_BIT 0
+#define MSI_EC_PRESET_COLUMN_CPU_POWER 0
+#define MSI_EC_PRESET_COLUMN_GPU_POWER 1
+#define MSI_EC_PRESET_COLUMN_SHIFT_MODE 2
+#define MSI_EC_PRESET_COLUMN_KBD_BL 3
+#define MSI_EC_PRESET_COLUMN_SILENT_FLAG 4
+#define MSI_EC_PRESET_COLUMN_BATTERY_SAVING 5
+#define MSI_EC_PRESET_COLUMNS 6
 
-// Keyboard, webcam device controls
-#define MSI_EC_KBD_LED_MICMUTE_ADDRESS 0x2b
-#define MSI_EC_MIC_LED_STATE_OFF 0x90
-#define MSI_EC_MIC_LED_STATE_ON 0x94 
-#define MSI_EC_KBD_LED_MUTE_ADDRESS 0x2c
-#define MSI_EC_MUTE_LED_STATE_OFF 0x50
-#define MSI_EC_MUTE_LED_STATE_ON 0x54
+// ============================================================ //
+// Per-model configuration
+// ============================================================ //
 
+struct msi_ec_webcam_conf {
+	int address;
+	int bit;
+	int hard_address;
+	int hard_bit; /* hotkey has no effect if this address disables the cam */
+};
 
+struct msi_ec_fn_win_conf {
+	int address;
+	int bit;
+	int fn_left;  /* bit value when the fn key sits on the left */
+	int win_left; /* bit value when the win key sits on the left */
+};
 
+struct msi_ec_charge_control_conf {
+	int address;
+	int max;
+	int medium;
+	int min;
+};
 
-#define MSI_EC_WEBCAM_ADDRESS 0x2e
-#define MSI_EC_WEBCAM_BIT 1
-#define MSI_EC_WEBCAM_HARD_ADDRESS 0x2f
-#define MSI_EC_WEBCAM_HARD_BIT 1 /* hotkey has no effect if this address disables the cam */
+struct msi_ec_cooler_boost_conf {
+	int address;
+	int bit;
+};
 
-#define MSI_EC_KBD_BL_ADDRESS 0xf3
-#define MSI_EC_KBD_BL_STATE_MASK 0x3
-#define MSI_EC_KBD_BL_STATE_OFF 0x80
-#define MSI_EC_KBD_BL_STATE_ON 0x81
-#define MSI_EC_KBD_BL_STATE_HALF 0x82
-#define MSI_EC_KBD_BL_STATE_FULL 0x83
-static int MSI_EC_KBD_BL_STATE[4] = {
-    MSI_EC_KBD_BL_STATE_OFF,
-    MSI_EC_KBD_BL_STATE_ON,
-    MSI_EC_KBD_BL_STATE_HALF,
-    MSI_EC_KBD_BL_STATE_FULL
+struct msi_ec_shift_mode_conf {
+	int address;
+	int overclock;
+	int balanced;
+	int eco;
+	int off;
 };
 
-/* Presets/user scenarios taken from MSI Center Pro */
-static u8 MSI_EC_PRESET_MEMORY_TABLE[6]= {
-	/* CPU pwr?, GPU pwr?, Shift mode, KBD brightness, Silent flag (1 bit), Battery saving flags(?) */
-	0xED, 0xD5, 0xF2, 0xF3, 0xF4, 0x33
+struct msi_ec_fan_mode_conf {
+	int address;
+	int silent_bit;
+	int basic_bit;
+	int advanced_bit;
 };
 
-static u8 MSI_EC_PRESET_VALUE_TABLE[4][6] = {
-	{ 0xA5, 0xA5, 0xC2, 0x80, 0U, 0x05}, /* Super battery */
-	{ 0xA1, 0xA1, 0xC1, 0x80, 1U, 0x0D}, /* Silent */
-	{ 0xA1, 0xA1, 0xC1, 0x80, 0U, 0x0D}, /* Balanced */
-	{ 0xA0, 0xA0, 0xC0, 0x80, 0U, 0x0D}, /* High performance */
+struct msi_ec_cpu_conf {
+	int rt_temp_address;
+	int rt_fan_speed_address;
+	int rt_fan_speed_base_min;
+	int rt_fan_speed_base_max;
 };
 
-#define MSI_EC_PRESET_SUPER_BATTERY 0
-#define MSI_EC_PRESET_SILENT 1
-#define MSI_EC_PRESET_BALANCED 2
-#define MSI_EC_PRESET_HIGH_PERFORMANCE 3
+struct msi_ec_gpu_conf {
+	int rt_temp_address;
+	int rt_fan_speed_address;
+};
 
-#define MSI_EC_PRESET_COLUMN_CPU_POWER 0
-#define MSI_EC_PRESET_COLUMN_GPU_POWER 1
-#define MSI_EC_PRESET_COLUMN_SHIFT_MODE 2
-#define MSI_EC_PRESET_COLUMN_KBD_BL 3
-#define MSI_EC_PRESET_COLUMN_SILENT_FLAG 4
-#define MSI_EC_PRESET_COLUMN_BATTERY_SAVING 5
+struct msi_ec_power_conf {
+	int address;
+	int lid_open_bit;
+	int ac_connected_bit;
+};
+
+struct msi_ec_led_conf {
+	int micmute_address;
+	int micmute_on;
+	int micmute_off;
+	int mute_address;
+	int mute_on;
+	int mute_off;
+};
+
+struct msi_ec_kbd_bl_conf {
+	int address;
+	int state_mask;
+	int states[MSI_EC_KBD_BL_STATES];
+};
+
+struct msi_ec_preset_conf {
+	int addresses[MSI_EC_PRESET_COLUMNS];
+	int values[MSI_EC_PRESET_COUNT][MSI_EC_PRESET_COLUMNS];
+	int silent_flag_bit;
+};
+
+struct msi_ec_conf {
+	const char *name;
+	const char *const *allowed_fw;
+	const struct dmi_system_id *dmi_table;
+
+	struct msi_ec_webcam_conf webcam;
+	struct msi_ec_fn_win_conf fn_win;
+	struct msi_ec_charge_control_conf charge_control;
+	struct msi_ec_cooler_boost_conf cooler_boost;
+	struct msi_ec_shift_mode_conf shift_mode;
+	struct msi_ec_fan_mode_conf fan_mode;
+	struct msi_ec_cpu_conf cpu;
+	struct msi_ec_gpu_conf gpu;
+	struct msi_ec_power_conf power;
+	struct msi_ec_led_conf leds;
+	struct msi_ec_kbd_bl_conf kbd_bl;
+	struct msi_ec_preset_conf preset;
+};
+
+// ============================================================ //
+// MSI Modern 14 B5M
+// ============================================================ //
+
+static const char *const ALLOWED_FW_MODERN_14_B5M[] = {
+	"14DLEMS1.105",
+	NULL
+};
+
+static const struct dmi_system_id DMI_MODERN_14_B5M[] = {
+	{
+		.ident = "MSI Modern 14 B5M",
+		.matches = {
+			DMI_MATCH(DMI_SYS_VENDOR, "Micro-Star International"),
+			DMI_MATCH(DMI_PRODUCT_NAME, "Modern 14 B5M"),
+		},
+	},
+	{ }
+};
+
+static const struct msi_ec_conf CONF_MODERN_14_B5M = {
+	.name = "Modern 14 B5M",
+	.allowed_fw = ALLOWED_FW_MODERN_14_B5M,
+	.dmi_table = DMI_MODERN_14_B5M,
+	.webcam = {
+		.address      = 0x2e,
+		.bit          = 1,
+		.hard_address = 0x2f,
+		.hard_bit     = 1,
+	},
+	.fn_win = {
+		.address  = 0xbf,
+		.bit      = 4,
+		.fn_left  = 1,
+		.win_left = 0,
+	},
+	.charge_control = {
+		.address = 0xef,
+		.max     = 0xe4,
+		.medium  = 0xd0,
+		.min     = 0xbc,
+	},
+	.cooler_boost = {
+		.address = 0x98,
+		.bit     = 7,
+	},
+	.shift_mode = {
+		.address   = 0xf2,
+		.overclock = 0xc0,
+		.balanced  = 0xc1,
+		.eco       = 0xc2,
+		.off       = 0x80,
+	},
+	.fan_mode = {
+		.address      = 0xd4,
+		.silent_bit   = 4,
+		.basic_bit    = MSI_EC_BIT_UNSUPP, /* bit 6: unused by MSI Center; useless due to unknown basic fan speed address */
+		.advanced_bit = 7,
+	},
+	.cpu = {
+		.rt_temp_address       = 0x68,
+		.rt_fan_speed_address  = 0xcd,
+		.rt_fan_speed_base_min = 0x19,
+		.rt_fan_speed_base_max = 0x37,
+	},
+	.gpu = {
+		.rt_temp_address      = 0x80,
+		.rt_fan_speed_address = 0x89,
+	},
+	.power = {
+		.address          = 0x30,
+		.lid_open_bit     = 1,
+		.ac_connected_bit = 0,
+	},
+	.leds = {
+		.micmute_address = 0x2b,
+		.micmute_on      = 0x94,
+		.micmute_off     = 0x90,
+		.mute_address    = 0x2c,
+		.mute_on         = 0x54,
+		.mute_off        = 0x50,
+	},
+	.kbd_bl = {
+		.address    = 0xf3,
+		.state_mask = 0x3,
+		.states     = { 0x80, 0x81, 0x82, 0x83 }, /* off, on, half, full */
+	},
+	/* Presets/user scenarios taken from MSI Center Pro */
+	.preset = {
+		/* CPU pwr?, GPU pwr?, Shift mode, KBD brightness, Silent flag (1 bit), Battery saving flags(?) */
+		.addresses = { 0xed, 0xd5, 0xf2, 0xf3, 0xf4, 0x33 },
+		.values = {
+			{ 0xa5, 0xa5, 0xc2, 0x80, 0, 0x05 }, /* Super battery */
+			{ 0xa1, 0xa1, 0xc1, 0x80, 1, 0x0d }, /* Silent */
+			{ 0xa1, 0xa1, 0xc1, 0x80, 0, 0x0d }, /* Balanced */
+			{ 0xa0, 0xa0, 0xc0, 0x80, 0, 0x0d }, /* High performance */
+		},
+		.silent_flag_bit = 4,
+	},
+};
+
+static const struct msi_ec_conf *CONFIGS[] = {
+	&CONF_MODERN_14_B5M,
+	NULL
+};
 
 #endif // __MSI_EC_CONSTANTS__
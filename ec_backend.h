@@ -0,0 +1,33 @@
+#ifndef __MSI_EC_BACKEND__
+#define __MSI_EC_BACKEND__
+
+#include <linux/bits.h>
+#include <linux/types.h>
+
+/*
+ * Transport used by msi-ec to reach the embedded controller. The driver uses
+ * the ACPI EC unless it is loaded with external_backend=1, in which case it
+ * waits for a module such as msi-ec-sim to register one.
+ */
+struct msi_ec_backend {
+	const char *name;
+	int (*read)(u8 addr, u8 *data);
+	int (*write)(u8 addr, u8 data);
+};
+
+int msi_ec_backend_register(const struct msi_ec_backend *backend);
+void msi_ec_backend_unregister(const struct msi_ec_backend *backend);
+
+/*
+ * Registers that changed behind the driver's back. The driver re-reads the
+ * registers of each source and notifies userspace about the changes.
+ */
+#define MSI_EC_EVENT_POWER BIT(0) /* ac_connected, lid_open */
+#define MSI_EC_EVENT_KBD_BL BIT(1)
+#define MSI_EC_EVENT_WEBCAM BIT(2)
+#define MSI_EC_EVENT_ALL (MSI_EC_EVENT_POWER | MSI_EC_EVENT_KBD_BL | \
+			  MSI_EC_EVENT_WEBCAM)
+
+void msi_ec_backend_event(unsigned int sources);
+
+#endif // __MSI_EC_BACKEND__
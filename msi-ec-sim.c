@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi-ec-sim.c - Simulated embedded controller backend for msi-ec.
+ *
+ * Provides a 256-byte register file seeded with a Modern 14 B5M image so the
+ * msi-ec driver can be exercised without MSI hardware:
+ *
+ *   modprobe msi-ec external_backend=1
+ *   modprobe msi-ec-sim latency_us=500 jitter_us=200 error_rate=10
+ *
+ * Every transaction sleeps latency_us plus up to jitter_us, and fails with
+ * -ETIME with a probability of error_rate per thousand. All parameters can
+ * be changed at runtime under /sys/module/msi_ec_sim/parameters.
+ *
+ * /sys/kernel/debug/msi-ec-sim/ exposes the register file (regs, 256 bytes,
+ * read/write) and transaction counters. Writing a mask of MSI_EC_EVENT_*
+ * sources to event makes msi-ec re-read those registers, as an EC query
+ * would on real hardware:
+ *
+ *   printf '\x01' | dd of=regs bs=1 seek=48 conv=notrunc && echo 1 > event
+ */
+
+#include "ec_backend.h"
+#include "sim_image.h"
+
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+
+static unsigned int latency_us;
+module_param(latency_us, uint, 0644);
+MODULE_PARM_DESC(latency_us, "Base delay of each EC transaction in microseconds (default: 0)");
+
+static unsigned int jitter_us;
+module_param(jitter_us, uint, 0644);
+MODULE_PARM_DESC(jitter_us, "Random extra delay of up to this many microseconds (default: 0)");
+
+static unsigned int error_rate;
+module_param(error_rate, uint, 0644);
+MODULE_PARM_DESC(error_rate, "Transactions per thousand that fail with -ETIME (default: 0)");
+
+static int error_addr = -1;
+module_param(error_addr, int, 0644);
+MODULE_PARM_DESC(error_addr, "Only inject errors on this address, -1 for any (default: -1)");
+
+static DEFINE_MUTEX(sim_lock);
+static u8 sim_regs[SIM_EC_SIZE];
+
+static u64 sim_reads;
+static u64 sim_writes;
+static u64 sim_errors;
+
+static struct dentry *sim_debugfs;
+
+// Called with sim_lock held, like the ACPI EC serialises its transactions
+static int sim_transaction(u8 addr)
+{
+	unsigned int delay = READ_ONCE(latency_us);
+	unsigned int jitter = READ_ONCE(jitter_us);
+	unsigned int rate = READ_ONCE(error_rate);
+	int only_addr = READ_ONCE(error_addr);
+
+	if (jitter)
+		delay += get_random_u32() % (jitter + 1);
+	if (delay)
+		fsleep(delay);
+
+	if (rate && (only_addr < 0 || only_addr == addr) &&
+	    get_random_u32() % 1000 < rate) {
+		sim_errors++;
+		return -ETIME;
+	}
+
+	return 0;
+}
+
+static int sim_read(u8 addr, u8 *data)
+{
+	int result;
+
+	mutex_lock(&sim_lock);
+	sim_reads++;
+	result = sim_transaction(addr);
+	if (result == 0)
+		*data = sim_regs[addr];
+	mutex_unlock(&sim_lock);
+
+	return result;
+}
+
+static int sim_write(u8 addr, u8 data)
+{
+	int result;
+
+	mutex_lock(&sim_lock);
+	sim_writes++;
+	result = sim_transaction(addr);
+	if (result == 0)
+		sim_regs[addr] = data;
+	mutex_unlock(&sim_lock);
+
+	return result;
+}
+
+static const struct msi_ec_backend sim_backend = {
+	.name = "sim",
+	.read = sim_read,
+	.write = sim_write,
+};
+
+// ============================================================ //
+// Debugfs
+// ============================================================ //
+
+static ssize_t regs_read(struct file *file, char __user *ubuf, size_t count,
+			 loff_t *ppos)
+{
+	ssize_t result;
+
+	mutex_lock(&sim_lock);
+	result = simple_read_from_buffer(ubuf, count, ppos, sim_regs,
+					 sizeof(sim_regs));
+	mutex_unlock(&sim_lock);
+
+	return result;
+}
+
+static ssize_t regs_write(struct file *file, const char __user *ubuf,
+			  size_t count, loff_t *ppos)
+{
+	ssize_t result;
+
+	mutex_lock(&sim_lock);
+	result = simple_write_to_buffer(sim_regs, sizeof(sim_regs), ppos, ubuf,
+					count);
+	mutex_unlock(&sim_lock);
+
+	return result;
+}
+
+static const struct file_operations regs_fops = {
+	.owner = THIS_MODULE,
+	.read = regs_read,
+	.write = regs_write,
+	.llseek = default_llseek,
+};
+
+static ssize_t event_write(struct file *file, const char __user *ubuf,
+			   size_t count, loff_t *ppos)
+{
+	unsigned int sources;
+	int result;
+
+	result = kstrtouint_from_user(ubuf, count, 0, &sources);
+	if (result < 0)
+		return result;
+	if (!sources || (sources & ~MSI_EC_EVENT_ALL))
+		return -EINVAL;
+
+	msi_ec_backend_event(sources);
+	return count;
+}
+
+static const struct file_operations event_fops = {
+	.owner = THIS_MODULE,
+	.write = event_write,
+};
+
+// ============================================================ //
+// Module load/unload
+// ============================================================ //
+
+static int __init msi_ec_sim_init(void)
+{
+	int result;
+
+	sim_image_seed(sim_regs);
+
+	sim_debugfs = debugfs_create_dir("msi-ec-sim", NULL);
+	debugfs_create_file_size("regs", 0600, sim_debugfs, NULL, &regs_fops,
+				 SIM_EC_SIZE);
+	debugfs_create_u64("reads", 0400, sim_debugfs, &sim_reads);
+	debugfs_create_u64("writes", 0400, sim_debugfs, &sim_writes);
+	debugfs_create_u64("errors", 0400, sim_debugfs, &sim_errors);
+	debugfs_create_file("event", 0200, sim_debugfs, NULL, &event_fops);
+
+	result = msi_ec_backend_register(&sim_backend);
+	if (result < 0) {
+		pr_err("msi-ec-sim: failed to register backend (error code %i), "
+		       "is msi-ec loaded with external_backend=1?\n", result);
+		debugfs_remove_recursive(sim_debugfs);
+		return result;
+	}
+
+	pr_info("msi-ec-sim: module_init\n");
+	return 0;
+}
+
+static void __exit msi_ec_sim_exit(void)
+{
+	msi_ec_backend_unregister(&sim_backend);
+	debugfs_remove_recursive(sim_debugfs);
+
+	pr_info("msi-ec-sim: module_exit\n");
+}
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Simulated MSI Embedded Controller backend for msi-ec");
+MODULE_VERSION("0.09");
+
+module_init(msi_ec_sim_init);
+module_exit(msi_ec_sim_exit);
@@ -0,0 +1,1134 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi-ec-test.c - KUnit tests for the msi-ec sysfs and LED handlers
+ *
+ * Included at the end of msi-ec.c when CONFIG_MSI_EC_KUNIT_TEST is set, so
+ * the handlers are driven directly through a mock EC backend that records
+ * every transaction. No hardware or ACPI EC is needed:
+ *
+ *   make kunit KDIR=<kernel source tree>
+ *
+ * The same file is built in userspace by tools/kunit on top of tools/shim.
+ *
+ * Besides output strings and exact transaction sequences, every handler has
+ * an EC transaction budget (msi_ec_test_budgets); going over it fails the
+ * suite, so optimisations cannot silently add EC traffic.
+ */
+
+#include <kunit/static_stub.h>
+#include <kunit/test.h>
+#include <linux/ktime.h>
+
+#include "sim_image.h"
+
+#define MOCK_EC_MAX_TX 64
+
+struct mock_tx {
+	char op; /* 'r' or 'w' */
+	u8 addr;
+	u8 value; /* only checked for writes */
+};
+
+#define RD(a) { 'r', a, 0 }
+#define WR(a, v) { 'w', a, v }
+
+static struct {
+	u8 regs[SIM_EC_SIZE];
+	struct mock_tx tx[MOCK_EC_MAX_TX];
+	int count;
+	int error_addr; /* -1 for none */
+	int error;
+} mock;
+
+static int mock_ec_read(u8 addr, u8 *data)
+{
+	if (mock.count < MOCK_EC_MAX_TX)
+		mock.tx[mock.count] = (struct mock_tx)RD(addr);
+	mock.count++;
+
+	if (addr == mock.error_addr)
+		return mock.error;
+
+	*data = mock.regs[addr];
+	return 0;
+}
+
+static int mock_ec_write(u8 addr, u8 data)
+{
+	if (mock.count < MOCK_EC_MAX_TX)
+		mock.tx[mock.count] = (struct mock_tx)WR(addr, data);
+	mock.count++;
+
+	if (addr == mock.error_addr)
+		return mock.error;
+
+	mock.regs[addr] = data;
+	return 0;
+}
+
+static const struct msi_ec_backend mock_backend = {
+	.name = "mock",
+	.read = mock_ec_read,
+	.write = mock_ec_write,
+};
+
+static void mock_clear_tx(void)
+{
+	mock.count = 0;
+}
+
+static void mock_fail(u8 addr, int error)
+{
+	mock.error_addr = addr;
+	mock.error = error;
+}
+
+static void expect_tx(struct kunit *test, const struct mock_tx *expected,
+		      int count)
+{
+	int i;
+
+	KUNIT_EXPECT_EQ(test, mock.count, count);
+
+	for (i = 0; i < count && i < mock.count && i < MOCK_EC_MAX_TX; i++) {
+		KUNIT_EXPECT_EQ_MSG(test, mock.tx[i].op, expected[i].op,
+				    "transaction %i", i);
+		KUNIT_EXPECT_EQ_MSG(test, mock.tx[i].addr, expected[i].addr,
+				    "transaction %i", i);
+		if (expected[i].op == 'w')
+			KUNIT_EXPECT_EQ_MSG(test, mock.tx[i].value,
+					    expected[i].value,
+					    "transaction %i", i);
+	}
+}
+
+#define EXPECT_TX(test, ...)                                        \
+	do {                                                        \
+		const struct mock_tx __tx[] = { __VA_ARGS__ };      \
+		expect_tx(test, __tx, ARRAY_SIZE(__tx));            \
+	} while (0)
+
+#define EXPECT_NO_TX(test) KUNIT_EXPECT_EQ(test, mock.count, 0)
+
+#define ENUM_ATTR(id) (&msi_ec_enum_attrs[MSI_EC_ENUM_ATTR_##id].dev_attr)
+
+static char *test_buf(struct kunit *test)
+{
+	char *buf = kunit_kzalloc(test, PAGE_SIZE, GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_NULL(test, buf);
+	return buf;
+}
+
+static ssize_t show(struct kunit *test, struct device_attribute *attr,
+		    char *buf)
+{
+	mock_clear_tx();
+	return attr->show(NULL, attr, buf);
+}
+
+static ssize_t store(struct device_attribute *attr, const char *value)
+{
+	mock_clear_tx();
+	return attr->store(NULL, attr, value, strlen(value));
+}
+
+#define EXPECT_SHOW(test, attr, expected)                                  \
+	do {                                                               \
+		char *__buf = test_buf(test);                              \
+		KUNIT_EXPECT_EQ(test, show(test, attr, __buf),             \
+				(ssize_t)strlen(expected));                \
+		KUNIT_EXPECT_STREQ(test, __buf, expected);                 \
+	} while (0)
+
+#define EXPECT_STORE_OK(test, attr, value) \
+	KUNIT_EXPECT_EQ(test, store(attr, value), (ssize_t)strlen(value))
+
+// Driver state the cases change, put back by msi_ec_test_exit()
+struct msi_ec_test_state {
+	struct msi_ec_conf conf;
+	struct msi_ec_fw_identity fw;
+	struct msi_ec_flight flights[MSI_EC_ADDRESSES];
+	struct msi_ec_event_reg event_regs[ARRAY_SIZE(event_regs)];
+	typeof(budget) budget;
+	typeof(breaker) breaker;
+	typeof(sched) sched;
+	unsigned int ec_budget;
+	unsigned int ec_budget_burst;
+	unsigned int ec_breaker_threshold;
+	bool ec_breaker_stale;
+	int kbd_bl_written;
+	const struct msi_ec_backend *backend;
+	struct device *event_dev;
+	struct device *kbd_bl_dev;
+};
+
+static int msi_ec_test_init(struct kunit *test)
+{
+	struct msi_ec_test_state *saved = kunit_kzalloc(test, sizeof(*saved),
+							GFP_KERNEL);
+
+	if (!saved)
+		return -ENOMEM;
+	memcpy(&saved->conf, &conf, sizeof(conf));
+	saved->fw = fw;
+	memcpy(saved->flights, flights, sizeof(flights));
+	memcpy(saved->event_regs, event_regs, sizeof(event_regs));
+	saved->budget = budget;
+	saved->breaker = breaker;
+	saved->sched = sched;
+	saved->ec_budget = ec_budget;
+	saved->ec_budget_burst = ec_budget_burst;
+	saved->ec_breaker_threshold = ec_breaker_threshold;
+	saved->ec_breaker_stale = ec_breaker_stale;
+	saved->kbd_bl_written = atomic_read(&kbd_bl_written);
+	saved->backend = backend;
+	saved->event_dev = event_dev;
+	saved->kbd_bl_dev = msiacpi_led_kbdlight.dev;
+	test->priv = saved;
+
+	memcpy(&conf, &CONF_MODERN_14_B5M, sizeof(conf));
+	msi_ec_enum_bind();
+	msi_ec_snapshot_init();
+	sim_image_seed(mock.regs);
+	mock.error_addr = -1;
+	mock.error = 0;
+	backend = &mock_backend;
+	memset(&budget, 0, sizeof(budget));
+	ec_budget = 0;
+	atomic_set(&kbd_bl_written, -1);
+	// Off unless tested, so every failure reaches the other cases
+	memset(&breaker, 0, sizeof(breaker));
+	ec_breaker_threshold = 0;
+	ec_breaker_stale = TRUE;
+
+	// As probe does, before the statistics start
+	msi_ec_fw_identity_read(&fw);
+	mock.count = 0;
+	memset(flights, 0, sizeof(flights));
+	memset(&sched, 0, sizeof(sched));
+	return 0;
+}
+
+static void msi_ec_test_exit(struct kunit *test)
+{
+	struct msi_ec_test_state *saved = test->priv;
+
+	event_dev = saved->event_dev;
+	msiacpi_led_kbdlight.dev = saved->kbd_bl_dev;
+	backend = saved->backend;
+	atomic_set(&kbd_bl_written, saved->kbd_bl_written);
+	ec_breaker_stale = saved->ec_breaker_stale;
+	ec_breaker_threshold = saved->ec_breaker_threshold;
+	ec_budget_burst = saved->ec_budget_burst;
+	ec_budget = saved->ec_budget;
+	sched = saved->sched;
+	breaker = saved->breaker;
+	budget = saved->budget;
+	memcpy(event_regs, saved->event_regs, sizeof(event_regs));
+	memcpy(flights, saved->flights, sizeof(flights));
+	fw = saved->fw;
+
+	// The enum attributes and the snapshot are derived from conf
+	memcpy(&conf, &saved->conf, sizeof(conf));
+	msi_ec_enum_bind();
+	msi_ec_snapshot_init();
+}
+
+// ============================================================ //
+// Root attributes
+// ============================================================ //
+
+static void test_webcam(struct kunit *test)
+{
+	EXPECT_SHOW(test, ENUM_ATTR(WEBCAM), "on\n");
+	EXPECT_TX(test, RD(0x2e));
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(WEBCAM), "off\n");
+	EXPECT_TX(test, RD(0x2e), WR(0x2e, 0x00));
+	EXPECT_SHOW(test, ENUM_ATTR(WEBCAM), "off\n");
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(WEBCAM), "on");
+	EXPECT_TX(test, RD(0x2e), WR(0x2e, 0x02));
+
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(WEBCAM), "maybe\n"), (ssize_t)-EINVAL);
+	EXPECT_NO_TX(test);
+
+	EXPECT_SHOW(test, &dev_attr_webcam_hard_block, "0\n");
+	EXPECT_TX(test, RD(0x2f));
+	mock.regs[0x2f] = 0x00;
+	EXPECT_SHOW(test, &dev_attr_webcam_hard_block, "1\n");
+}
+
+static void test_fn_win_key(struct kunit *test)
+{
+	EXPECT_SHOW(test, ENUM_ATTR(FN_KEY), "left\n");
+	EXPECT_TX(test, RD(0xbf));
+	EXPECT_SHOW(test, ENUM_ATTR(WIN_KEY), "right\n");
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(FN_KEY), "right\n");
+	EXPECT_TX(test, RD(0xbf), WR(0xbf, 0x00));
+	EXPECT_SHOW(test, ENUM_ATTR(FN_KEY), "right\n");
+	EXPECT_SHOW(test, ENUM_ATTR(WIN_KEY), "left\n");
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(WIN_KEY), "right\n");
+	EXPECT_TX(test, RD(0xbf), WR(0xbf, 0x10));
+	EXPECT_SHOW(test, ENUM_ATTR(FN_KEY), "left\n");
+
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(FN_KEY), "up\n"), (ssize_t)-EINVAL);
+	EXPECT_NO_TX(test);
+}
+
+static void test_battery_charge_mode(struct kunit *test)
+{
+	EXPECT_SHOW(test, ENUM_ATTR(BATTERY_CHARGE_MODE), "max\n");
+	EXPECT_TX(test, RD(0xef));
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(BATTERY_CHARGE_MODE), "medium\n");
+	EXPECT_TX(test, WR(0xef, 0xd0));
+	EXPECT_SHOW(test, ENUM_ATTR(BATTERY_CHARGE_MODE), "medium\n");
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(BATTERY_CHARGE_MODE), "min\n");
+	EXPECT_TX(test, WR(0xef, 0xbc));
+	EXPECT_SHOW(test, ENUM_ATTR(BATTERY_CHARGE_MODE), "min\n");
+
+	mock.regs[0xef] = 0x42;
+	EXPECT_SHOW(test, ENUM_ATTR(BATTERY_CHARGE_MODE), "unknown (66)\n");
+
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(BATTERY_CHARGE_MODE), "full\n"),
+			(ssize_t)-EINVAL);
+	EXPECT_NO_TX(test);
+}
+
+static void test_cooler_boost(struct kunit *test)
+{
+	EXPECT_SHOW(test, ENUM_ATTR(COOLER_BOOST), "off\n");
+	EXPECT_TX(test, RD(0x98));
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(COOLER_BOOST), "on\n");
+	EXPECT_TX(test, RD(0x98), WR(0x98, 0x80));
+	EXPECT_SHOW(test, ENUM_ATTR(COOLER_BOOST), "on\n");
+
+	// Values can also be given by their index
+	EXPECT_STORE_OK(test, ENUM_ATTR(COOLER_BOOST), "0\n");
+	EXPECT_TX(test, RD(0x98), WR(0x98, 0x00));
+
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(COOLER_BOOST), "2\n"), (ssize_t)-EINVAL);
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(COOLER_BOOST), "-1\n"), (ssize_t)-EINVAL);
+	EXPECT_NO_TX(test);
+}
+
+static void test_shift_mode(struct kunit *test)
+{
+	EXPECT_SHOW(test, ENUM_ATTR(SHIFT_MODE), "balanced\n");
+	EXPECT_TX(test, RD(0xf2));
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(SHIFT_MODE), "overclock\n");
+	EXPECT_TX(test, WR(0xf2, 0xc0));
+	EXPECT_SHOW(test, ENUM_ATTR(SHIFT_MODE), "overclock\n");
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(SHIFT_MODE), "eco\n");
+	EXPECT_TX(test, WR(0xf2, 0xc2));
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(SHIFT_MODE), "off\n");
+	EXPECT_TX(test, WR(0xf2, 0x80));
+	EXPECT_SHOW(test, ENUM_ATTR(SHIFT_MODE), "off\n");
+
+	mock.regs[0xf2] = 0x07;
+	EXPECT_SHOW(test, ENUM_ATTR(SHIFT_MODE), "unknown (7)\n");
+
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(SHIFT_MODE), "turbo\n"), (ssize_t)-EINVAL);
+	EXPECT_NO_TX(test);
+}
+
+static void test_fan_mode(struct kunit *test)
+{
+	EXPECT_SHOW(test, ENUM_ATTR(FAN_MODE), "auto\n");
+	EXPECT_TX(test, RD(0xd4));
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(FAN_MODE), "silent\n");
+	EXPECT_TX(test, RD(0xd4), WR(0xd4, 0x10));
+	EXPECT_SHOW(test, ENUM_ATTR(FAN_MODE), "silent\n");
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(FAN_MODE), "advanced\n");
+	EXPECT_TX(test, RD(0xd4), WR(0xd4, 0x80));
+	EXPECT_SHOW(test, ENUM_ATTR(FAN_MODE), "advanced\n");
+
+	EXPECT_STORE_OK(test, ENUM_ATTR(FAN_MODE), "auto\n");
+	EXPECT_SHOW(test, ENUM_ATTR(FAN_MODE), "auto\n");
+
+	// The basic fan mode bit is not supported on this model
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(FAN_MODE), "basic\n"), (ssize_t)-EINVAL);
+	EXPECT_NO_TX(test);
+	mock.regs[0xd4] = 0x40;
+	EXPECT_SHOW(test, ENUM_ATTR(FAN_MODE), "auto\n");
+
+	// Silent wins when the firmware also sets the advanced bit
+	mock.regs[0xd4] = 0x90;
+	EXPECT_SHOW(test, ENUM_ATTR(FAN_MODE), "silent\n");
+}
+
+static void test_preset(struct kunit *test)
+{
+	static const char *const names[] = {
+		"super_battery", "silent", "balanced", "high_performance",
+	};
+	char expected[32];
+	int i;
+
+	EXPECT_SHOW(test, &dev_attr_preset, "balanced\n");
+
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		snprintf(expected, sizeof(expected), "%s\n", names[i]);
+		EXPECT_STORE_OK(test, &dev_attr_preset, expected);
+		EXPECT_SHOW(test, &dev_attr_preset, expected);
+	}
+
+	EXPECT_STORE_OK(test, &dev_attr_preset, "silent\n");
+	EXPECT_TX(test, WR(0xed, 0xa1), WR(0xd5, 0xa1), WR(0xf2, 0xc1),
+		  WR(0xf3, 0x80), RD(0xf4), WR(0xf4, 0x10), WR(0x33, 0x0d),
+		  RD(0xd4), WR(0xd4, 0x00));
+
+	mock.regs[0xed] = 0x12;
+	EXPECT_SHOW(test, &dev_attr_preset, "custom\n");
+
+	KUNIT_EXPECT_EQ(test, store(&dev_attr_preset, "fast\n"), (ssize_t)-EINVAL);
+	EXPECT_NO_TX(test);
+}
+
+static void test_fw_identity(struct kunit *test)
+{
+	struct kobj_uevent_env *env = kunit_kzalloc(test, sizeof(*env),
+						    GFP_KERNEL);
+
+	// Read at probe (test init here), served from memory
+	EXPECT_SHOW(test, &dev_attr_fw_version, "14DLEMS1.105\n");
+	EXPECT_SHOW(test, &dev_attr_fw_release_date, "2023/03/30 10:05:00\n");
+	EXPECT_SHOW(test, &dev_attr_fw_release_date_iso8601,
+		    "2023-03-30T10:05:00\n");
+	EXPECT_SHOW(test, &dev_attr_fw_release_date_epoch, "1680170700\n");
+	EXPECT_NO_TX(test);
+
+	KUNIT_ASSERT_NOT_NULL(test, env);
+	KUNIT_EXPECT_EQ(test, msi_ec_device_type.uevent(NULL, env), 0);
+	KUNIT_EXPECT_EQ(test, env->envp_idx, 2);
+	KUNIT_EXPECT_STREQ(test, env->envp[0], "MSI_EC_FW_VERSION=14DLEMS1.105");
+	KUNIT_EXPECT_STREQ(test, env->envp[1],
+			   "MSI_EC_FW_RELEASE_DATE=2023-03-30T10:05:00");
+
+	mock_clear_tx();
+	KUNIT_EXPECT_EQ(test, msi_ec_fw_identity_read(&fw), 0);
+	KUNIT_EXPECT_EQ(test, mock.count, MSI_EC_FW_VERSION_LENGTH +
+			MSI_EC_FW_DATE_LENGTH + MSI_EC_FW_TIME_LENGTH);
+
+	// A date that does not parse hides the date attributes
+	mock.regs[MSI_EC_FW_DATE_ADDRESS + 2] = '4';
+	KUNIT_EXPECT_EQ(test, msi_ec_fw_identity_read(&fw), 0);
+	KUNIT_EXPECT_FALSE(test, fw.dated);
+	KUNIT_EXPECT_EQ(test, msi_root_is_visible(NULL,
+			&dev_attr_fw_release_date_epoch.attr, 0), (umode_t)0);
+	EXPECT_SHOW(test, &dev_attr_fw_version, "14DLEMS1.105\n");
+}
+
+static void test_power(struct kunit *test)
+{
+	EXPECT_SHOW(test, &dev_attr_ac_connected, "1\n");
+	EXPECT_TX(test, RD(0x30));
+	EXPECT_SHOW(test, &dev_attr_lid_open, "1\n");
+	EXPECT_TX(test, RD(0x30));
+
+	mock.regs[0x30] = 0x00;
+	EXPECT_SHOW(test, &dev_attr_ac_connected, "0\n");
+	EXPECT_SHOW(test, &dev_attr_lid_open, "0\n");
+}
+
+// ============================================================ //
+// CPU and GPU attributes
+// ============================================================ //
+
+static void test_cpu_gpu(struct kunit *test)
+{
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "45\n");
+	EXPECT_TX(test, RD(0x68));
+
+	mock.regs[0xcd] = 0x19;
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_fan_speed, "0\n");
+	mock.regs[0xcd] = 0x37;
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_fan_speed, "100\n");
+	EXPECT_TX(test, RD(0xcd));
+	mock.regs[0xcd] = 0x10;
+	KUNIT_EXPECT_EQ(test, show(test, &dev_attr_cpu_realtime_fan_speed,
+				   test_buf(test)),
+			(ssize_t)-EINVAL);
+
+	EXPECT_SHOW(test, &dev_attr_gpu_realtime_temperature, "40\n");
+	EXPECT_TX(test, RD(0x80));
+	mock.regs[0x89] = 77;
+	EXPECT_SHOW(test, &dev_attr_gpu_realtime_fan_speed, "77\n");
+	EXPECT_TX(test, RD(0x89));
+}
+
+// ============================================================ //
+// LEDs
+// ============================================================ //
+
+static void test_leds(struct kunit *test)
+{
+	mock_clear_tx();
+	KUNIT_EXPECT_EQ(test, micmute_led_cdev.brightness_set_blocking(&micmute_led_cdev, 1), 0);
+	EXPECT_TX(test, WR(0x2b, 0x94));
+
+	mock_clear_tx();
+	KUNIT_EXPECT_EQ(test, mute_led_cdev.brightness_set_blocking(&mute_led_cdev, 0), 0);
+	EXPECT_TX(test, WR(0x2c, 0x50));
+
+	mock_clear_tx();
+	KUNIT_EXPECT_EQ(test, msiacpi_led_kbdlight.brightness_get(&msiacpi_led_kbdlight),
+			(enum led_brightness)2);
+	EXPECT_TX(test, RD(0xf3));
+
+	mock_clear_tx();
+	KUNIT_EXPECT_EQ(test, msiacpi_led_kbdlight.brightness_set_blocking(&msiacpi_led_kbdlight, 3), 0);
+	EXPECT_TX(test, WR(0xf3, 0x83));
+
+	mock_clear_tx();
+	KUNIT_EXPECT_LT(test, msiacpi_led_kbdlight.brightness_set_blocking(&msiacpi_led_kbdlight, 4), 0);
+	EXPECT_NO_TX(test);
+
+	// Needed for brightness_hw_changed to exist
+	KUNIT_EXPECT_TRUE(test, msiacpi_led_kbdlight.flags & LED_BRIGHT_HW_CHANGED);
+	KUNIT_EXPECT_TRUE(test, msiacpi_led_kbdlight.flags & LED_RETAIN_AT_SHUTDOWN);
+}
+
+// ============================================================ //
+// Register map files
+// ============================================================ //
+
+#define RM(field, index, value) \
+	{ MSI_EC_RM_##field, index, cpu_to_le16(value) }
+
+static const struct firmware *
+regmap_blob(struct kunit *test, const struct msi_ec_regmap_entry *entries,
+	    int count)
+{
+	size_t size = sizeof(struct msi_ec_regmap_header) +
+		      count * sizeof(*entries);
+	struct msi_ec_regmap_header *header = kunit_kzalloc(test, size,
+							    GFP_KERNEL);
+	struct firmware *map = kunit_kzalloc(test, sizeof(*map), GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_NULL(test, header);
+	KUNIT_ASSERT_NOT_NULL(test, map);
+
+	memcpy(header->magic, MSI_EC_REGMAP_MAGIC, sizeof(header->magic));
+	header->version = MSI_EC_REGMAP_VERSION;
+	header->count = cpu_to_le16(count);
+	memcpy(header + 1, entries, count * sizeof(*entries));
+	header->crc32 = cpu_to_le32(crc32_le(~0, (const u8 *)(header + 1),
+					     count * sizeof(*entries)) ^ ~0);
+
+	map->data = (const u8 *)header;
+	map->size = size;
+	return map;
+}
+
+static void expect_no_unsupp_tx(struct kunit *test)
+{
+	int i;
+
+	for (i = 0; i < mock.count && i < MOCK_EC_MAX_TX; i++)
+		KUNIT_EXPECT_NE_MSG(test, mock.tx[i].addr, (u8)MSI_EC_ADDR_UNSUPP,
+				    "transaction %i", i);
+}
+
+static void test_regmap(struct kunit *test)
+{
+	// Every preset address but only one value, fan_mode without its bits
+	const struct msi_ec_regmap_entry partial[] = {
+		RM(PRESET_ADDRESSES, 0, 0xed),
+		RM(PRESET_ADDRESSES, 1, 0xd5),
+		RM(PRESET_ADDRESSES, 2, 0xf2),
+		RM(PRESET_ADDRESSES, 3, 0xf3),
+		RM(PRESET_ADDRESSES, 4, 0xf4),
+		RM(PRESET_ADDRESSES, 5, 0x33),
+		RM(PRESET_VALUES, MSI_EC_PRESET_BALANCED * MSI_EC_PRESET_COLUMNS, 0xa1),
+		RM(PRESET_SILENT_FLAG_BIT, 0, 4),
+		RM(FAN_MODE_ADDRESS, 0, 0xd4),
+		RM(FAN_MODE_SILENT_BIT, 0, 4),
+	};
+	const struct msi_ec_regmap_entry bad_bit[] = {
+		RM(FAN_MODE_SILENT_BIT, 0, 8),
+	};
+	struct msi_ec_regmap_entry complete[MSI_EC_PRESET_COLUMNS *
+					    (MSI_EC_PRESET_COUNT + 1) + 1];
+	const struct firmware *map;
+	struct firmware corrupt;
+	int count = 0;
+	int c, p;
+
+	regmap_init_unsupported(&conf);
+	KUNIT_EXPECT_EQ(test, regmap_parse(regmap_blob(test, partial,
+						       ARRAY_SIZE(partial)),
+					   &conf),
+			(int)ARRAY_SIZE(partial));
+	KUNIT_EXPECT_EQ(test, conf.preset.addresses[5], 0x33);
+	KUNIT_EXPECT_EQ(test, conf.preset.values[MSI_EC_PRESET_BALANCED][0], 0xa1);
+	KUNIT_EXPECT_EQ(test, conf.preset.values[MSI_EC_PRESET_BALANCED][1],
+			MSI_EC_VALUE_UNSUPP);
+	KUNIT_EXPECT_EQ(test, conf.fan_mode.advanced_bit, MSI_EC_BIT_UNSUPP);
+	KUNIT_EXPECT_EQ(test, conf.webcam.address, MSI_EC_ADDR_UNSUPP);
+
+	// A preset that cannot be set completely is hidden...
+	KUNIT_EXPECT_EQ(test, msi_root_is_visible(NULL, &dev_attr_preset.attr, 0),
+			(umode_t)0);
+
+	// ...and refused, rather than writing the values the map did not give
+	KUNIT_EXPECT_EQ(test, store(&dev_attr_preset, "balanced\n"),
+			(ssize_t)-EOPNOTSUPP);
+	EXPECT_NO_TX(test);
+	KUNIT_EXPECT_EQ(test, show(test, &dev_attr_preset, test_buf(test)),
+			(ssize_t)-EOPNOTSUPP);
+	EXPECT_NO_TX(test);
+
+	// With every address, value and the silent flag bit it is usable
+	regmap_init_unsupported(&conf);
+	for (c = 0; c < MSI_EC_PRESET_COLUMNS; c++) {
+		complete[count++] = (struct msi_ec_regmap_entry)
+			RM(PRESET_ADDRESSES, c, CONF_MODERN_14_B5M.preset.addresses[c]);
+		for (p = 0; p < MSI_EC_PRESET_COUNT; p++)
+			complete[count++] = (struct msi_ec_regmap_entry)
+				RM(PRESET_VALUES, p * MSI_EC_PRESET_COLUMNS + c,
+				   CONF_MODERN_14_B5M.preset.values[p][c]);
+	}
+	complete[count++] = (struct msi_ec_regmap_entry)
+		RM(PRESET_SILENT_FLAG_BIT, 0, 4);
+	KUNIT_EXPECT_EQ(test, regmap_parse(regmap_blob(test, complete, count),
+					   &conf),
+			count);
+	KUNIT_EXPECT_EQ(test, msi_root_is_visible(NULL, &dev_attr_preset.attr, 0),
+			dev_attr_preset.attr.mode);
+	EXPECT_STORE_OK(test, &dev_attr_preset, "balanced\n");
+	EXPECT_TX(test, WR(0xed, 0xa1), WR(0xd5, 0xa1), WR(0xf2, 0xc1),
+		  WR(0xf3, 0x80), RD(0xf4), WR(0xf4, 0x00), WR(0x33, 0x0d));
+	EXPECT_SHOW(test, &dev_attr_preset, "balanced\n");
+	expect_no_unsupp_tx(test);
+
+	// Malformed maps are rejected
+	KUNIT_EXPECT_EQ(test, regmap_parse(regmap_blob(test, bad_bit, 1), &conf),
+			-EINVAL);
+	corrupt = *regmap_blob(test, partial, ARRAY_SIZE(partial));
+	corrupt.size--;
+	KUNIT_EXPECT_EQ(test, regmap_parse(&corrupt, &conf), -EINVAL);
+	map = regmap_blob(test, partial, ARRAY_SIZE(partial));
+	((u8 *)map->data)[sizeof(struct msi_ec_regmap_header)] ^= 1;
+	KUNIT_EXPECT_EQ(test, regmap_parse(map, &conf), -EBADMSG);
+}
+
+// ============================================================ //
+// Suspend/resume
+// ============================================================ //
+
+static void test_suspend_resume(struct kunit *test)
+{
+	mock_clear_tx();
+	KUNIT_EXPECT_EQ(test, msi_ec_suspend(NULL), 0);
+	EXPECT_TX(test, RD(0xed), RD(0xd5), RD(0xf2), RD(0xf3), RD(0xf4),
+		  RD(0x33), RD(0x2e), RD(0xbf), RD(0xef), RD(0x98), RD(0xd4),
+		  RD(0x2b), RD(0x2c));
+
+	// Firmware reset two controls and touched a bit the driver does not own
+	mock.regs[0xef] = 0x42;
+	mock.regs[0x98] = 0x80;
+	mock.regs[0xf4] = 0x01;
+
+	mock_clear_tx();
+	KUNIT_EXPECT_EQ(test, msi_ec_resume(NULL), 0);
+	EXPECT_TX(test, RD(0xed), RD(0xd5), RD(0xf2), RD(0xf3), RD(0xf4),
+		  RD(0x33), RD(0x2e), RD(0xbf), RD(0xef), WR(0xef, 0xe4),
+		  RD(0x98), WR(0x98, 0x00), RD(0xd4), RD(0x2b), RD(0x2c));
+	KUNIT_EXPECT_EQ(test, mock.regs[0xf4], 0x01);
+
+	// Registers that could not be saved are left alone
+	mock_fail(0xef, -ETIME);
+	msi_ec_suspend(NULL);
+	mock.error_addr = -1;
+	mock.regs[0xef] = 0x42;
+	mock_clear_tx();
+	msi_ec_resume(NULL);
+	KUNIT_EXPECT_EQ(test, mock.regs[0xef], 0x42);
+
+	// The snapshot is read from the EC even when reads are throttled...
+	ec_budget = 1;
+	ec_budget_burst = 1;
+	EXPECT_SHOW(test, ENUM_ATTR(BATTERY_CHARGE_MODE), "unknown (66)\n");
+	mock.regs[0xef] = 0xe4;
+	EXPECT_SHOW(test, ENUM_ATTR(BATTERY_CHARGE_MODE), "unknown (66)\n");
+	mock_clear_tx();
+	msi_ec_suspend(NULL);
+	KUNIT_EXPECT_EQ(test, mock.count, snapshot_count);
+	mock.regs[0xef] = 0x42;
+	msi_ec_resume(NULL);
+	KUNIT_EXPECT_EQ(test, mock.regs[0xef], 0xe4);
+	ec_budget = 0;
+
+	// ...and not taken at all while the circuit breaker is open
+	breaker.state = MSI_EC_BREAKER_OPEN;
+	ec_breaker_threshold = 3;
+	mock_clear_tx();
+	msi_ec_suspend(NULL);
+	EXPECT_NO_TX(test);
+	breaker.state = MSI_EC_BREAKER_CLOSED;
+	mock.regs[0xef] = 0x42;
+	msi_ec_resume(NULL);
+	EXPECT_NO_TX(test);
+	KUNIT_EXPECT_EQ(test, mock.regs[0xef], 0x42);
+}
+
+// ============================================================ //
+// EC events
+// ============================================================ //
+
+static void test_events(struct kunit *test)
+{
+	msi_ec_event_reset();
+
+	mock_clear_tx();
+	msi_ec_event_process(MSI_EC_EVENT_ALL);
+	EXPECT_TX(test, RD(0x30), RD(0xf3), RD(0x2e), RD(0x2f));
+
+	// Each source only re-reads its own register
+	mock.regs[0x30] = 0x02;
+	mock_clear_tx();
+	msi_ec_event_process(MSI_EC_EVENT_POWER);
+	EXPECT_TX(test, RD(0x30));
+	KUNIT_EXPECT_EQ(test, event_regs[0].value, 0x02);
+
+	mock_clear_tx();
+	msi_ec_event_process(MSI_EC_EVENT_KBD_BL | MSI_EC_EVENT_WEBCAM);
+	EXPECT_TX(test, RD(0xf3), RD(0x2e), RD(0x2f));
+
+	// A failed read drops the cached value instead of keeping a stale one
+	mock_fail(0x2e, -ETIME);
+	msi_ec_event_process(MSI_EC_EVENT_WEBCAM);
+	KUNIT_EXPECT_FALSE(test, event_regs[2].valid);
+	KUNIT_EXPECT_TRUE(test, event_regs[1].valid);
+	KUNIT_EXPECT_TRUE(test, event_regs[3].valid);
+}
+
+#define TEST_MAX_NOTIFIED 8
+
+static struct {
+	const char *attrs[TEST_MAX_NOTIFIED];
+	int count;
+	int kbd_bl; /* -1 if not notified */
+} notified;
+
+static void test_notify(const char *attr)
+{
+	if (notified.count < TEST_MAX_NOTIFIED)
+		notified.attrs[notified.count] = attr;
+	notified.count++;
+}
+
+static void test_notify_kbd_bl(unsigned int level)
+{
+	notified.kbd_bl = level;
+}
+
+static void notified_clear(void)
+{
+	memset(&notified, 0, sizeof(notified));
+	notified.kbd_bl = -1;
+}
+
+#define EXPECT_NOTIFIED(test, attr)                                  \
+	do {                                                         \
+		KUNIT_EXPECT_EQ(test, notified.count, 1);            \
+		if (notified.count == 1)                             \
+			KUNIT_EXPECT_STREQ(test, notified.attrs[0], attr); \
+		notified_clear();                                    \
+	} while (0)
+
+static void test_event_notify(struct kunit *test)
+{
+	struct device *dev = kunit_kzalloc(test, sizeof(*dev), GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_NULL(test, dev);
+	kunit_activate_static_stub(test, msi_ec_notify, test_notify);
+	kunit_activate_static_stub(test, msi_ec_notify_kbd_bl,
+				   test_notify_kbd_bl);
+	notified_clear();
+	event_dev = dev;
+	msiacpi_led_kbdlight.dev = dev;
+
+	// Events without a bound device are dropped, conf is not set up yet
+	event_dev = NULL;
+	mock_clear_tx();
+	msi_ec_backend_event(MSI_EC_EVENT_ALL);
+	flush_work(&event_work);
+	EXPECT_NO_TX(test);
+	KUNIT_EXPECT_EQ(test, atomic_read(&event_pending), 0);
+	event_dev = dev;
+
+	// The first read only fills the cache
+	msi_ec_event_reset();
+	msi_ec_event_process(MSI_EC_EVENT_ALL);
+	KUNIT_EXPECT_EQ(test, notified.count, 0);
+
+	mock.regs[0x30] ^= BIT(conf.power.ac_connected_bit);
+	msi_ec_event_process(MSI_EC_EVENT_POWER);
+	EXPECT_NOTIFIED(test, "ac_connected");
+	mock.regs[0x30] ^= BIT(conf.power.lid_open_bit);
+	msi_ec_event_process(MSI_EC_EVENT_POWER);
+	EXPECT_NOTIFIED(test, "lid_open");
+
+	mock.regs[0x2e] ^= BIT(conf.webcam.bit);
+	msi_ec_event_process(MSI_EC_EVENT_WEBCAM);
+	EXPECT_NOTIFIED(test, "webcam");
+	mock.regs[0x2f] ^= BIT(conf.webcam.hard_bit);
+	msi_ec_event_process(MSI_EC_EVENT_WEBCAM);
+	EXPECT_NOTIFIED(test, "webcam_hard_block");
+
+	// Fn key backlight changes, but not the level the LED core just set
+	mock.regs[0xf3] = conf.kbd_bl.states[3];
+	msi_ec_event_process(MSI_EC_EVENT_KBD_BL);
+	KUNIT_EXPECT_EQ(test, notified.kbd_bl, 3);
+	notified_clear();
+	KUNIT_EXPECT_EQ(test, kbd_bl_sysfs_set(&msiacpi_led_kbdlight, 1), 0);
+	msi_ec_event_process(MSI_EC_EVENT_KBD_BL);
+	KUNIT_EXPECT_EQ(test, notified.kbd_bl, -1);
+	KUNIT_EXPECT_EQ(test, notified.count, 0);
+
+	// Whatever the LED core last cached, every Fn key change is reported
+	mock.regs[0xf3] = conf.kbd_bl.states[2];
+	msi_ec_event_process(MSI_EC_EVENT_KBD_BL);
+	KUNIT_EXPECT_EQ(test, notified.kbd_bl, 2);
+	mock.regs[0xf3] = conf.kbd_bl.states[3];
+	msi_ec_event_process(MSI_EC_EVENT_KBD_BL);
+	KUNIT_EXPECT_EQ(test, notified.kbd_bl, 3);
+	mock.regs[0xf3] = conf.kbd_bl.states[2];
+	msi_ec_event_process(MSI_EC_EVENT_KBD_BL);
+	KUNIT_EXPECT_EQ(test, notified.kbd_bl, 2);
+	notified_clear();
+
+	// Stores to a watched attribute notify as well, for other readers
+	EXPECT_STORE_OK(test, ENUM_ATTR(WEBCAM), "off\n");
+	EXPECT_NOTIFIED(test, "webcam");
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(WEBCAM), "maybe\n"), (ssize_t)-EINVAL);
+	EXPECT_STORE_OK(test, ENUM_ATTR(FN_KEY), "left\n");
+	KUNIT_EXPECT_EQ(test, notified.count, 0);
+}
+
+// ============================================================ //
+// Read coalescing
+// ============================================================ //
+
+static void test_read_coalescing(struct kunit *test)
+{
+	const struct msi_ec_flight *f = &flights[0x68];
+	u8 data;
+
+	// Without concurrent readers every read is its own transaction
+	KUNIT_EXPECT_EQ(test, msi_ec_read(0x68, &data), 0);
+	KUNIT_EXPECT_EQ(test, msi_ec_read(0x68, &data), 0);
+	KUNIT_EXPECT_EQ(test, f->reads, 2ULL);
+	KUNIT_EXPECT_EQ(test, f->coalesced, 0ULL);
+	KUNIT_EXPECT_EQ(test, f->generation, 2U);
+	KUNIT_EXPECT_FALSE(test, f->busy);
+	KUNIT_EXPECT_EQ(test, f->value, mock.regs[0x68]);
+
+	// Failed reads complete the flight too, keeping the last good value
+	mock_fail(0x68, -ETIME);
+	KUNIT_EXPECT_EQ(test, msi_ec_read(0x68, &data), -ETIME);
+	KUNIT_EXPECT_EQ(test, f->result, -ETIME);
+	KUNIT_EXPECT_FALSE(test, f->busy);
+	KUNIT_EXPECT_EQ(test, f->value, mock.regs[0x68]);
+
+	// A write keeps later readers out of the read before it
+	EXPECT_STORE_OK(test, ENUM_ATTR(WEBCAM), "on\n");
+	KUNIT_EXPECT_FALSE(test, flights[0x2e].joinable);
+}
+
+// ============================================================ //
+// EC scheduling
+// ============================================================ //
+
+static void test_scheduling(struct kunit *test)
+{
+	struct msi_ec_queue *interactive = &sched.queues[MSI_EC_INTERACTIVE];
+	struct msi_ec_queue *background = &sched.queues[MSI_EC_BACKGROUND];
+
+	// Telemetry is background, setting changes (reads included) interactive
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "45\n");
+	KUNIT_EXPECT_EQ(test, background->requests, 1ULL);
+	KUNIT_EXPECT_EQ(test, interactive->requests, 0ULL);
+	EXPECT_STORE_OK(test, ENUM_ATTR(WEBCAM), "on\n");
+	KUNIT_EXPECT_EQ(test, interactive->requests, 2ULL);
+	KUNIT_EXPECT_EQ(test, background->requests, 1ULL);
+	KUNIT_EXPECT_FALSE(test, sched.busy);
+	KUNIT_EXPECT_EQ(test, interactive->queued + background->queued, 0ULL);
+
+	KUNIT_EXPECT_EQ(test, msi_ec_sched_pick(), MSI_EC_CLASSES);
+
+	background->depth = 1;
+	KUNIT_EXPECT_EQ(test, msi_ec_sched_pick(), MSI_EC_BACKGROUND);
+
+	interactive->depth = 1;
+	KUNIT_EXPECT_EQ(test, msi_ec_sched_pick(), MSI_EC_INTERACTIVE);
+
+	// A background request gets its turn after a burst of interactive ones
+	sched.burst = MSI_EC_INTERACTIVE_BURST;
+	KUNIT_EXPECT_EQ(test, msi_ec_sched_pick(), MSI_EC_BACKGROUND);
+	background->depth = 0;
+	KUNIT_EXPECT_EQ(test, msi_ec_sched_pick(), MSI_EC_INTERACTIVE);
+
+	memset(&sched, 0, sizeof(sched));
+}
+
+// ============================================================ //
+// EC budget
+// ============================================================ //
+
+static void test_budget(struct kunit *test)
+{
+	ec_budget = 2;
+	ec_budget_burst = 2;
+
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "45\n");
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "45\n");
+	EXPECT_TX(test, RD(0x68));
+
+	// Out of tokens: the last value is served without a transaction
+	mock.regs[0x68] = 50;
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "45\n");
+	EXPECT_NO_TX(test);
+	KUNIT_EXPECT_EQ(test, budget.throttled, 1ULL);
+	KUNIT_EXPECT_EQ(test, flights[0x68].throttled, 1ULL);
+
+	// Setting changes and never read registers still go to the EC
+	EXPECT_STORE_OK(test, ENUM_ATTR(WEBCAM), "off\n");
+	EXPECT_TX(test, RD(0x2e), WR(0x2e, 0x00));
+	EXPECT_SHOW(test, &dev_attr_gpu_realtime_temperature, "40\n");
+	EXPECT_TX(test, RD(0x80));
+	KUNIT_EXPECT_EQ(test, budget.overdrawn, 3ULL);
+
+	// A written value is served as the last one
+	EXPECT_SHOW(test, ENUM_ATTR(WEBCAM), "off\n");
+	EXPECT_NO_TX(test);
+
+	ec_budget = 0;
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "50\n");
+}
+
+// ============================================================ //
+// Circuit breaker
+// ============================================================ //
+
+static void test_breaker(struct kunit *test)
+{
+	char *buf = test_buf(test);
+
+	ec_breaker_threshold = 3;
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "45\n");
+
+	// The third failure in a row opens it, and is served the last value
+	mock_fail(0x68, -ETIME);
+	KUNIT_EXPECT_EQ(test, show(test, &dev_attr_cpu_realtime_temperature, buf),
+			(ssize_t)-ETIME);
+	KUNIT_EXPECT_EQ(test, show(test, &dev_attr_cpu_realtime_temperature, buf),
+			(ssize_t)-ETIME);
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "45\n");
+	EXPECT_TX(test, RD(0x68));
+	EXPECT_SHOW(test, &dev_attr_breaker_state, "open\n");
+	EXPECT_SHOW(test, &dev_attr_breaker_trips, "1\n");
+
+	// While open nothing reaches the EC
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "45\n");
+	EXPECT_NO_TX(test);
+	KUNIT_EXPECT_EQ(test, show(test, ENUM_ATTR(WEBCAM), buf), (ssize_t)-ETIME);
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(WEBCAM), "off\n"), (ssize_t)-ETIME);
+	EXPECT_NO_TX(test);
+	EXPECT_SHOW(test, &dev_attr_stale_reads, "2\n");
+	EXPECT_SHOW(test, &dev_attr_breaker_rejected, "3\n");
+
+	// A failed probe doubles the backoff, a successful one closes it
+	breaker.probe_ns = 0;
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "45\n");
+	EXPECT_TX(test, RD(0x68));
+	KUNIT_EXPECT_EQ(test, breaker.state, MSI_EC_BREAKER_OPEN);
+	KUNIT_EXPECT_EQ(test, breaker.backoff_ms, 2U * MSI_EC_BREAKER_BACKOFF_MIN_MS);
+
+	mock.error_addr = -1;
+	mock.regs[0x68] = 50;
+	breaker.probe_ns = 0;
+	EXPECT_SHOW(test, &dev_attr_cpu_realtime_temperature, "50\n");
+	EXPECT_TX(test, RD(0x68));
+	EXPECT_SHOW(test, &dev_attr_breaker_state, "closed\n");
+	EXPECT_SHOW(test, &dev_attr_breaker_failures, "0\n");
+
+	// Without stale values it only fails fast
+	ec_breaker_stale = FALSE;
+	mock_fail(0x68, -EIO);
+	KUNIT_EXPECT_EQ(test, show(test, &dev_attr_cpu_realtime_temperature, buf),
+			(ssize_t)-EIO);
+	KUNIT_EXPECT_EQ(test, show(test, &dev_attr_cpu_realtime_temperature, buf),
+			(ssize_t)-EIO);
+	KUNIT_EXPECT_EQ(test, show(test, &dev_attr_cpu_realtime_temperature, buf),
+			(ssize_t)-EIO);
+	KUNIT_EXPECT_EQ(test, show(test, &dev_attr_cpu_realtime_temperature, buf),
+			(ssize_t)-EIO);
+	EXPECT_NO_TX(test);
+	EXPECT_SHOW(test, &dev_attr_breaker_trips, "2\n");
+}
+
+// ============================================================ //
+// Error propagation
+// ============================================================ //
+
+static void test_errors(struct kunit *test)
+{
+	char *buf = test_buf(test);
+
+	mock_fail(0x2e, -ETIME);
+	KUNIT_EXPECT_EQ(test, show(test, ENUM_ATTR(WEBCAM), buf), (ssize_t)-ETIME);
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(WEBCAM), "on\n"), (ssize_t)-ETIME);
+	EXPECT_TX(test, RD(0x2e));
+
+	mock_fail(0xef, -EIO);
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(BATTERY_CHARGE_MODE), "min\n"),
+			(ssize_t)-EIO);
+
+	// A failure half way through a multi-byte read aborts it
+	mock_fail(MSI_EC_FW_VERSION_ADDRESS + 3, -ETIME);
+	mock_clear_tx();
+	KUNIT_EXPECT_EQ(test, msi_ec_fw_identity_read(&fw), -ETIME);
+	KUNIT_EXPECT_EQ(test, mock.count, 4);
+
+	mock_fail(0xd4, -EBUSY);
+	KUNIT_EXPECT_EQ(test, store(ENUM_ATTR(FAN_MODE), "silent\n"), (ssize_t)-EBUSY);
+	EXPECT_TX(test, RD(0xd4));
+
+	mock_fail(0x68, -ETIME);
+	KUNIT_EXPECT_EQ(test, show(test, &dev_attr_cpu_realtime_temperature, buf),
+			(ssize_t)-ETIME);
+
+	mock_fail(0x2b, -EIO);
+	KUNIT_EXPECT_EQ(test, micmute_led_cdev.brightness_set_blocking(&micmute_led_cdev, 1),
+			-EIO);
+
+	mock_fail(0xf3, -EIO);
+	KUNIT_EXPECT_EQ(test, msiacpi_led_kbdlight.brightness_get(&msiacpi_led_kbdlight),
+			(enum led_brightness)0);
+}
+
+// ============================================================ //
+// Transaction budgets
+// ============================================================ //
+
+struct msi_ec_test_budget {
+	struct device_attribute *attr;
+	const char *input; /* NULL to benchmark show */
+	int max_tx;
+};
+
+static const struct msi_ec_test_budget msi_ec_test_budgets[] = {
+	{ ENUM_ATTR(WEBCAM), NULL, 1 },
+	{ ENUM_ATTR(WEBCAM), "on\n", 2 },
+	{ &dev_attr_webcam_hard_block, NULL, 1 },
+	{ ENUM_ATTR(FN_KEY), NULL, 1 },
+	{ ENUM_ATTR(FN_KEY), "left\n", 2 },
+	{ ENUM_ATTR(WIN_KEY), NULL, 1 },
+	{ ENUM_ATTR(WIN_KEY), "right\n", 2 },
+	{ ENUM_ATTR(BATTERY_CHARGE_MODE), NULL, 1 },
+	{ ENUM_ATTR(BATTERY_CHARGE_MODE), "max\n", 1 },
+	{ ENUM_ATTR(COOLER_BOOST), NULL, 1 },
+	{ ENUM_ATTR(COOLER_BOOST), "off\n", 2 },
+	{ ENUM_ATTR(SHIFT_MODE), NULL, 1 },
+	{ ENUM_ATTR(SHIFT_MODE), "balanced\n", 1 },
+	{ ENUM_ATTR(FAN_MODE), NULL, 1 },
+	{ ENUM_ATTR(FAN_MODE), "auto\n", 2 },
+	{ &dev_attr_preset, NULL, 12 },
+	{ &dev_attr_preset, "balanced\n", 9 },
+	{ &dev_attr_fw_version, NULL, 0 },
+	{ &dev_attr_fw_release_date, NULL, 0 },
+	{ &dev_attr_fw_release_date_iso8601, NULL, 0 },
+	{ &dev_attr_fw_release_date_epoch, NULL, 0 },
+	{ &dev_attr_ac_connected, NULL, 1 },
+	{ &dev_attr_lid_open, NULL, 1 },
+	{ &dev_attr_cpu_realtime_temperature, NULL, 1 },
+	{ &dev_attr_cpu_realtime_fan_speed, NULL, 1 },
+	{ &dev_attr_gpu_realtime_temperature, NULL, 1 },
+	{ &dev_attr_gpu_realtime_fan_speed, NULL, 1 },
+};
+
+#define MSI_EC_TEST_BENCH_ROUNDS 100
+
+static void test_budgets(struct kunit *test)
+{
+	const struct msi_ec_test_budget *b;
+	char *buf = test_buf(test);
+	u64 start, elapsed;
+	int tx;
+	int i;
+
+	for (b = msi_ec_test_budgets;
+	     b < msi_ec_test_budgets + ARRAY_SIZE(msi_ec_test_budgets); b++) {
+		if (b->input)
+			KUNIT_EXPECT_GT(test, store(b->attr, b->input), (ssize_t)0);
+		else
+			KUNIT_EXPECT_GT(test, show(test, b->attr, buf), (ssize_t)0);
+		tx = mock.count;
+
+		start = ktime_get_ns();
+		for (i = 0; i < MSI_EC_TEST_BENCH_ROUNDS; i++) {
+			if (b->input)
+				store(b->attr, b->input);
+			else
+				show(test, b->attr, buf);
+		}
+		elapsed = ktime_get_ns() - start;
+
+		kunit_info(test, "%-24s %-5s %3i tx (budget %i), %llu ns/op\n",
+			   b->attr->attr.name, b->input ? "store" : "show", tx,
+			   b->max_tx,
+			   (unsigned long long)(elapsed / MSI_EC_TEST_BENCH_ROUNDS));
+		KUNIT_EXPECT_LE_MSG(test, tx, b->max_tx, "%s %s",
+				    b->attr->attr.name,
+				    b->input ? "store" : "show");
+	}
+}
+
+static struct kunit_case msi_ec_test_cases[] = {
+	KUNIT_CASE(test_webcam),
+	KUNIT_CASE(test_fn_win_key),
+	KUNIT_CASE(test_battery_charge_mode),
+	KUNIT_CASE(test_cooler_boost),
+	KUNIT_CASE(test_shift_mode),
+	KUNIT_CASE(test_fan_mode),
+	KUNIT_CASE(test_preset),
+	KUNIT_CASE(test_fw_identity),
+	KUNIT_CASE(test_regmap),
+	KUNIT_CASE(test_power),
+	KUNIT_CASE(test_cpu_gpu),
+	KUNIT_CASE(test_leds),
+	KUNIT_CASE(test_suspend_resume),
+	KUNIT_CASE(test_events),
+	KUNIT_CASE(test_event_notify),
+	KUNIT_CASE(test_read_coalescing),
+	KUNIT_CASE(test_scheduling),
+	KUNIT_CASE(test_budget),
+	KUNIT_CASE(test_breaker),
+	KUNIT_CASE(test_errors),
+	KUNIT_CASE(test_budgets),
+	{}
+};
+
+static struct kunit_suite msi_ec_test_suite = {
+	.name = "msi-ec",
+	.init = msi_ec_test_init,
+	.exit = msi_ec_test_exit,
+	.test_cases = msi_ec_test_cases,
+};
+
+kunit_test_suite(msi_ec_test_suite);
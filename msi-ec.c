@@ -21,370 +21,1306 @@
  * This driver also registers available led class devices for
  * mute, micmute and keyboard_backlight leds
  *
- * This driver might not work on other laptops produced by MSI. Also, and until
- * future enhancements, no DMI data are used to identify your compatibility
+ * Register addresses are taken from a per-model configuration (constants.h),
+ * selected at probe time from the EC firmware version and DMI data, and can
+ * be overridden by a register map file (regmap.h) without rebuilding.
  *
  */
 
 #include "constants.h"
+#include "ec_backend.h"
+#include "regmap.h"
 
 #include <acpi/battery.h>
+#include <acpi/button.h>
+#include <kunit/static_stub.h>
 #include <linux/acpi.h>
+#include <linux/atomic.h>
+#include <linux/crc32.h>
+#include <linux/ctype.h>
+#include <linux/debugfs.h>
+#include <linux/dmi.h>
+#include <linux/firmware.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/leds.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/platform_device.h>
+#include <linux/pm.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <linux/string.h>
+#include <linux/time.h>
+#include <linux/version.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #define streq(x, y) (strcmp(x, y) == 0 || strcmp(x, y "\n") == 0)
 
-static int ec_read_seq(u8 addr, u8 *buf, u8 len)
+// ============================================================ //
+// EC backend
+// ============================================================ //
+
+static bool external_backend;
+module_param(external_backend, bool, 0444);
+MODULE_PARM_DESC(external_backend,
+		 "Don't use the ACPI EC, wait for a backend module such as msi-ec-sim (default: false)");
+
+#if IS_ENABLED(CONFIG_ACPI)
+static const struct msi_ec_backend acpi_backend = {
+	.name = "acpi",
+	.read = ec_read,
+	.write = ec_write,
+};
+#else
+// Without ACPI (e.g. KUnit on UML) only external backends can reach an EC
+static int no_ec_read(u8 addr, u8 *data)
 {
-	int result;
-	u8 i;
-	for (i = 0; i < len; i++) {
-		result = ec_read(addr + i, buf + i);
-		if (result < 0)
-			return result;
-	}
-	return 0;
+	return -ENODEV;
 }
 
-static int ec_write_bit(u8 addr, u8 index, bool set)
+static int no_ec_write(u8 addr, u8 data)
 {
-	u8 data;
-	int result;
+	return -ENODEV;
+}
 
-	result = ec_read(addr, &data);
-	if (result < 0)
-		return result;
-	if(set)
-		data |= (1UL << index);
-	else
-		data &= ~(1UL << index);
+static const struct msi_ec_backend acpi_backend = {
+	.name = "none",
+	.read = no_ec_read,
+	.write = no_ec_write,
+};
+#endif
+
+static const struct msi_ec_backend *backend = &acpi_backend;
+
+// ============================================================ //
+// EC circuit breaker
+// ============================================================ //
+
+/*
+ * An EC that stopped responding makes every transaction wait out the EC
+ * timeout. After ec_breaker_threshold failed transactions in a row the
+ * breaker opens: transactions fail at once with the last error, and reads
+ * of a register with a last known value are served that value, counted as
+ * stale. One transaction at a time is let through to probe the EC, first
+ * after MSI_EC_BREAKER_BACKOFF_MIN_MS, then after twice as long as before
+ * each time the probe fails; the first one that succeeds closes the
+ * breaker.
+ */
+
+#define MSI_EC_BREAKER_BACKOFF_MIN_MS 100
+#define MSI_EC_BREAKER_BACKOFF_MAX_MS 30000
+
+static unsigned int ec_breaker_threshold = 3;
+module_param(ec_breaker_threshold, uint, 0644);
+MODULE_PARM_DESC(ec_breaker_threshold,
+		 "Failed EC transactions in a row that open the circuit breaker, 0 to disable it (default: 3)");
+
+static bool ec_breaker_stale = TRUE;
+module_param(ec_breaker_stale, bool, 0644);
+MODULE_PARM_DESC(ec_breaker_stale,
+		 "Serve the last known values while the circuit breaker is open instead of failing (default: true)");
+
+enum msi_ec_breaker_state {
+	MSI_EC_BREAKER_CLOSED,
+	MSI_EC_BREAKER_OPEN,
+	MSI_EC_BREAKER_PROBING,
+};
+
+static const char *const msi_ec_breaker_state_names[] = {
+	[MSI_EC_BREAKER_CLOSED] = "closed",
+	[MSI_EC_BREAKER_OPEN] = "open",
+	[MSI_EC_BREAKER_PROBING] = "probing",
+};
+
+static struct {
+	enum msi_ec_breaker_state state;
+	unsigned int failures; /* in a row */
+	int error;	       /* of the last failure, returned while open */
+	unsigned int backoff_ms;
+	u64 probe_ns;	       /* when the next probe may go */
+
+	/* Reported in sysfs */
+	u64 trips;
+	u64 rejected;
+	u64 stale;
+} breaker;
+static DEFINE_MUTEX(breaker_lock);
+
+// 0 if a transaction may go to the EC, the error to fail it with otherwise
+static int msi_ec_breaker_enter(void)
+{
+	int result = 0;
+
+	if (!READ_ONCE(ec_breaker_threshold))
+		return 0;
+
+	mutex_lock(&breaker_lock);
+	if (breaker.state == MSI_EC_BREAKER_OPEN &&
+	    ktime_get_ns() >= breaker.probe_ns) {
+		breaker.state = MSI_EC_BREAKER_PROBING;
+	} else if (breaker.state != MSI_EC_BREAKER_CLOSED) {
+		breaker.rejected++;
+		result = breaker.error;
+	}
+	mutex_unlock(&breaker_lock);
 
-	return ec_write(addr, data);
+	return result;
 }
 
-static bool is_bit_set(u8 index, u8 byte)
+static void msi_ec_breaker_exit(int result)
 {
-	return (byte >> index) & 1UL;
+	unsigned int threshold = READ_ONCE(ec_breaker_threshold);
+
+	mutex_lock(&breaker_lock);
+	if (result == 0) {
+		if (breaker.state != MSI_EC_BREAKER_CLOSED)
+			pr_info("msi-ec: EC responding again, circuit breaker closed\n");
+		breaker.state = MSI_EC_BREAKER_CLOSED;
+		breaker.failures = 0;
+		mutex_unlock(&breaker_lock);
+		return;
+	}
+
+	breaker.failures++;
+	breaker.error = result;
+	if (breaker.state == MSI_EC_BREAKER_PROBING) {
+		breaker.backoff_ms = min_t(unsigned int, breaker.backoff_ms * 2,
+					   MSI_EC_BREAKER_BACKOFF_MAX_MS);
+	} else if (breaker.state == MSI_EC_BREAKER_CLOSED && threshold &&
+		   breaker.failures >= threshold) {
+		pr_warn("msi-ec: %u EC transactions failed in a row (error %i), circuit breaker open\n",
+			breaker.failures, result);
+		breaker.trips++;
+		breaker.backoff_ms = MSI_EC_BREAKER_BACKOFF_MIN_MS;
+	} else {
+		mutex_unlock(&breaker_lock);
+		return;
+	}
+	breaker.state = MSI_EC_BREAKER_OPEN;
+	breaker.probe_ns = ktime_get_ns() +
+			   (u64)breaker.backoff_ms * NSEC_PER_MSEC;
+	mutex_unlock(&breaker_lock);
+}
+
+// Whether a failed read is to be served its register's last known value
+static bool msi_ec_breaker_serve_stale(void)
+{
+	bool stale;
+
+	if (!READ_ONCE(ec_breaker_stale))
+		return FALSE;
+
+	mutex_lock(&breaker_lock);
+	stale = breaker.state != MSI_EC_BREAKER_CLOSED;
+	if (stale)
+		breaker.stale++;
+	mutex_unlock(&breaker_lock);
+
+	return stale;
 }
 
 // ============================================================ //
-// Sysfs platform device attributes (root)
+// EC scheduling
 // ============================================================ //
 
-static ssize_t webcam_show(struct device *device, struct device_attribute *attr,
-			   char *buf)
+/*
+ * The driver's EC transactions are issued one at a time in two classes:
+ * writes and the reads of read-modify-writes (setting changes, LEDs) are
+ * interactive, all other reads are background. When the EC is free again
+ * the oldest interactive request goes first, so an LED update waits for at
+ * most the transaction in flight and the interactive requests ahead of it,
+ * not for a burst of telemetry or a 24-read preset_show. After
+ * MSI_EC_INTERACTIVE_BURST interactive requests in a row a waiting
+ * background one is let through, so background reads cannot starve.
+ */
+
+#define MSI_EC_INTERACTIVE_BURST 8
+
+enum msi_ec_class {
+	MSI_EC_INTERACTIVE,
+	MSI_EC_BACKGROUND,
+	MSI_EC_CLASSES
+};
+
+static const char *const msi_ec_class_names[MSI_EC_CLASSES] = {
+	[MSI_EC_INTERACTIVE] = "interactive",
+	[MSI_EC_BACKGROUND] = "background",
+};
+
+struct msi_ec_queue {
+	u64 tickets; /* handed out to waiters */
+	u64 served;  /* waiters granted the EC, in ticket order */
+	unsigned int depth;
+
+	/* Reported in debugfs */
+	u64 requests;
+	u64 queued;
+	unsigned int max_depth;
+	u64 wait_ns;
+	u64 max_wait_ns;
+};
+
+static struct {
+	bool busy;
+	unsigned int burst; /* interactive grants since the last background one */
+	struct msi_ec_queue queues[MSI_EC_CLASSES];
+} sched;
+static DEFINE_MUTEX(sched_lock);
+static DECLARE_WAIT_QUEUE_HEAD(sched_wq);
+
+// Class to hand the EC to next, MSI_EC_CLASSES if nobody waits
+static enum msi_ec_class msi_ec_sched_pick(void)
 {
-	u8 rdata;
-	int result;
+	bool interactive = sched.queues[MSI_EC_INTERACTIVE].depth > 0;
+	bool background = sched.queues[MSI_EC_BACKGROUND].depth > 0;
+
+	if (interactive && (!background || sched.burst < MSI_EC_INTERACTIVE_BURST))
+		return MSI_EC_INTERACTIVE;
+	if (background)
+		return MSI_EC_BACKGROUND;
+	return MSI_EC_CLASSES;
+}
 
-	result = ec_read(MSI_EC_WEBCAM_ADDRESS, &rdata);
-	if (result < 0)
-		return result;
+static void msi_ec_sched_acquire(enum msi_ec_class class)
+{
+	struct msi_ec_queue *q = &sched.queues[class];
+	u64 ticket, start, wait;
+
+	mutex_lock(&sched_lock);
+	q->requests++;
+	if (!sched.busy) {
+		sched.busy = TRUE;
+		mutex_unlock(&sched_lock);
+		return;
+	}
 
-	if(is_bit_set(MSI_EC_WEBCAM_BIT, rdata))
-		return sprintf(buf, "%s\n", "on");
-	else
-		return sprintf(buf, "%s\n", "off");
+	ticket = q->tickets++;
+	q->queued++;
+	q->depth++;
+	if (q->depth > q->max_depth)
+		q->max_depth = q->depth;
+	mutex_unlock(&sched_lock);
+
+	start = ktime_get_ns();
+	wait_event(sched_wq, READ_ONCE(q->served) > ticket);
+	wait = ktime_get_ns() - start;
+
+	mutex_lock(&sched_lock);
+	q->wait_ns += wait;
+	if (wait > q->max_wait_ns)
+		q->max_wait_ns = wait;
+	mutex_unlock(&sched_lock);
 }
 
-static ssize_t webcam_store(struct device *dev, struct device_attribute *attr,
-			    const char *buf, size_t count)
+static void msi_ec_sched_release(void)
 {
-	int result = -EINVAL;
+	enum msi_ec_class next;
+
+	mutex_lock(&sched_lock);
+	next = msi_ec_sched_pick();
+	if (next == MSI_EC_CLASSES) {
+		sched.busy = FALSE;
+		mutex_unlock(&sched_lock);
+		return;
+	}
 
-	if (streq(buf, "on"))
-		result = ec_write_bit(MSI_EC_WEBCAM_ADDRESS,
-				      MSI_EC_WEBCAM_BIT,
-				      TRUE);
+	// The EC stays busy, it is handed over to the next waiter
+	sched.burst = next == MSI_EC_INTERACTIVE ? sched.burst + 1 : 0;
+	sched.queues[next].depth--;
+	WRITE_ONCE(sched.queues[next].served, sched.queues[next].served + 1);
+	mutex_unlock(&sched_lock);
+	wake_up_all(&sched_wq);
+}
 
-	if (streq(buf, "off"))
-		result = ec_write_bit(MSI_EC_WEBCAM_ADDRESS,
-				      MSI_EC_WEBCAM_BIT,
-				      FALSE);
+static int msi_ec_submit_read(u8 addr, u8 *data, enum msi_ec_class class)
+{
+	int result;
 
+	result = msi_ec_breaker_enter();
 	if (result < 0)
 		return result;
 
-	return count;
+	msi_ec_sched_acquire(class);
+	result = backend->read(addr, data);
+	msi_ec_sched_release();
+
+	msi_ec_breaker_exit(result);
+	return result;
 }
 
-static ssize_t fn_key_show(struct device *device, struct device_attribute *attr,
-			   char *buf)
+static int msi_ec_submit_write(u8 addr, u8 data)
 {
-	u8 rdata;
 	int result;
 
-	result = ec_read(MSI_EC_FN_WIN_ADDRESS, &rdata);
+	result = msi_ec_breaker_enter();
 	if (result < 0)
 		return result;
 
-	if(is_bit_set(MSI_EC_FN_WIN_BIT, rdata) == MSI_EC_FN_KEY_LEFT) {
-		return sprintf(buf, "%s\n", "left");
+	msi_ec_sched_acquire(MSI_EC_INTERACTIVE);
+	result = backend->write(addr, data);
+	msi_ec_sched_release();
+
+	msi_ec_breaker_exit(result);
+	return result;
+}
+
+static int ec_queue_show(struct seq_file *m, void *v)
+{
+	const struct msi_ec_queue *q;
+	int class;
+
+	seq_printf(m, "%-12s %12s %12s %6s %10s %12s %12s\n", "class",
+		   "requests", "queued", "depth", "max_depth", "avg_wait_us",
+		   "max_wait_us");
+
+	mutex_lock(&sched_lock);
+	for (class = 0; class < MSI_EC_CLASSES; class++) {
+		q = &sched.queues[class];
+		seq_printf(m, "%-12s %12llu %12llu %6u %10u %12llu %12llu\n",
+			   msi_ec_class_names[class],
+			   (unsigned long long)q->requests,
+			   (unsigned long long)q->queued, q->depth, q->max_depth,
+			   (unsigned long long)(q->queued ?
+				div64_u64(q->wait_ns, q->queued) / 1000 : 0),
+			   (unsigned long long)q->max_wait_ns / 1000);
 	}
-	else {
-		return sprintf(buf, "%s\n", "right");
+	mutex_unlock(&sched_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ec_queue);
+
+// ============================================================ //
+// EC budget
+// ============================================================ //
+
+/*
+ * The ACPI EC is shared with the battery, AC and thermal methods, so the
+ * driver's own traffic can be capped with a token bucket: ec_budget
+ * transactions per second, up to ec_budget_burst at once. Writes and the
+ * reads of read-modify-writes always go through (and use up tokens);
+ * other reads with no token left are served the last value read from or
+ * written to the register, if there is one.
+ */
+
+static unsigned int ec_budget;
+module_param(ec_budget, uint, 0644);
+MODULE_PARM_DESC(ec_budget,
+		 "EC transactions per second the driver may issue, 0 for no limit (default: 0)");
+
+static unsigned int ec_budget_burst = 32;
+module_param(ec_budget_burst, uint, 0644);
+MODULE_PARM_DESC(ec_budget_burst,
+		 "EC transactions the budget allows at once (default: 32)");
+
+/* Tokens are counted in nanoseconds' worth of budget, NSEC_PER_SEC each */
+static struct {
+	u64 tokens;
+	u64 last_ns;
+
+	/* Reported in debugfs */
+	u64 throttled; /* reads served from the last value */
+	u64 overdrawn; /* transactions let through without a token */
+} budget;
+static DEFINE_MUTEX(budget_lock);
+
+// Takes a token; without one, only a forced transaction goes through
+static bool msi_ec_budget_take(bool force)
+{
+	unsigned int rate = READ_ONCE(ec_budget);
+	u64 cap, now, elapsed;
+	bool allowed = TRUE;
+
+	if (!rate)
+		return TRUE;
+
+	mutex_lock(&budget_lock);
+	cap = (u64)max(READ_ONCE(ec_budget_burst), 1U) * NSEC_PER_SEC;
+	now = ktime_get_ns();
+	elapsed = min(now - budget.last_ns, div64_u64(cap, rate) + 1);
+	budget.tokens = min(budget.tokens + elapsed * rate, cap);
+	budget.last_ns = now;
+
+	if (budget.tokens >= NSEC_PER_SEC) {
+		budget.tokens -= NSEC_PER_SEC;
+	} else if (force) {
+		budget.overdrawn++;
+	} else {
+		budget.throttled++;
+		allowed = FALSE;
 	}
+	mutex_unlock(&budget_lock);
+
+	return allowed;
 }
 
-static ssize_t fn_key_store(struct device *dev, struct device_attribute *attr,
-			    const char *buf, size_t count)
+static int ec_budget_show(struct seq_file *m, void *v)
 {
-	int result = -EINVAL;
+	mutex_lock(&budget_lock);
+	seq_printf(m, "rate       %u\n", READ_ONCE(ec_budget));
+	seq_printf(m, "burst      %u\n", READ_ONCE(ec_budget_burst));
+	seq_printf(m, "tokens     %llu\n",
+		   (unsigned long long)div64_u64(budget.tokens, NSEC_PER_SEC));
+	seq_printf(m, "throttled  %llu\n", (unsigned long long)budget.throttled);
+	seq_printf(m, "overdrawn  %llu\n", (unsigned long long)budget.overdrawn);
+	mutex_unlock(&budget_lock);
 
-	if (streq(buf, "left"))
-		result = ec_write_bit(MSI_EC_FN_WIN_ADDRESS,
-				      MSI_EC_FN_WIN_BIT,
-				      MSI_EC_FN_KEY_LEFT);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ec_budget);
 
-	if (streq(buf, "right"))
-		result = ec_write_bit(MSI_EC_FN_WIN_ADDRESS,
-				      MSI_EC_FN_WIN_BIT,
-				      MSI_EC_FN_KEY_RIGHT);
+// ============================================================ //
+// Read coalescing
+// ============================================================ //
 
-	if (result < 0)
-		return result;
+/*
+ * Concurrent reads of one address share a single EC transaction: the first
+ * reader issues it, readers arriving while it is in flight wait for it and
+ * take its result. A write to the address stops later readers from joining
+ * a read that may have been issued before it.
+ *
+ * The last value read from or written to each address is kept for when
+ * the EC budget runs out or the circuit breaker is open; its age is
+ * reported in debugfs.
+ */
 
-	return count;
-}
+#define MSI_EC_ADDRESSES 256
+
+struct msi_ec_flight {
+	bool busy;
+	bool joinable;
+	u32 generation; /* completed reads */
+	int result;
+	u8 value;
+
+	bool cached;
+	u8 cached_value;
+	u64 cached_ns;
+
+	/* Reported in debugfs */
+	u64 reads;
+	u64 coalesced;
+	u64 throttled;
+	u64 stale;
+};
+
+static struct msi_ec_flight flights[MSI_EC_ADDRESSES];
+static DEFINE_MUTEX(flight_lock);
+static DECLARE_WAIT_QUEUE_HEAD(flight_wq);
 
-static ssize_t win_key_show(struct device *device,
-			    struct device_attribute *attr, char *buf)
+static int msi_ec_read(u8 addr, u8 *data)
 {
-	u8 rdata;
+	struct msi_ec_flight *f = &flights[addr];
+	u32 generation;
+	bool joined;
 	int result;
 
-	result = ec_read(MSI_EC_FN_WIN_ADDRESS, &rdata);
-	if (result < 0)
+	for (;;) {
+		mutex_lock(&flight_lock);
+		if (!f->busy)
+			break;
+
+		generation = f->generation;
+		joined = f->joinable;
+		if (joined)
+			f->coalesced++;
+		mutex_unlock(&flight_lock);
+
+		wait_event(flight_wq, READ_ONCE(f->generation) != generation);
+		if (!joined)
+			continue;
+
+		// A later read may have completed too, its value is as fresh
+		mutex_lock(&flight_lock);
+		result = f->result;
+		if (result == 0)
+			*data = f->value;
+		mutex_unlock(&flight_lock);
 		return result;
+	}
 
-	if(is_bit_set(MSI_EC_FN_WIN_BIT, rdata) == MSI_EC_WIN_KEY_LEFT) {
-		return sprintf(buf, "%s\n", "left");
+	if (f->cached && !msi_ec_budget_take(FALSE)) {
+		f->throttled++;
+		*data = f->cached_value;
+		mutex_unlock(&flight_lock);
+		return 0;
 	}
-	else {
-		return sprintf(buf, "%s\n", "right");
+
+	f->busy = TRUE;
+	f->joinable = TRUE;
+	f->reads++;
+	mutex_unlock(&flight_lock);
+
+	// A register that was never read is read regardless of the budget
+	if (!f->cached)
+		msi_ec_budget_take(TRUE);
+	result = msi_ec_submit_read(addr, data, MSI_EC_BACKGROUND);
+
+	mutex_lock(&flight_lock);
+	if (result == 0) {
+		// Unless a write went in meanwhile, which is the newer value
+		if (f->joinable) {
+			f->cached = TRUE;
+			f->cached_value = *data;
+			f->cached_ns = ktime_get_ns();
+		}
+	} else if (f->cached && msi_ec_breaker_serve_stale()) {
+		f->stale++;
+		*data = f->cached_value;
+		result = 0;
 	}
+	f->result = result;
+	if (result == 0)
+		f->value = *data;
+	f->busy = FALSE;
+	WRITE_ONCE(f->generation, f->generation + 1);
+	mutex_unlock(&flight_lock);
+	wake_up_all(&flight_wq);
+
+	return result;
 }
 
-static ssize_t win_key_store(struct device *dev, struct device_attribute *attr,
-			     const char *buf, size_t count)
+static int msi_ec_write(u8 addr, u8 data)
 {
-	int result = -EINVAL;
+	struct msi_ec_flight *f = &flights[addr];
+	int result;
 
-	if (streq(buf, "left"))
-		result = ec_write_bit(MSI_EC_FN_WIN_ADDRESS,
-				      MSI_EC_FN_WIN_BIT,
-				      MSI_EC_WIN_KEY_LEFT);
+	mutex_lock(&flight_lock);
+	f->joinable = FALSE;
+	mutex_unlock(&flight_lock);
 
-	if (streq(buf, "right"))
-		result = ec_write_bit(MSI_EC_FN_WIN_ADDRESS,
-				      MSI_EC_FN_WIN_BIT,
-				      MSI_EC_WIN_KEY_RIGHT);
+	msi_ec_budget_take(TRUE);
+	result = msi_ec_submit_write(addr, data);
 
-	if (result < 0)
-		return result;
+	mutex_lock(&flight_lock);
+	f->cached = result == 0;
+	f->cached_value = data;
+	f->cached_ns = ktime_get_ns();
+	mutex_unlock(&flight_lock);
 
-	return count;
+	return result;
 }
 
-static ssize_t battery_charge_mode_show(struct device *device,
-				 	struct device_attribute *attr, char *buf)
+/*
+ * Read for a read-modify-write: interactive, and neither joins nor starts a
+ * shared read, since the value is about to be written back.
+ */
+static int msi_ec_read_fresh(u8 addr, u8 *data)
 {
-	u8 rdata;
-	int result;
+	msi_ec_budget_take(TRUE);
+	return msi_ec_submit_read(addr, data, MSI_EC_INTERACTIVE);
+}
 
-	result = ec_read(MSI_EC_BATTERY_MODE_ADDRESS, &rdata);
-	if (result < 0)
-		return result;
+static int ec_reads_show(struct seq_file *m, void *v)
+{
+	const struct msi_ec_flight *f;
+	u64 now = ktime_get_ns();
+
+	seq_printf(m, "%-7s %12s %12s %12s %12s %12s\n", "address", "reads",
+		   "coalesced", "throttled", "stale", "age_ms");
+
+	mutex_lock(&flight_lock);
+	for (f = flights; f < flights + MSI_EC_ADDRESSES; f++) {
+		if (!f->reads && !f->coalesced && !f->cached)
+			continue;
+
+		seq_printf(m, "%#-7x %12llu %12llu %12llu %12llu ",
+			   (unsigned int)(f - flights),
+			   (unsigned long long)f->reads,
+			   (unsigned long long)f->coalesced,
+			   (unsigned long long)f->throttled,
+			   (unsigned long long)f->stale);
+		if (f->cached)
+			seq_printf(m, "%12llu\n", (unsigned long long)
+				   div64_u64(now - f->cached_ns, NSEC_PER_MSEC));
+		else
+			seq_printf(m, "%12s\n", "-");
+	}
+	mutex_unlock(&flight_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ec_reads);
 
-	switch (rdata) {
-	case MSI_EC_BATTERY_MODE_MAX_CHARGE:
-		return sprintf(buf, "%s\n", "max");
-	case MSI_EC_BATTERY_MODE_MEDIUM_CHARGE:
-		return sprintf(buf, "%s\n", "medium");
-	case MSI_EC_BATTERY_MODE_MIN_CHARGE:
-		return sprintf(buf, "%s\n", "min");
-	default:
-		return sprintf(buf, "%s (%i)\n", "unknown", rdata);
+static int ec_read_seq(u8 addr, u8 *buf, u8 len)
+{
+	int result;
+	u8 i;
+	for (i = 0; i < len; i++) {
+		result = msi_ec_read(addr + i, buf + i);
+		if (result < 0)
+			return result;
 	}
+	return 0;
 }
 
-static ssize_t battery_charge_mode_store(struct device *dev,
-				  	 struct device_attribute *attr,
-				  	 const char *buf, size_t count)
+/*
+ * Several controls share a register (fan_mode and the preset's fan mode
+ * cleanup, fn_key and win_key), so read-modify-writes of a register are
+ * serialised, or one of them could write back a stale copy of the bits
+ * another one just changed.
+ */
+static DEFINE_MUTEX(ec_update_lock);
+
+static int ec_update_bits(u8 addr, u8 mask, u8 bits)
 {
-	int result = -EINVAL;
+	u8 data;
+	int result;
 
-	if (streq(buf, "max"))
-		result = ec_write(MSI_EC_BATTERY_MODE_ADDRESS,
-				  MSI_EC_BATTERY_MODE_MAX_CHARGE);
+	mutex_lock(&ec_update_lock);
+	result = msi_ec_read_fresh(addr, &data);
+	if (result == 0)
+		result = msi_ec_write(addr, (data & ~mask) | (bits & mask));
+	mutex_unlock(&ec_update_lock);
 
-	if (streq(buf, "medium"))
-		result = ec_write(MSI_EC_BATTERY_MODE_ADDRESS,
-				  MSI_EC_BATTERY_MODE_MEDIUM_CHARGE);
+	return result;
+}
 
-	if (streq(buf, "min"))
-		result = ec_write(MSI_EC_BATTERY_MODE_ADDRESS,
-				  MSI_EC_BATTERY_MODE_MIN_CHARGE);
+static int ec_write_bit(u8 addr, u8 index, bool set)
+{
+	return ec_update_bits(addr, BIT(index), set ? BIT(index) : 0);
+}
 
-	if (result < 0)
-		return result;
+static bool is_bit_set(u8 index, u8 byte)
+{
+	return (byte >> index) & 1UL;
+}
 
-	return count;
+// ============================================================ //
+// Firmware identity
+// ============================================================ //
+
+/*
+ * The firmware version and build date and time cannot change while the
+ * driver is bound, so they are read once at probe and served from memory.
+ * The build time is the EC's local time, the epoch treats it as UTC.
+ */
+
+struct msi_ec_fw_identity {
+	char version[MSI_EC_FW_VERSION_LENGTH + 1];
+	bool dated; /* the build date and time were read and parsed */
+	u16 year;
+	u8 month;
+	u8 day;
+	u8 hour;
+	u8 minute;
+	u8 second;
+	time64_t epoch;
+};
+
+static struct msi_ec_fw_identity fw;
+
+// The date is stored as MMDDYYYY, the time as HH:MM:SS
+static bool fw_parse_build(struct msi_ec_fw_identity *id, const char *rdate,
+			   const char *rtime)
+{
+	unsigned int year, month, day, hour, minute, second;
+
+	if (sscanf(rdate, "%02u%02u%04u", &month, &day, &year) != 3 ||
+	    sscanf(rtime, "%02u:%02u:%02u", &hour, &minute, &second) != 3)
+		return FALSE;
+	if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 ||
+	    minute > 59 || second > 59)
+		return FALSE;
+
+	id->year = year;
+	id->month = month;
+	id->day = day;
+	id->hour = hour;
+	id->minute = minute;
+	id->second = second;
+	id->epoch = mktime64(year, month, day, hour, minute, second);
+	return TRUE;
 }
 
-static ssize_t cooler_boost_show(struct device *device,
-				 struct device_attribute *attr, char *buf)
+static int msi_ec_fw_identity_read(struct msi_ec_fw_identity *id)
 {
-	u8 rdata;
+	char rdate[MSI_EC_FW_DATE_LENGTH + 1];
+	char rtime[MSI_EC_FW_TIME_LENGTH + 1];
 	int result;
 
-	result = ec_read(MSI_EC_COOLER_BOOST_ADDRESS, &rdata);
+	memset(id, 0, sizeof(*id));
+	result = ec_read_seq(MSI_EC_FW_VERSION_ADDRESS, (u8 *)id->version,
+			     MSI_EC_FW_VERSION_LENGTH);
 	if (result < 0)
 		return result;
 
-	if(is_bit_set(MSI_EC_COOLER_BOOST_BIT, rdata))
-		return sprintf(buf, "%s\n", "on");
-	else
-		return sprintf(buf, "%s\n", "off");
+	// Only the version is needed to bind, the build date is left out
+	memset(rdate, 0, sizeof(rdate));
+	memset(rtime, 0, sizeof(rtime));
+	if (ec_read_seq(MSI_EC_FW_DATE_ADDRESS, (u8 *)rdate,
+			MSI_EC_FW_DATE_LENGTH) == 0 &&
+	    ec_read_seq(MSI_EC_FW_TIME_ADDRESS, (u8 *)rtime,
+			MSI_EC_FW_TIME_LENGTH) == 0)
+		id->dated = fw_parse_build(id, rdate, rtime);
+	if (!id->dated)
+		pr_warn("msi-ec: cannot read the firmware build date\n");
+
+	return 0;
 }
 
-static ssize_t cooler_boost_store(struct device *dev,
-				  struct device_attribute *attr,
-				  const char *buf, size_t count)
-{
-	int result = -EINVAL;
+// ============================================================ //
+// Model configuration
+// ============================================================ //
 
-	if (streq(buf, "on"))
-		result = ec_write_bit(MSI_EC_COOLER_BOOST_ADDRESS,
-				      MSI_EC_COOLER_BOOST_BIT,
-				      TRUE);
+/* Copy of the matching CONFIGS entry, filled in once at probe */
+static struct msi_ec_conf conf __read_mostly;
 
-	if (streq(buf, "off"))
-		result = ec_write_bit(MSI_EC_COOLER_BOOST_ADDRESS,
-				      MSI_EC_COOLER_BOOST_BIT,
-				      FALSE);
+static bool fw_is_allowed(const struct msi_ec_conf *cfg, const char *fw_version)
+{
+	const char *const *fw;
 
-	if (result < 0)
-		return result;
+	for (fw = cfg->allowed_fw; *fw; fw++)
+		if (strcmp(*fw, fw_version) == 0)
+			return TRUE;
 
-	return count;
+	return FALSE;
 }
 
-static ssize_t shift_mode_show(struct device *device,
-			       struct device_attribute *attr, char *buf)
+// ============================================================ //
+// Loadable register map
+// ============================================================ //
+
+static bool load_regmap = TRUE;
+module_param(load_regmap, bool, 0444);
+MODULE_PARM_DESC(load_regmap,
+		 "Apply msi-ec/<fw_version>.bin register map overrides if present (default: true)");
+
+enum msi_ec_regmap_kind {
+	RM_ADDR,  /* EC address or MSI_EC_ADDR_UNSUPP */
+	RM_BIT,   /* bit index or MSI_EC_BIT_UNSUPP */
+	RM_VALUE, /* raw register value */
+};
+
+struct msi_ec_regmap_field_desc {
+	u16 offset;
+	u8 count; /* ints covered by the field, 0 for unused ids */
+	u8 kind;
+};
+
+#define RM_FIELD(id, member, field_kind)					\
+	[id] = {								\
+		.offset = offsetof(struct msi_ec_conf, member),			\
+		.count = sizeof_field(struct msi_ec_conf, member) / sizeof(int),	\
+		.kind = field_kind,						\
+	}
+
+static const struct msi_ec_regmap_field_desc regmap_fields[MSI_EC_RM_FIELD_MAX] = {
+	RM_FIELD(MSI_EC_RM_WEBCAM_ADDRESS, webcam.address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_WEBCAM_BIT, webcam.bit, RM_BIT),
+	RM_FIELD(MSI_EC_RM_WEBCAM_HARD_ADDRESS, webcam.hard_address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_WEBCAM_HARD_BIT, webcam.hard_bit, RM_BIT),
+
+	RM_FIELD(MSI_EC_RM_FN_WIN_ADDRESS, fn_win.address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_FN_WIN_BIT, fn_win.bit, RM_BIT),
+	RM_FIELD(MSI_EC_RM_FN_WIN_FN_LEFT, fn_win.fn_left, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_FN_WIN_WIN_LEFT, fn_win.win_left, RM_VALUE),
+
+	RM_FIELD(MSI_EC_RM_CHARGE_CONTROL_ADDRESS, charge_control.address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_CHARGE_CONTROL_MAX, charge_control.max, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_CHARGE_CONTROL_MEDIUM, charge_control.medium, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_CHARGE_CONTROL_MIN, charge_control.min, RM_VALUE),
+
+	RM_FIELD(MSI_EC_RM_COOLER_BOOST_ADDRESS, cooler_boost.address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_COOLER_BOOST_BIT, cooler_boost.bit, RM_BIT),
+
+	RM_FIELD(MSI_EC_RM_SHIFT_MODE_ADDRESS, shift_mode.address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_SHIFT_MODE_OVERCLOCK, shift_mode.overclock, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_SHIFT_MODE_BALANCED, shift_mode.balanced, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_SHIFT_MODE_ECO, shift_mode.eco, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_SHIFT_MODE_OFF, shift_mode.off, RM_VALUE),
+
+	RM_FIELD(MSI_EC_RM_FAN_MODE_ADDRESS, fan_mode.address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_FAN_MODE_SILENT_BIT, fan_mode.silent_bit, RM_BIT),
+	RM_FIELD(MSI_EC_RM_FAN_MODE_BASIC_BIT, fan_mode.basic_bit, RM_BIT),
+	RM_FIELD(MSI_EC_RM_FAN_MODE_ADVANCED_BIT, fan_mode.advanced_bit, RM_BIT),
+
+	RM_FIELD(MSI_EC_RM_CPU_RT_TEMP_ADDRESS, cpu.rt_temp_address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_CPU_RT_FAN_SPEED_ADDRESS, cpu.rt_fan_speed_address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_CPU_RT_FAN_SPEED_BASE_MIN, cpu.rt_fan_speed_base_min, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_CPU_RT_FAN_SPEED_BASE_MAX, cpu.rt_fan_speed_base_max, RM_VALUE),
+
+	RM_FIELD(MSI_EC_RM_GPU_RT_TEMP_ADDRESS, gpu.rt_temp_address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_GPU_RT_FAN_SPEED_ADDRESS, gpu.rt_fan_speed_address, RM_ADDR),
+
+	RM_FIELD(MSI_EC_RM_POWER_ADDRESS, power.address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_POWER_LID_OPEN_BIT, power.lid_open_bit, RM_BIT),
+	RM_FIELD(MSI_EC_RM_POWER_AC_CONNECTED_BIT, power.ac_connected_bit, RM_BIT),
+
+	RM_FIELD(MSI_EC_RM_LEDS_MICMUTE_ADDRESS, leds.micmute_address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_LEDS_MICMUTE_ON, leds.micmute_on, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_LEDS_MICMUTE_OFF, leds.micmute_off, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_LEDS_MUTE_ADDRESS, leds.mute_address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_LEDS_MUTE_ON, leds.mute_on, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_LEDS_MUTE_OFF, leds.mute_off, RM_VALUE),
+
+	RM_FIELD(MSI_EC_RM_KBD_BL_ADDRESS, kbd_bl.address, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_KBD_BL_STATE_MASK, kbd_bl.state_mask, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_KBD_BL_STATES, kbd_bl.states, RM_VALUE),
+
+	RM_FIELD(MSI_EC_RM_PRESET_ADDRESSES, preset.addresses, RM_ADDR),
+	RM_FIELD(MSI_EC_RM_PRESET_VALUES, preset.values, RM_VALUE),
+	RM_FIELD(MSI_EC_RM_PRESET_SILENT_FLAG_BIT, preset.silent_flag_bit, RM_BIT),
+};
+
+static int *regmap_field_ptr(struct msi_ec_conf *cfg,
+			     const struct msi_ec_regmap_field_desc *desc,
+			     int index)
 {
-	u8 rdata;
-	int result;
+	return (int *)((u8 *)cfg + desc->offset) + index;
+}
 
-	result = ec_read(MSI_EC_SHIFT_MODE_ADDRESS, &rdata);
-	if (result < 0)
-		return result;
+// Starting point for a register map on a model without compiled-in support
+static void regmap_init_unsupported(struct msi_ec_conf *cfg)
+{
+	const struct msi_ec_regmap_field_desc *desc;
+	int i, p;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->name = "firmware register map";
+
+	// Written as they are, so the map has to give every one of them
+	for (p = 0; p < MSI_EC_PRESET_COUNT; p++)
+		for (i = 0; i < MSI_EC_PRESET_COLUMNS; i++)
+			cfg->preset.values[p][i] = MSI_EC_VALUE_UNSUPP;
+
+	for (desc = regmap_fields; desc < regmap_fields + MSI_EC_RM_FIELD_MAX; desc++) {
+		for (i = 0; i < desc->count; i++) {
+			if (desc->kind == RM_ADDR)
+				*regmap_field_ptr(cfg, desc, i) = MSI_EC_ADDR_UNSUPP;
+			else if (desc->kind == RM_BIT)
+				*regmap_field_ptr(cfg, desc, i) = MSI_EC_BIT_UNSUPP;
+		}
+	}
+}
 
-	switch (rdata) {
-	case MSI_EC_SHIFT_MODE_OVERCLOCK:
-		return sprintf(buf, "%s\n", "overclock");
-	case MSI_EC_SHIFT_MODE_BALANCED:
-		return sprintf(buf, "%s\n", "balanced");
-	case MSI_EC_SHIFT_MODE_ECO:
-		return sprintf(buf, "%s\n", "eco");
-	case MSI_EC_SHIFT_MODE_OFF:
-		return sprintf(buf, "%s\n", "off");
-	default:
-		return sprintf(buf, "%s (%i)\n", "unknown", rdata);
+static int regmap_decode_value(const struct msi_ec_regmap_field_desc *desc,
+			       u16 raw, int *value)
+{
+	switch (desc->kind) {
+	case RM_ADDR:
+		if (raw == MSI_EC_REGMAP_ADDR_UNSUPP) {
+			*value = MSI_EC_ADDR_UNSUPP;
+			return 0;
+		}
+		break;
+	case RM_BIT:
+		if (raw == MSI_EC_REGMAP_BIT_UNSUPP) {
+			*value = MSI_EC_BIT_UNSUPP;
+			return 0;
+		}
+		if (raw > 7)
+			return -EINVAL;
+		break;
 	}
+
+	if (raw > 0xff)
+		return -EINVAL;
+
+	*value = raw;
+	return 0;
 }
 
-static ssize_t shift_mode_store(struct device *dev,
-				struct device_attribute *attr, const char *buf,
-				size_t count)
+static int regmap_parse(const struct firmware *fw, struct msi_ec_conf *cfg)
 {
-	int result = -EINVAL;
+	const struct msi_ec_regmap_header *header;
+	const struct msi_ec_regmap_entry *entries;
+	const struct msi_ec_regmap_field_desc *desc;
+	u16 count;
+	u32 crc;
+	int value;
+	int result;
+	int i;
 
-	if (streq(buf, "overclock"))
-		result = ec_write(MSI_EC_SHIFT_MODE_ADDRESS,
-				  MSI_EC_SHIFT_MODE_OVERCLOCK);
+	if (fw->size < sizeof(*header))
+		return -EINVAL;
 
-	if (streq(buf, "balanced"))
-		result = ec_write(MSI_EC_SHIFT_MODE_ADDRESS,
-				  MSI_EC_SHIFT_MODE_BALANCED);
+	header = (const struct msi_ec_regmap_header *)fw->data;
+	if (memcmp(header->magic, MSI_EC_REGMAP_MAGIC, sizeof(header->magic)) != 0)
+		return -EINVAL;
+	if (header->version != MSI_EC_REGMAP_VERSION)
+		return -EPROTONOSUPPORT;
 
-	if (streq(buf, "eco"))
-		result = ec_write(MSI_EC_SHIFT_MODE_ADDRESS,
-				  MSI_EC_SHIFT_MODE_ECO);
+	count = le16_to_cpu(header->count);
+	if (count > MSI_EC_REGMAP_MAX_ENTRIES ||
+	    fw->size != sizeof(*header) + count * sizeof(*entries))
+		return -EINVAL;
 
-	if (streq(buf, "off"))
-		result = ec_write(MSI_EC_SHIFT_MODE_ADDRESS,
-				  MSI_EC_SHIFT_MODE_OFF);
+	entries = (const struct msi_ec_regmap_entry *)(header + 1);
+	crc = crc32_le(~0, (const u8 *)entries, count * sizeof(*entries)) ^ ~0;
+	if (crc != le32_to_cpu(header->crc32))
+		return -EBADMSG;
 
-	if (result < 0)
-		return result;
+	for (i = 0; i < count; i++) {
+		if (entries[i].field >= MSI_EC_RM_FIELD_MAX)
+			return -EINVAL;
+
+		desc = &regmap_fields[entries[i].field];
+		if (entries[i].index >= desc->count)
+			return -EINVAL;
+
+		result = regmap_decode_value(desc, le16_to_cpu(entries[i].value),
+					     &value);
+		if (result < 0)
+			return result;
+
+		*regmap_field_ptr(cfg, desc, entries[i].index) = value;
+	}
 
 	return count;
 }
 
-static ssize_t fan_mode_show(struct device *device,
-			     struct device_attribute *attr, char *buf)
+// Overlays msi-ec/<fw_version>.bin onto conf, leaving it untouched on failure
+static int load_regmap_file(struct device *dev, const char *fw_version)
 {
-	u8 rdata;
+	const struct firmware *fw;
+	struct msi_ec_conf map;
+	char name[32];
+	const char *c;
 	int result;
 
-	result = ec_read(MSI_EC_FAN_MODE_ADDRESS, &rdata);
+	// The version string comes from the EC; keep it from escaping the directory
+	for (c = fw_version; *c; c++)
+		if (!isalnum(*c) && *c != '.')
+			return -EINVAL;
+
+	snprintf(name, sizeof(name), "msi-ec/%s.bin", fw_version);
+	result = request_firmware_direct(&fw, name, dev);
 	if (result < 0)
 		return result;
 
-	if (is_bit_set(MSI_EC_FAN_MODE_SILENT_BIT, rdata))  {
-		return sprintf(buf, "%s\n", "silent");
-	}
-	else if (is_bit_set(MSI_EC_FAN_MODE_ADVANCED_BIT, rdata))  {
-		return sprintf(buf, "%s\n", "advanced");
-	}
-	else if (is_bit_set(MSI_EC_FAN_MODE_BASIC_BIT, rdata)) {
-		return sprintf(buf, "%s\n", "basic");
-	}
-	else {
-		return sprintf(buf, "%s\n", "auto");
+	memcpy(&map, &conf, sizeof(map));
+	result = regmap_parse(fw, &map);
+	release_firmware(fw);
+
+	if (result < 0) {
+		dev_err(dev, "ignoring invalid register map %s (error code %i)\n",
+			name, result);
+		return result;
 	}
+
+	memcpy(&conf, &map, sizeof(conf));
+	dev_info(dev, "applied %i register overrides from %s\n", result, name);
+	return 0;
 }
 
-static ssize_t fan_mode_store(struct device *dev, struct device_attribute *attr,
-			      const char *buf, size_t count)
+static const struct msi_ec_conf *match_configuration(const char *fw_version)
 {
-	int result = -EINVAL;
-	bool is_auto = streq(buf, "auto");
-	bool is_silent = streq(buf, "silent");
-	bool is_basic = streq(buf, "basic");
-	bool is_adv = streq(buf, "advanced");
-
-	if (!is_auto && !is_basic && !is_adv && !is_silent)
-		return result;
+	const struct msi_ec_conf *const *cfg;
+
+	// An exact firmware match is authoritative
+	for (cfg = CONFIGS; *cfg; cfg++) {
+		if (fw_is_allowed(*cfg, fw_version)) {
+			pr_info("msi-ec: using %s configuration (firmware %s)\n",
+				(*cfg)->name, fw_version);
+			return *cfg;
+		}
+	}
 
-	result = ec_write_bit(MSI_EC_FAN_MODE_ADDRESS,
-			      MSI_EC_FAN_MODE_BASIC_BIT,
-			      is_basic);
+	// Otherwise fall back to the model the DMI data says we are running on
+	for (cfg = CONFIGS; *cfg; cfg++) {
+		if (dmi_check_system((*cfg)->dmi_table)) {
+			pr_warn("msi-ec: firmware %s is untested, using %s configuration based on DMI data\n",
+				fw_version, (*cfg)->name);
+			return *cfg;
+		}
+	}
 
-	if (result < 0)
-		return result;
+	return NULL;
+}
 
-	result = ec_write_bit(MSI_EC_FAN_MODE_ADDRESS,
-			      MSI_EC_FAN_MODE_ADVANCED_BIT,
-			      is_adv);
+static int load_configuration(struct device *dev)
+{
+	const struct msi_ec_conf *cfg;
+	int result;
 
+	result = msi_ec_fw_identity_read(&fw);
 	if (result < 0)
 		return result;
 
-	result = ec_write_bit(MSI_EC_FAN_MODE_ADDRESS,
-			      MSI_EC_FAN_MODE_SILENT_BIT,
-			      is_silent);
+	cfg = match_configuration(fw.version);
+	if (cfg)
+		memcpy(&conf, cfg, sizeof(conf));
+	else
+		regmap_init_unsupported(&conf);
 
-	if (result < 0)
-		return result;
+	// A register map file fixes up the compiled-in tables or stands in for them
+	if (load_regmap && load_regmap_file(dev, fw.version) == 0)
+		return 0;
 
-	return count;
+	if (!cfg) {
+		pr_err("msi-ec: firmware %s is not supported\n", fw.version);
+		return -EOPNOTSUPP;
+	}
+
+	return 0;
+}
+
+// ============================================================ //
+// Sysfs platform device attributes (multiple choice)
+// ============================================================ //
+
+/*
+ * Controls that pick one of a few named values stored in a single register
+ * are described by a row in msi_ec_enum_attrs and share one show/store pair.
+ * Each value refers to a field of conf, resolved by msi_ec_enum_bind() once
+ * the model configuration is known:
+ *
+ * - MSI_EC_ENUM_BYTE: the field is the whole register value.
+ * - MSI_EC_ENUM_FLAGS: the field is the index of the bit to set, NULL for
+ *   none. The register is updated with a read-modify-write that only
+ *   touches the bits of the control. If polarity points to 0, the meaning
+ *   of set and clear is swapped (fn_key/win_key). If the firmware sets the
+ *   bits of several values at once, show reports the one with the highest
+ *   priority (fan_mode: silent, then advanced, then basic).
+ *
+ * Besides the names, store accepts the index of a value in the row.
+ */
+
+#define MSI_EC_ENUM_MAX_VALUES 4
+
+enum msi_ec_enum_kind {
+	MSI_EC_ENUM_BYTE,
+	MSI_EC_ENUM_FLAGS,
+};
+
+struct msi_ec_enum_value {
+	const char *name;
+	const int *source;
+	int priority; /* MSI_EC_ENUM_FLAGS only */
+};
+
+struct msi_ec_enum_attr {
+	struct device_attribute dev_attr;
+	enum msi_ec_enum_kind kind;
+	const int *address;
+	const int *polarity;
+	const struct msi_ec_enum_value *values;
+	int count;
+
+	/* Filled in by msi_ec_enum_bind() */
+	const char *names[MSI_EC_ENUM_MAX_VALUES];
+	u8 patterns[MSI_EC_ENUM_MAX_VALUES];
+	bool supported[MSI_EC_ENUM_MAX_VALUES];
+	u8 mask;
+};
+
+static ssize_t msi_ec_enum_show(struct device *device,
+				struct device_attribute *attr, char *buf);
+static void msi_ec_notify(const char *attr);
+static ssize_t msi_ec_enum_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count);
+
+#define MSI_EC_ENUM(_id, _name, _kind, _address, _polarity, ...)		\
+	[MSI_EC_ENUM_ATTR_##_id] = {						\
+		.dev_attr = __ATTR(_name, 0644, msi_ec_enum_show,		\
+				   msi_ec_enum_store),				\
+		.kind = MSI_EC_ENUM_##_kind,					\
+		.address = _address,						\
+		.polarity = _polarity,						\
+		.values = (const struct msi_ec_enum_value[]){ __VA_ARGS__ },	\
+		.count = ARRAY_SIZE(((const struct msi_ec_enum_value[]){	\
+			__VA_ARGS__ })),					\
+	}
+
+enum msi_ec_enum_attr_id {
+	MSI_EC_ENUM_ATTR_WEBCAM,
+	MSI_EC_ENUM_ATTR_FN_KEY,
+	MSI_EC_ENUM_ATTR_WIN_KEY,
+	MSI_EC_ENUM_ATTR_BATTERY_CHARGE_MODE,
+	MSI_EC_ENUM_ATTR_COOLER_BOOST,
+	MSI_EC_ENUM_ATTR_SHIFT_MODE,
+	MSI_EC_ENUM_ATTR_FAN_MODE,
+	MSI_EC_ENUM_ATTR_COUNT
+};
+
+static struct msi_ec_enum_attr msi_ec_enum_attrs[MSI_EC_ENUM_ATTR_COUNT] = {
+	MSI_EC_ENUM(WEBCAM, webcam, FLAGS, &conf.webcam.address, NULL,
+		    { "off", NULL },
+		    { "on", &conf.webcam.bit }),
+	MSI_EC_ENUM(FN_KEY, fn_key, FLAGS, &conf.fn_win.address,
+		    &conf.fn_win.fn_left,
+		    { "right", NULL },
+		    { "left", &conf.fn_win.bit }),
+	MSI_EC_ENUM(WIN_KEY, win_key, FLAGS, &conf.fn_win.address,
+		    &conf.fn_win.win_left,
+		    { "right", NULL },
+		    { "left", &conf.fn_win.bit }),
+	MSI_EC_ENUM(BATTERY_CHARGE_MODE, battery_charge_mode, BYTE,
+		    &conf.charge_control.address, NULL,
+		    { "max", &conf.charge_control.max },
+		    { "medium", &conf.charge_control.medium },
+		    { "min", &conf.charge_control.min }),
+	MSI_EC_ENUM(COOLER_BOOST, cooler_boost, FLAGS,
+		    &conf.cooler_boost.address, NULL,
+		    { "off", NULL },
+		    { "on", &conf.cooler_boost.bit }),
+	MSI_EC_ENUM(SHIFT_MODE, shift_mode, BYTE, &conf.shift_mode.address, NULL,
+		    { "overclock", &conf.shift_mode.overclock },
+		    { "balanced", &conf.shift_mode.balanced },
+		    { "eco", &conf.shift_mode.eco },
+		    { "off", &conf.shift_mode.off }),
+	MSI_EC_ENUM(FAN_MODE, fan_mode, FLAGS, &conf.fan_mode.address, NULL,
+		    { "auto", NULL },
+		    { "silent", &conf.fan_mode.silent_bit, 3 },
+		    { "basic", &conf.fan_mode.basic_bit, 1 },
+		    { "advanced", &conf.fan_mode.advanced_bit, 2 }),
+};
+
+static struct attribute *msi_enum_attrs[MSI_EC_ENUM_ATTR_COUNT + 1];
+
+// Resolve the register values of every row against conf
+static void msi_ec_enum_bind(void)
+{
+	struct msi_ec_enum_attr *ea;
+	int source;
+	int i;
+
+	for (ea = msi_ec_enum_attrs;
+	     ea < msi_ec_enum_attrs + MSI_EC_ENUM_ATTR_COUNT; ea++) {
+		ea->mask = ea->kind == MSI_EC_ENUM_BYTE ? 0xff : 0;
+
+		for (i = 0; i < ea->count; i++) {
+			source = ea->values[i].source ? *ea->values[i].source : 0;
+
+			ea->names[i] = ea->values[i].name;
+			if (ea->kind == MSI_EC_ENUM_BYTE) {
+				ea->supported[i] = source >= 0 && source <= 0xff;
+				ea->patterns[i] = source;
+			} else {
+				ea->supported[i] = source >= 0 && source < 8;
+				ea->patterns[i] = ea->values[i].source &&
+						  ea->supported[i] ? BIT(source) : 0;
+				ea->mask |= ea->patterns[i];
+			}
+		}
+
+		if (ea->polarity && !*ea->polarity) {
+			for (i = 0; i < ea->count; i++)
+				ea->patterns[i] ^= ea->mask;
+		}
+
+		msi_enum_attrs[ea - msi_ec_enum_attrs] = &ea->dev_attr.attr;
+	}
+}
+
+static ssize_t msi_ec_enum_show(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct msi_ec_enum_attr *ea =
+		container_of(attr, struct msi_ec_enum_attr, dev_attr);
+	int best = -1;
+	u8 rdata;
+	int result;
+	int i;
+
+	result = msi_ec_read(*ea->address, &rdata);
+	if (result < 0)
+		return result;
+
+	for (i = 0; i < ea->count; i++) {
+		if (ea->supported[i] && (rdata & ea->mask) == ea->patterns[i])
+			return sprintf(buf, "%s\n", ea->names[i]);
+	}
+
+	// Several flags set at once
+	for (i = 0; ea->kind == MSI_EC_ENUM_FLAGS && i < ea->count; i++) {
+		if (!ea->supported[i] || !ea->patterns[i] ||
+		    (rdata & ea->patterns[i]) != ea->patterns[i])
+			continue;
+		if (best < 0 || ea->values[i].priority > ea->values[best].priority)
+			best = i;
+	}
+	if (best >= 0)
+		return sprintf(buf, "%s\n", ea->names[best]);
+
+	return sprintf(buf, "%s (%i)\n", "unknown", rdata);
+}
+
+static ssize_t msi_ec_enum_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct msi_ec_enum_attr *ea =
+		container_of(attr, struct msi_ec_enum_attr, dev_attr);
+	unsigned int index;
+	int result;
+
+	result = __sysfs_match_string(ea->names, ea->count, buf);
+	if (result >= 0)
+		index = result;
+	else if (kstrtouint(buf, 0, &index) < 0)
+		return -EINVAL;
+
+	if (index >= ea->count || !ea->supported[index])
+		return -EINVAL;
+
+	if (ea->mask == 0xff)
+		result = msi_ec_write(*ea->address, ea->patterns[index]);
+	else
+		result = ec_update_bits(*ea->address, ea->mask,
+					ea->patterns[index]);
+
+	if (result < 0)
+		return result;
+
+	// Pollers of an attribute EC events report expect other writers too
+	if (ea == &msi_ec_enum_attrs[MSI_EC_ENUM_ATTR_WEBCAM])
+		msi_ec_notify(ea->dev_attr.attr.name);
+
+	return count;
+}
+
+static umode_t msi_enum_is_visible(struct kobject *kobj,
+				   struct attribute *attr, int idx)
+{
+	struct msi_ec_enum_attr *ea =
+		container_of(attr, struct msi_ec_enum_attr, dev_attr.attr);
+
+	if (*ea->address == MSI_EC_ADDR_UNSUPP)
+		return 0;
+
+	return attr->mode;
+}
+
+static const struct attribute_group msi_enum_group = {
+	.is_visible = msi_enum_is_visible,
+	.attrs = msi_enum_attrs,
+};
+
+// ============================================================ //
+// Sysfs platform device attributes (root)
+// ============================================================ //
+
+static bool preset_column_supported(int c)
+{
+	int p;
+
+	if (conf.preset.addresses[c] == MSI_EC_ADDR_UNSUPP)
+		return FALSE;
+	if (c == MSI_EC_PRESET_COLUMN_SILENT_FLAG &&
+	    conf.preset.silent_flag_bit == MSI_EC_BIT_UNSUPP)
+		return FALSE;
+	for (p = 0; p < MSI_EC_PRESET_COUNT; p++)
+		if (conf.preset.values[p][c] == MSI_EC_VALUE_UNSUPP)
+			return FALSE;
+	return TRUE;
+}
+
+// A partial register map cannot switch presets: hidden, and refused
+static bool preset_supported(void)
+{
+	int c;
+
+	for (c = 0; c < MSI_EC_PRESET_COLUMNS; c++)
+		if (!preset_column_supported(c))
+			return FALSE;
+	return TRUE;
 }
 
 static ssize_t preset_show(struct device *device,
@@ -396,13 +1332,16 @@ static ssize_t preset_show(struct device *device,
 	u8 rdata;
 	bool match;
 
-	for (v = 0; v < ARRAY_SIZE(MSI_EC_PRESET_VALUE_TABLE); v++) {
+	if (!preset_supported())
+		return -EOPNOTSUPP;
+
+	for (v = 0; v < MSI_EC_PRESET_COUNT; v++) {
 		match = TRUE;
-		for (c = 0; c < ARRAY_SIZE(MSI_EC_PRESET_MEMORY_TABLE); c++) {
-			u8 addr = MSI_EC_PRESET_MEMORY_TABLE[c];
-			u8 value = MSI_EC_PRESET_VALUE_TABLE[v][c];
+		for (c = 0; c < MSI_EC_PRESET_COLUMNS; c++) {
+			u8 addr = conf.preset.addresses[c];
+			u8 value = conf.preset.values[v][c];
 
-			result = ec_read(addr, &rdata);
+			result = msi_ec_read(addr, &rdata);
 
 			if (result < 0) {
 				pr_err("msi-ec: preset_store: failed to read from address %#02x "
@@ -416,7 +1355,7 @@ static ssize_t preset_show(struct device *device,
 			if (c == MSI_EC_PRESET_COLUMN_KBD_BL)
 				continue;
 			else if (c == MSI_EC_PRESET_COLUMN_SILENT_FLAG) {
-				if(value == is_bit_set(MSI_EC_FAN_MODE_SILENT_BIT, rdata))
+				if(value == is_bit_set(conf.preset.silent_flag_bit, rdata))
 					continue;
 
 				match = FALSE;
@@ -463,17 +1402,20 @@ static ssize_t preset_store(struct device *dev, struct device_attribute *attr,
 	else
 		return result;
 
-	for (c = 0; c < ARRAY_SIZE(MSI_EC_PRESET_MEMORY_TABLE); c++) {
-		u8 addr = MSI_EC_PRESET_MEMORY_TABLE[c];
-		u8 value = MSI_EC_PRESET_VALUE_TABLE[index][c];
+	if (!preset_supported())
+		return -EOPNOTSUPP;
+
+	for (c = 0; c < MSI_EC_PRESET_COLUMNS; c++) {
+		u8 addr = conf.preset.addresses[c];
+		u8 value = conf.preset.values[index][c];
 
 		if(c == MSI_EC_PRESET_COLUMN_SILENT_FLAG) {
 			result = ec_write_bit(addr,
-					      MSI_EC_FAN_MODE_SILENT_BIT,
+					      conf.preset.silent_flag_bit,
 					      value);
 		}
 		else {
-			result = ec_write(addr, value);
+			result = msi_ec_write(addr, value);
 		}
 
 		if(result < 0)
@@ -483,15 +1425,18 @@ static ssize_t preset_store(struct device *dev, struct device_attribute *attr,
 	}
 
 	/* ---- Validate fan modes ---- */
-	if(index != MSI_EC_PRESET_HIGH_PERFORMANCE) {
+	if(index != MSI_EC_PRESET_HIGH_PERFORMANCE &&
+	   conf.fan_mode.address != MSI_EC_ADDR_UNSUPP) {
 		// Disable basic/adv fan mode flags when not using high performance preset
-		 ec_write_bit(MSI_EC_FAN_MODE_ADDRESS,
-			      MSI_EC_FAN_MODE_ADVANCED_BIT,
-			      FALSE);
-
-		 ec_write_bit(MSI_EC_FAN_MODE_ADDRESS,
-			      MSI_EC_FAN_MODE_BASIC_BIT,
-			      FALSE);
+		if (conf.fan_mode.advanced_bit != MSI_EC_BIT_UNSUPP)
+			ec_write_bit(conf.fan_mode.address,
+				     conf.fan_mode.advanced_bit,
+				     FALSE);
+
+		if (conf.fan_mode.basic_bit != MSI_EC_BIT_UNSUPP)
+			ec_write_bit(conf.fan_mode.address,
+				     conf.fan_mode.basic_bit,
+				     FALSE);
 	}
 
 	return count;
@@ -500,330 +1445,975 @@ static ssize_t preset_store(struct device *dev, struct device_attribute *attr,
 static ssize_t fw_version_show(struct device *device,
 			       struct device_attribute *attr, char *buf)
 {
-	u8 rdata[MSI_EC_FW_VERSION_LENGTH + 1];
+	return sprintf(buf, "%s\n", fw.version);
+}
+
+static ssize_t fw_release_date_show(struct device *device,
+				    struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%04u/%02u/%02u %02u:%02u:%02u\n", fw.year,
+		       fw.month, fw.day, fw.hour, fw.minute, fw.second);
+}
+
+static ssize_t fw_release_date_iso8601_show(struct device *device,
+					    struct device_attribute *attr,
+					    char *buf)
+{
+	return sprintf(buf, "%04u-%02u-%02uT%02u:%02u:%02u\n", fw.year,
+		       fw.month, fw.day, fw.hour, fw.minute, fw.second);
+}
+
+static ssize_t fw_release_date_epoch_show(struct device *device,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	return sprintf(buf, "%lld\n", (long long)fw.epoch);
+}
+
+// The camera is cut off in hardware while the hard bit is clear
+static ssize_t webcam_hard_block_show(struct device *device,
+				      struct device_attribute *attr, char *buf)
+{
+	u8 rdata;
+	int result;
+
+	result = msi_ec_read(conf.webcam.hard_address, &rdata);
+	if (result < 0)
+		return result;
+
+	return sprintf(buf, "%i\n", !is_bit_set(conf.webcam.hard_bit, rdata));
+}
+
+static ssize_t ac_connected_show(struct device *device,
+			     	 struct device_attribute *attr, char *buf)
+{
+	u8 rdata;
+	int result;
+
+	result = msi_ec_read(conf.power.address, &rdata);
+	if (result < 0)
+		return result;
+
+	return sprintf(buf, "%i\n", is_bit_set(conf.power.ac_connected_bit, rdata));
+}
+
+static ssize_t lid_open_show(struct device *device,
+			     struct device_attribute *attr, char *buf)
+{
+	u8 rdata;
+	int result;
+
+	result = msi_ec_read(conf.power.address, &rdata);
+	if (result < 0)
+		return result;
+
+	return sprintf(buf, "%i\n", is_bit_set(conf.power.lid_open_bit, rdata));
+}
+
+static DEVICE_ATTR_RW(preset);
+static DEVICE_ATTR_RO(fw_version);
+static DEVICE_ATTR_RO(fw_release_date);
+static DEVICE_ATTR_RO(fw_release_date_iso8601);
+static DEVICE_ATTR_RO(fw_release_date_epoch);
+static DEVICE_ATTR_RO(ac_connected);
+static DEVICE_ATTR_RO(lid_open);
+static DEVICE_ATTR_RO(webcam_hard_block);
+
+static struct attribute *msi_root_attrs[] = {
+	&dev_attr_fw_version.attr,	&dev_attr_ac_connected.attr,
+	&dev_attr_lid_open.attr,	&dev_attr_fw_release_date.attr,
+	&dev_attr_preset.attr,		&dev_attr_webcam_hard_block.attr,
+	&dev_attr_fw_release_date_iso8601.attr,
+	&dev_attr_fw_release_date_epoch.attr,
+	NULL
+};
+
+static umode_t msi_root_is_visible(struct kobject *kobj,
+				   struct attribute *attr, int idx)
+{
+	bool supported = TRUE;
+
+	if (attr == &dev_attr_preset.attr)
+		supported = preset_supported();
+	else if (attr == &dev_attr_fw_release_date.attr ||
+		 attr == &dev_attr_fw_release_date_iso8601.attr ||
+		 attr == &dev_attr_fw_release_date_epoch.attr)
+		supported = fw.dated;
+	else if (attr == &dev_attr_ac_connected.attr)
+		supported = conf.power.address != MSI_EC_ADDR_UNSUPP &&
+			    conf.power.ac_connected_bit != MSI_EC_BIT_UNSUPP;
+	else if (attr == &dev_attr_lid_open.attr)
+		supported = conf.power.address != MSI_EC_ADDR_UNSUPP &&
+			    conf.power.lid_open_bit != MSI_EC_BIT_UNSUPP;
+	else if (attr == &dev_attr_webcam_hard_block.attr)
+		supported = conf.webcam.hard_address != MSI_EC_ADDR_UNSUPP &&
+			    conf.webcam.hard_bit != MSI_EC_BIT_UNSUPP;
+
+	return supported ? attr->mode : 0;
+}
+
+static const struct attribute_group msi_root_group = {
+	.is_visible = msi_root_is_visible,
+	.attrs = msi_root_attrs,
+};
+
+// ============================================================ //
+// Sysfs platform device attributes (cpu)
+// ============================================================ //
+
+static ssize_t cpu_realtime_temperature_show(struct device *device,
+					     struct device_attribute *attr,
+					     char *buf)
+{
+	u8 rdata;
+	int result;
+
+	result = msi_ec_read(conf.cpu.rt_temp_address, &rdata);
+	if (result < 0)
+		return result;
+
+	return sprintf(buf, "%i\n", rdata);
+}
+
+static ssize_t cpu_realtime_fan_speed_show(struct device *device,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	u8 rdata;
+	int result;
+
+	result = msi_ec_read(conf.cpu.rt_fan_speed_address, &rdata);
+	if (result < 0)
+		return result;
+
+	if (rdata < conf.cpu.rt_fan_speed_base_min ||
+	    rdata > conf.cpu.rt_fan_speed_base_max)
+		return -EINVAL;
+
+	return sprintf(buf, "%i\n",
+		       100 * (rdata - conf.cpu.rt_fan_speed_base_min) /
+			       (conf.cpu.rt_fan_speed_base_max -
+				conf.cpu.rt_fan_speed_base_min));
+}
+
+
+
+static struct device_attribute dev_attr_cpu_realtime_temperature = {
+	.attr = {
+		.name = "realtime_temperature",
+		.mode = 0444,
+	},
+	.show = cpu_realtime_temperature_show,
+};
+
+static struct device_attribute dev_attr_cpu_realtime_fan_speed = {
+	.attr = {
+		.name = "realtime_fan_speed",
+		.mode = 0444,
+	},
+	.show = cpu_realtime_fan_speed_show,
+};
+
+static struct attribute *msi_cpu_attrs[] = {
+	&dev_attr_cpu_realtime_temperature.attr,
+	&dev_attr_cpu_realtime_fan_speed.attr,
+	NULL,
+};
+
+static umode_t msi_cpu_is_visible(struct kobject *kobj,
+				  struct attribute *attr, int idx)
+{
+	bool supported = TRUE;
+
+	if (attr == &dev_attr_cpu_realtime_temperature.attr)
+		supported = conf.cpu.rt_temp_address != MSI_EC_ADDR_UNSUPP;
+	else if (attr == &dev_attr_cpu_realtime_fan_speed.attr)
+		supported = conf.cpu.rt_fan_speed_address != MSI_EC_ADDR_UNSUPP;
+
+	return supported ? attr->mode : 0;
+}
+
+static const struct attribute_group msi_cpu_group = {
+	.name = "cpu",
+	.is_visible = msi_cpu_is_visible,
+	.attrs = msi_cpu_attrs,
+};
+
+// ============================================================ //
+// Sysfs platform device attributes (gpu)
+// ============================================================ //
+
+static ssize_t gpu_realtime_temperature_show(struct device *device,
+					     struct device_attribute *attr,
+					     char *buf)
+{
+	u8 rdata;
 	int result;
 
-	memset(rdata, 0, MSI_EC_FW_VERSION_LENGTH + 1);
-	result = ec_read_seq(MSI_EC_FW_VERSION_ADDRESS, rdata,
-			     MSI_EC_FW_VERSION_LENGTH);
-	if (result < 0)
-		return result;
+	result = msi_ec_read(conf.gpu.rt_temp_address, &rdata);
+	if (result < 0)
+		return result;
+
+	return sprintf(buf, "%i\n", rdata);
+}
+
+static ssize_t gpu_realtime_fan_speed_show(struct device *device,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	u8 rdata;
+	int result;
+
+	result = msi_ec_read(conf.gpu.rt_fan_speed_address, &rdata);
+	if (result < 0)
+		return result;
+
+	return sprintf(buf, "%i\n", rdata);
+}
+
+static struct device_attribute dev_attr_gpu_realtime_temperature = {
+	.attr = {
+		.name = "realtime_temperature",
+		.mode = 0444,
+	},
+	.show = gpu_realtime_temperature_show,
+};
+
+static struct device_attribute dev_attr_gpu_realtime_fan_speed = {
+	.attr = {
+		.name = "realtime_fan_speed",
+		.mode = 0444,
+	},
+	.show = gpu_realtime_fan_speed_show,
+};
+
+static struct attribute *msi_gpu_attrs[] = {
+	&dev_attr_gpu_realtime_temperature.attr,
+	&dev_attr_gpu_realtime_fan_speed.attr,
+	NULL,
+};
+
+static umode_t msi_gpu_is_visible(struct kobject *kobj,
+				  struct attribute *attr, int idx)
+{
+	bool supported = TRUE;
+
+	if (attr == &dev_attr_gpu_realtime_temperature.attr)
+		supported = conf.gpu.rt_temp_address != MSI_EC_ADDR_UNSUPP;
+	else if (attr == &dev_attr_gpu_realtime_fan_speed.attr)
+		supported = conf.gpu.rt_fan_speed_address != MSI_EC_ADDR_UNSUPP;
+
+	return supported ? attr->mode : 0;
+}
+
+static const struct attribute_group msi_gpu_group = {
+	.name = "gpu",
+	.is_visible = msi_gpu_is_visible,
+	.attrs = msi_gpu_attrs,
+};
+
+// ============================================================ //
+// Sysfs platform device attributes (ec)
+// ============================================================ //
+
+static ssize_t breaker_state_show(struct device *device,
+				  struct device_attribute *attr, char *buf)
+{
+	enum msi_ec_breaker_state state = READ_ONCE(breaker.state);
+
+	return sprintf(buf, "%s\n", msi_ec_breaker_state_names[state]);
+}
+
+static ssize_t breaker_failures_show(struct device *device,
+				     struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(breaker.failures));
+}
+
+// Time until the next probe while the breaker is open
+static ssize_t breaker_retry_ms_show(struct device *device,
+				     struct device_attribute *attr, char *buf)
+{
+	u64 now = ktime_get_ns();
+	u64 retry = 0;
+
+	mutex_lock(&breaker_lock);
+	if (breaker.state == MSI_EC_BREAKER_OPEN && breaker.probe_ns > now)
+		retry = div64_u64(breaker.probe_ns - now, NSEC_PER_MSEC);
+	mutex_unlock(&breaker_lock);
+
+	return sprintf(buf, "%llu\n", (unsigned long long)retry);
+}
+
+static ssize_t breaker_trips_show(struct device *device,
+				  struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n", (unsigned long long)READ_ONCE(breaker.trips));
+}
+
+static ssize_t breaker_rejected_show(struct device *device,
+				     struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       (unsigned long long)READ_ONCE(breaker.rejected));
+}
+
+static ssize_t stale_reads_show(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n", (unsigned long long)READ_ONCE(breaker.stale));
+}
+
+static DEVICE_ATTR_RO(breaker_state);
+static DEVICE_ATTR_RO(breaker_failures);
+static DEVICE_ATTR_RO(breaker_retry_ms);
+static DEVICE_ATTR_RO(breaker_trips);
+static DEVICE_ATTR_RO(breaker_rejected);
+static DEVICE_ATTR_RO(stale_reads);
+
+static struct attribute *msi_ec_attrs[] = {
+	&dev_attr_breaker_state.attr,
+	&dev_attr_breaker_failures.attr,
+	&dev_attr_breaker_retry_ms.attr,
+	&dev_attr_breaker_trips.attr,
+	&dev_attr_breaker_rejected.attr,
+	&dev_attr_stale_reads.attr,
+	NULL,
+};
+
+static const struct attribute_group msi_ec_group = {
+	.name = "ec",
+	.attrs = msi_ec_attrs,
+};
+
+// ============================================================ //
+// Suspend/resume
+// ============================================================ //
+
+/*
+ * The EC may come back from sleep with some controls reset to firmware
+ * defaults. Every register the driver writes is snapshotted on suspend and
+ * put back on resume, limited to the bits the driver owns and skipping the
+ * registers that survived. Registers are restored in table order: preset
+ * columns first, so the individual controls can override them.
+ */
+
+#define MSI_EC_SNAPSHOT_MAX 24
+
+struct msi_ec_snapshot_entry {
+	u8 address;
+	u8 mask;
+	u8 value;
+	bool valid;
+};
+
+static struct msi_ec_snapshot_entry snapshot[MSI_EC_SNAPSHOT_MAX];
+static int snapshot_count;
+
+static void snapshot_add(int address, u8 mask)
+{
+	int i;
+
+	if (address < 0 || address > 0xff || !mask)
+		return;
+
+	for (i = 0; i < snapshot_count; i++) {
+		if (snapshot[i].address == address) {
+			snapshot[i].mask |= mask;
+			return;
+		}
+	}
+
+	if (WARN_ON(snapshot_count == MSI_EC_SNAPSHOT_MAX))
+		return;
+
+	snapshot[snapshot_count].address = address;
+	snapshot[snapshot_count].mask = mask;
+	snapshot[snapshot_count].valid = FALSE;
+	snapshot_count++;
+}
+
+// Collect the writable registers of conf; called after msi_ec_enum_bind()
+static void msi_ec_snapshot_init(void)
+{
+	const struct msi_ec_enum_attr *ea;
+	int c;
+
+	snapshot_count = 0;
+
+	for (c = 0; c < MSI_EC_PRESET_COLUMNS; c++) {
+		if (c != MSI_EC_PRESET_COLUMN_SILENT_FLAG)
+			snapshot_add(conf.preset.addresses[c], 0xff);
+		else if (conf.preset.silent_flag_bit >= 0)
+			snapshot_add(conf.preset.addresses[c],
+				     BIT(conf.preset.silent_flag_bit));
+	}
+
+	for (ea = msi_ec_enum_attrs;
+	     ea < msi_ec_enum_attrs + MSI_EC_ENUM_ATTR_COUNT; ea++)
+		snapshot_add(*ea->address, ea->mask);
+
+	snapshot_add(conf.kbd_bl.address, 0xff);
+	snapshot_add(conf.leds.micmute_address, 0xff);
+	snapshot_add(conf.leds.mute_address, 0xff);
+}
+
+static int __maybe_unused msi_ec_suspend(struct device *dev)
+{
+	struct msi_ec_snapshot_entry *e;
+	bool tripped = READ_ONCE(breaker.state) != MSI_EC_BREAKER_CLOSED;
+
+	// Nothing is saved from an EC that stopped responding
+	if (tripped)
+		pr_warn("msi-ec: suspend: circuit breaker open, not saving registers\n");
+
+	// Straight from the EC, a budget or stale value must not be written back
+	for (e = snapshot; e < snapshot + snapshot_count; e++)
+		e->valid = !tripped &&
+			   msi_ec_read_fresh(e->address, &e->value) == 0;
+
+	return 0;
+}
+
+static int __maybe_unused msi_ec_resume(struct device *dev)
+{
+	struct msi_ec_snapshot_entry *e;
+	int restored = 0;
+	u64 start;
+	u8 rdata;
+	int result;
+
+	start = ktime_get_ns();
+
+	for (e = snapshot; e < snapshot + snapshot_count; e++) {
+		if (!e->valid)
+			continue;
+
+		mutex_lock(&ec_update_lock);
+		result = msi_ec_read_fresh(e->address, &rdata);
+		if (result == 0 && (rdata & e->mask) == (e->value & e->mask)) {
+			mutex_unlock(&ec_update_lock);
+			continue;
+		}
+
+		// If the register cannot be read, write back the whole snapshot
+		if (result < 0)
+			rdata = e->value;
+		result = msi_ec_write(e->address,
+				      (rdata & ~e->mask) | (e->value & e->mask));
+		mutex_unlock(&ec_update_lock);
+		if (result < 0)
+			pr_err("msi-ec: resume: failed to restore address %#02x "
+			       "(error code %i)\n", e->address, result);
+		else
+			restored++;
+	}
+
+	pr_info("msi-ec: resume: restored %i of %i registers in %llu us\n",
+		restored, snapshot_count,
+		(unsigned long long)(ktime_get_ns() - start) / 1000);
+
+	return 0;
+}
+
+static SIMPLE_DEV_PM_OPS(msi_ec_pm_ops, msi_ec_suspend, msi_ec_resume);
+
+// ============================================================ //
+// Sysfs leds subsystem
+// ============================================================ //
+
+static int micmute_led_sysfs_set(struct led_classdev *led_cdev,
+				 enum led_brightness brightness)
+{
+	u8 state = brightness ? conf.leds.micmute_on : conf.leds.micmute_off;
+	int result = msi_ec_write(conf.leds.micmute_address, state);
+	if (result < 0)
+		return result;
+	return 0;
+}
+
+static int mute_led_sysfs_set(struct led_classdev *led_cdev,
+			      enum led_brightness brightness)
+{
+	u8 state = brightness ? conf.leds.mute_on : conf.leds.mute_off;
+	int result = msi_ec_write(conf.leds.mute_address, state);
+	if (result < 0)
+		return result;
+	return 0;
+}
+
+static enum led_brightness kbd_bl_sysfs_get(struct led_classdev *led_cdev)
+{
+	u8 rdata;
+	int result = msi_ec_read(conf.kbd_bl.address, &rdata);
+	if (result < 0)
+		return 0;
+	return rdata & conf.kbd_bl.state_mask;
+}
+
+/*
+ * Level last written through the LED class, -1 if none: the change it
+ * causes is not a hardware change. Consumed by the next change seen.
+ */
+static atomic_t kbd_bl_written = ATOMIC_INIT(-1);
+
+static int kbd_bl_sysfs_set(struct led_classdev *led_cdev,
+			    enum led_brightness brightness)
+{
+	u8 wdata;
+	int result;
+	if (brightness > 3)
+		return -1;
+	wdata = conf.kbd_bl.states[brightness];
+	atomic_set(&kbd_bl_written, brightness);
+	result = msi_ec_write(conf.kbd_bl.address, wdata);
+	if (result < 0)
+		atomic_set(&kbd_bl_written, -1);
+	return result;
+}
+
+static struct led_classdev micmute_led_cdev = {
+	.name = "platform::micmute",
+	.max_brightness = 1,
+	.brightness_set_blocking = &micmute_led_sysfs_set,
+	.default_trigger = "audio-micmute",
+};
+
+static struct led_classdev mute_led_cdev = {
+	.name = "platform::mute",
+	.max_brightness = 1,
+	.brightness_set_blocking = &mute_led_sysfs_set,
+	.default_trigger = "audio-mute",
+};
+
+static struct led_classdev msiacpi_led_kbdlight = {
+	.name = "msiacpi::kbd_backlight",
+	.max_brightness = 3,
+	.flags = LED_BRIGHT_HW_CHANGED | LED_RETAIN_AT_SHUTDOWN,
+	.brightness_set_blocking = &kbd_bl_sysfs_set,
+	.brightness_get = &kbd_bl_sysfs_get,
+};
+
+// ============================================================ //
+// EC events
+// ============================================================ //
+
+/*
+ * Firmware changes the power, keyboard backlight and webcam registers on its
+ * own (AC plug, lid, Fn hotkeys). Event sources only say which of them may
+ * have changed; a work item re-reads those registers and notifies the
+ * attributes whose value differs from the cached one. Events arriving while
+ * the work is pending are merged into one pass.
+ */
+
+struct msi_ec_event_reg {
+	unsigned int source;
+	const int *address;
+	u8 value;
+	bool valid;
+};
+
+static struct msi_ec_event_reg event_regs[] = {
+	{ MSI_EC_EVENT_POWER, &conf.power.address },
+	{ MSI_EC_EVENT_KBD_BL, &conf.kbd_bl.address },
+	{ MSI_EC_EVENT_WEBCAM, &conf.webcam.address },
+	{ MSI_EC_EVENT_WEBCAM, &conf.webcam.hard_address },
+};
 
-	return sprintf(buf, "%s\n", rdata);
-}
+static struct device *event_dev;
+static atomic_t event_pending = ATOMIC_INIT(0);
 
-static ssize_t fw_release_date_show(struct device *device,
-				    struct device_attribute *attr, char *buf)
+// Notifications go through these two, so KUnit can stub them out
+static void msi_ec_notify(const char *attr)
 {
-	u8 rdate[MSI_EC_FW_DATE_LENGTH + 1];
-	u8 rtime[MSI_EC_FW_TIME_LENGTH + 1];
-	int result;
-	int year, month, day, hour, minute, second;
+	KUNIT_STATIC_STUB_REDIRECT(msi_ec_notify, attr);
 
-	memset(rdate, 0, MSI_EC_FW_DATE_LENGTH + 1);
-	result = ec_read_seq(MSI_EC_FW_DATE_ADDRESS, rdate,
-			     MSI_EC_FW_DATE_LENGTH);
-	if (result < 0)
-		return result;
-	sscanf(rdate, "%02d%02d%04d", &month, &day, &year);
+	if (event_dev)
+		sysfs_notify(&event_dev->kobj, NULL, attr);
+}
 
-	memset(rtime, 0, MSI_EC_FW_TIME_LENGTH + 1);
-	result = ec_read_seq(MSI_EC_FW_TIME_ADDRESS, rtime,
-			     MSI_EC_FW_TIME_LENGTH);
-	if (result < 0)
-		return result;
-	sscanf(rtime, "%02d:%02d:%02d", &hour, &minute, &second);
+static void msi_ec_notify_kbd_bl(unsigned int level)
+{
+	KUNIT_STATIC_STUB_REDIRECT(msi_ec_notify_kbd_bl, level);
 
-	return sprintf(buf, "%04d/%02d/%02d %02d:%02d:%02d\n", year, month, day,
-		       hour, minute, second);
+	led_classdev_notify_brightness_hw_changed(&msiacpi_led_kbdlight, level);
 }
 
-static ssize_t ac_connected_show(struct device *device,
-			     	 struct device_attribute *attr, char *buf)
+static void event_notify_bit(const char *attr, int bit, u8 old, u8 new)
 {
-	u8 rdata;
-	int result;
-
-	result = ec_read(MSI_EC_POWER_ADDRESS, &rdata);
-	if (result < 0)
-		return result;
+	if (bit != MSI_EC_BIT_UNSUPP && is_bit_set(bit, old ^ new))
+		msi_ec_notify(attr);
+}
 
-	return sprintf(buf, "%i\n", is_bit_set(MSI_EC_POWER_AC_CONNECTED_BIT, rdata));
+static void msi_ec_event_changed(const struct msi_ec_event_reg *reg, u8 old,
+				 u8 new)
+{
+	unsigned int level;
+
+	if (!event_dev)
+		return;
+
+	if (reg->address == &conf.webcam.hard_address) {
+		event_notify_bit("webcam_hard_block", conf.webcam.hard_bit,
+				 old, new);
+	} else if (reg->source == MSI_EC_EVENT_POWER) {
+		event_notify_bit("ac_connected", conf.power.ac_connected_bit,
+				 old, new);
+		event_notify_bit("lid_open", conf.power.lid_open_bit, old, new);
+	} else if (reg->source == MSI_EC_EVENT_KBD_BL) {
+		level = new & conf.kbd_bl.state_mask;
+		if (level == (old & conf.kbd_bl.state_mask))
+			return;
+
+		// Skip the level set through the LED class, only report the Fn keys
+		if (atomic_xchg(&kbd_bl_written, -1) != level &&
+		    msiacpi_led_kbdlight.dev)
+			msi_ec_notify_kbd_bl(level);
+	} else if (reg->source == MSI_EC_EVENT_WEBCAM) {
+		event_notify_bit("webcam", conf.webcam.bit, old, new);
+	}
 }
 
-static ssize_t lid_open_show(struct device *device,
-			     struct device_attribute *attr, char *buf)
+static void msi_ec_event_process(unsigned int sources)
 {
+	struct msi_ec_event_reg *reg;
 	u8 rdata;
-	int result;
-
-	result = ec_read(MSI_EC_POWER_ADDRESS, &rdata);
-	if (result < 0)
-		return result;
-
-	return sprintf(buf, "%i\n", is_bit_set(MSI_EC_POWER_LID_OPEN_BIT, rdata));
-}
 
-static DEVICE_ATTR_RW(webcam);
-static DEVICE_ATTR_RW(fn_key);
-static DEVICE_ATTR_RW(win_key);
-static DEVICE_ATTR_RW(battery_charge_mode);
-static DEVICE_ATTR_RW(cooler_boost);
-static DEVICE_ATTR_RW(shift_mode);
-static DEVICE_ATTR_RW(fan_mode);
-static DEVICE_ATTR_RW(preset);
-static DEVICE_ATTR_RO(fw_version);
-static DEVICE_ATTR_RO(fw_release_date);
-static DEVICE_ATTR_RO(ac_connected);
-static DEVICE_ATTR_RO(lid_open);
+	for (reg = event_regs; reg < event_regs + ARRAY_SIZE(event_regs); reg++) {
+		if (!(sources & reg->source) ||
+		    *reg->address == MSI_EC_ADDR_UNSUPP)
+			continue;
 
-static struct attribute *msi_root_attrs[] = {
-	&dev_attr_webcam.attr,		&dev_attr_fn_key.attr,
-	&dev_attr_win_key.attr,		&dev_attr_battery_charge_mode.attr,
-	&dev_attr_cooler_boost.attr,	&dev_attr_shift_mode.attr,
-	&dev_attr_fan_mode.attr,		&dev_attr_fw_version.attr,
-	&dev_attr_ac_connected.attr,	&dev_attr_lid_open.attr,
-	&dev_attr_fw_release_date.attr,	&dev_attr_preset.attr,
-	NULL
-};
+		if (msi_ec_read(*reg->address, &rdata) < 0) {
+			reg->valid = FALSE;
+			continue;
+		}
 
-static const struct attribute_group msi_root_group = {
-	.attrs = msi_root_attrs,
-};
+		// The first read only fills the cache
+		if (reg->valid && rdata != reg->value)
+			msi_ec_event_changed(reg, reg->value, rdata);
 
-// ============================================================ //
-// Sysfs platform device attributes (cpu)
-// ============================================================ //
+		reg->value = rdata;
+		reg->valid = TRUE;
+	}
+}
 
-static ssize_t cpu_realtime_temperature_show(struct device *device,
-					     struct device_attribute *attr,
-					     char *buf)
+static void msi_ec_event_reset(void)
 {
-	u8 rdata;
-	int result;
-
-	result = ec_read(MSI_EC_CPU_REALTIME_TEMPERATURE_ADDRESS, &rdata);
-	if (result < 0)
-		return result;
+	struct msi_ec_event_reg *reg;
 
-	return sprintf(buf, "%i\n", rdata);
+	for (reg = event_regs; reg < event_regs + ARRAY_SIZE(event_regs); reg++)
+		reg->valid = FALSE;
 }
 
-static ssize_t cpu_realtime_fan_speed_show(struct device *device,
-					   struct device_attribute *attr,
-					   char *buf)
+static void event_work_fn(struct work_struct *work)
 {
-	u8 rdata;
-	int result;
+	// Queued just before the device went away
+	if (!READ_ONCE(event_dev))
+		return;
 
-	result = ec_read(MSI_EC_CPU_REALTIME_FAN_SPEED_ADDRESS, &rdata);
-	if (result < 0)
-		return result;
+	msi_ec_event_process(atomic_xchg(&event_pending, 0));
+}
 
-	if (rdata < MSI_EC_CPU_REALTIME_FAN_SPEED_BASE_MIN ||
-	    rdata > MSI_EC_CPU_REALTIME_FAN_SPEED_BASE_MAX)
-		return -EINVAL;
+static DECLARE_WORK(event_work, event_work_fn);
 
-	return sprintf(buf, "%i\n",
-		       100 * (rdata - MSI_EC_CPU_REALTIME_FAN_SPEED_BASE_MIN) /
-			       (MSI_EC_CPU_REALTIME_FAN_SPEED_BASE_MAX -
-				MSI_EC_CPU_REALTIME_FAN_SPEED_BASE_MIN));
+void msi_ec_backend_event(unsigned int sources)
+{
+	// Without a bound device conf has no registers to read
+	if (!READ_ONCE(event_dev))
+		return;
+
+	atomic_or(sources, &event_pending);
+	schedule_work(&event_work);
 }
+EXPORT_SYMBOL_GPL(msi_ec_backend_event);
 
+#if IS_ENABLED(CONFIG_ACPI)
+static int acpi_bus_notifier(struct notifier_block *nb, unsigned long val,
+			     void *data)
+{
+	struct acpi_bus_event *event = data;
 
+	if (strcmp(event->device_class, "ac_adapter") == 0)
+		msi_ec_backend_event(MSI_EC_EVENT_POWER);
+	return NOTIFY_DONE;
+}
 
-static struct device_attribute dev_attr_cpu_realtime_temperature = {
-	.attr = {
-		.name = "realtime_temperature",
-		.mode = 0444,
-	},
-	.show = cpu_realtime_temperature_show,
-};
+static int lid_notifier(struct notifier_block *nb, unsigned long val,
+			void *data)
+{
+	msi_ec_backend_event(MSI_EC_EVENT_POWER);
+	return NOTIFY_DONE;
+}
 
-static struct device_attribute dev_attr_cpu_realtime_fan_speed = {
-	.attr = {
-		.name = "realtime_fan_speed",
-		.mode = 0444,
-	},
-	.show = cpu_realtime_fan_speed_show,
-};
+// Notify() from the EC's _Qxx query methods, raised by the Fn hotkeys
+static void ec_notify_handler(acpi_handle handle, u32 event, void *data)
+{
+	msi_ec_backend_event(MSI_EC_EVENT_KBD_BL | MSI_EC_EVENT_WEBCAM);
+}
 
-static struct attribute *msi_cpu_attrs[] = {
-	&dev_attr_cpu_realtime_temperature.attr,
-	&dev_attr_cpu_realtime_fan_speed.attr,
-	NULL,
+static struct notifier_block acpi_bus_nb = {
+	.notifier_call = acpi_bus_notifier,
 };
 
-static const struct attribute_group msi_cpu_group = {
-	.name = "cpu",
-	.attrs = msi_cpu_attrs,
+static struct notifier_block lid_nb = {
+	.notifier_call = lid_notifier,
 };
 
-// ============================================================ //
-// Sysfs platform device attributes (gpu)
-// ============================================================ //
+static struct acpi_device *ec_adev;
 
-static ssize_t gpu_realtime_temperature_show(struct device *device,
-					     struct device_attribute *attr,
-					     char *buf)
+static void msi_ec_acpi_events_start(void)
 {
-	u8 rdata;
-	int result;
+	acpi_status status;
 
-	result = ec_read(MSI_EC_GPU_REALTIME_TEMPERATURE_ADDRESS, &rdata);
-	if (result < 0)
-		return result;
+	register_acpi_notifier(&acpi_bus_nb);
+	acpi_lid_notifier_register(&lid_nb);
 
-	return sprintf(buf, "%i\n", rdata);
+	ec_adev = acpi_dev_get_first_match_dev("PNP0C09", NULL, -1);
+	if (!ec_adev)
+		return;
+
+	status = acpi_install_notify_handler(ec_adev->handle, ACPI_DEVICE_NOTIFY,
+					     ec_notify_handler, NULL);
+	if (ACPI_FAILURE(status)) {
+		pr_warn("msi-ec: cannot listen to EC notifications, hotkey changes will not be reported\n");
+		acpi_dev_put(ec_adev);
+		ec_adev = NULL;
+	}
 }
 
-static ssize_t gpu_realtime_fan_speed_show(struct device *device,
-					   struct device_attribute *attr,
-					   char *buf)
+static void msi_ec_acpi_events_stop(void)
 {
-	u8 rdata;
-	int result;
-
-	result = ec_read(MSI_EC_GPU_REALTIME_FAN_SPEED_ADDRESS, &rdata);
-	if (result < 0)
-		return result;
+	if (ec_adev) {
+		acpi_remove_notify_handler(ec_adev->handle, ACPI_DEVICE_NOTIFY,
+					   ec_notify_handler);
+		acpi_dev_put(ec_adev);
+		ec_adev = NULL;
+	}
 
-	return sprintf(buf, "%i\n", rdata);
+	acpi_lid_notifier_unregister(&lid_nb);
+	unregister_acpi_notifier(&acpi_bus_nb);
 }
+#else
+static void msi_ec_acpi_events_start(void) { }
+static void msi_ec_acpi_events_stop(void) { }
+#endif
 
-static struct device_attribute dev_attr_gpu_realtime_temperature = {
-	.attr = {
-		.name = "realtime_temperature",
-		.mode = 0444,
-	},
-	.show = gpu_realtime_temperature_show,
-};
+static void msi_ec_events_start(struct device *dev)
+{
+	msi_ec_event_reset();
+	WRITE_ONCE(event_dev, dev);
 
-static struct device_attribute dev_attr_gpu_realtime_fan_speed = {
-	.attr = {
-		.name = "realtime_fan_speed",
-		.mode = 0444,
-	},
-	.show = gpu_realtime_fan_speed_show,
-};
+	// An external backend reports its own events
+	if (!external_backend)
+		msi_ec_acpi_events_start();
 
-static struct attribute *msi_gpu_attrs[] = {
-	&dev_attr_gpu_realtime_temperature.attr,
-	&dev_attr_gpu_realtime_fan_speed.attr,
-	NULL,
-};
+	// Fill the cache off the probe path
+	msi_ec_backend_event(MSI_EC_EVENT_ALL);
+}
 
-static const struct attribute_group msi_gpu_group = {
-	.name = "gpu",
-	.attrs = msi_gpu_attrs,
-};
+static void msi_ec_events_stop(void)
+{
+	if (!external_backend)
+		msi_ec_acpi_events_stop();
+
+	// Cleared first, so no event queues the work again once it is cancelled
+	WRITE_ONCE(event_dev, NULL);
+	cancel_work_sync(&event_work);
+	atomic_set(&event_pending, 0);
+}
 
 static const struct attribute_group *msi_platform_groups[] = {
 	&msi_root_group,
+	&msi_enum_group,
 	&msi_cpu_group,
 	&msi_gpu_group,
+	&msi_ec_group,
 	NULL,
 };
 
+// Enable backlight by default, the EC comes up with it off
+static void kbd_bl_init_work_fn(struct work_struct *work)
+{
+	int result;
+
+	// Through the LED core so its cached brightness matches the EC
+	result = led_set_brightness_sync(&msiacpi_led_kbdlight, 2);
+	if (result < 0)
+		pr_err("msi-ec: failed to enable keyboard backlight (error code %i)\n",
+		       result);
+}
+
+static DECLARE_WORK(kbd_bl_init_work, kbd_bl_init_work_fn);
+
 static int msi_platform_probe(struct platform_device *pdev)
 {
+	u64 start = ktime_get_ns();
 	int result;
-	result = sysfs_create_groups(&pdev->dev.kobj, msi_platform_groups);
+
+	result = load_configuration(&pdev->dev);
 	if (result < 0)
 		return result;
+	msi_ec_enum_bind();
+	msi_ec_snapshot_init();
+
+	if (conf.leds.micmute_address != MSI_EC_ADDR_UNSUPP) {
+		result = devm_led_classdev_register(&pdev->dev, &micmute_led_cdev);
+		if (result < 0)
+			return result;
+	}
+	if (conf.leds.mute_address != MSI_EC_ADDR_UNSUPP) {
+		result = devm_led_classdev_register(&pdev->dev, &mute_led_cdev);
+		if (result < 0)
+			return result;
+	}
+	if (conf.kbd_bl.address != MSI_EC_ADDR_UNSUPP) {
+		result = devm_led_classdev_register(&pdev->dev,
+						    &msiacpi_led_kbdlight);
+		if (result < 0)
+			return result;
+
+		// Off the probe path, an EC write can take milliseconds
+		schedule_work(&kbd_bl_init_work);
+	}
+
+	msi_ec_events_start(&pdev->dev);
+
+	// The attribute groups are added by the driver core through dev_groups
+	pr_info("msi-ec: probed %s in %llu us\n", conf.name,
+		(unsigned long long)(ktime_get_ns() - start) / 1000);
 	return 0;
 }
 
 static int msi_platform_remove(struct platform_device *pdev)
 {
-	sysfs_remove_groups(&pdev->dev.kobj, msi_platform_groups);
+	msi_ec_events_stop();
+	cancel_work_sync(&kbd_bl_init_work);
+	memset(&fw, 0, sizeof(fw));
 	return 0;
 }
 
+/*
+ * The firmware identity goes into the device's uevents (from the one that
+ * reports the driver bound on), so udev rules can match on it.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+static int msi_ec_uevent(const struct device *dev, struct kobj_uevent_env *env)
+#else
+static int msi_ec_uevent(struct device *dev, struct kobj_uevent_env *env)
+#endif
+{
+	int result;
+
+	if (!fw.version[0])
+		return 0;
+
+	result = add_uevent_var(env, "MSI_EC_FW_VERSION=%s", fw.version);
+	if (result == 0 && fw.dated)
+		result = add_uevent_var(env,
+			"MSI_EC_FW_RELEASE_DATE=%04u-%02u-%02uT%02u:%02u:%02u",
+			fw.year, fw.month, fw.day, fw.hour, fw.minute,
+			fw.second);
+
+	return result;
+}
+
+static const struct device_type msi_ec_device_type = {
+	.uevent = msi_ec_uevent,
+};
+
 static struct platform_device *msi_platform_device;
 
 static struct platform_driver msi_platform_driver = {
 	.driver = {
 		.name = MSI_DRIVER_NAME,
+		.pm = &msi_ec_pm_ops,
+		.dev_groups = msi_platform_groups,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = msi_platform_probe,
 	.remove = msi_platform_remove,
 };
 
 // ============================================================ //
-// Sysfs leds subsystem
+// Module load/unload
 // ============================================================ //
 
-static int micmute_led_sysfs_set(struct led_classdev *led_cdev,
-				 enum led_brightness brightness)
-{
-	u8 state = brightness ? MSI_EC_MIC_LED_STATE_ON : MSI_EC_MIC_LED_STATE_OFF;
-	int result = ec_write(MSI_EC_KBD_LED_MICMUTE_ADDRESS, state);
-	if (result < 0)
-		return result;
-	return 0;
-}
+/* EC access statistics */
+static struct dentry *msi_ec_debugfs;
 
-static int mute_led_sysfs_set(struct led_classdev *led_cdev,
-			      enum led_brightness brightness)
+static int msi_ec_device_add(void)
 {
-	u8 state = brightness ? MSI_EC_MUTE_LED_STATE_ON : MSI_EC_MUTE_LED_STATE_OFF;
-	int result = ec_write(MSI_EC_KBD_LED_MUTE_ADDRESS, state);
-	if (result < 0)
+	int result;
+
+	msi_platform_device = platform_device_alloc(MSI_DRIVER_NAME, -1);
+	if (msi_platform_device == NULL)
+		return -ENOMEM;
+	msi_platform_device->dev.type = &msi_ec_device_type;
+
+	// Probing is asynchronous, an unsupported model leaves the device unbound
+	result = platform_device_add(msi_platform_device);
+	if (result < 0) {
+		platform_device_put(msi_platform_device);
+		msi_platform_device = NULL;
 		return result;
+	}
+
 	return 0;
 }
 
-static enum led_brightness kbd_bl_sysfs_get(struct led_classdev *led_cdev)
+static void msi_ec_device_del(void)
 {
-	u8 rdata;
-	int result = ec_read(MSI_EC_KBD_BL_ADDRESS, &rdata);
-	if (result < 0)
-		return 0;
-	return rdata & MSI_EC_KBD_BL_STATE_MASK;
+	if (msi_platform_device == NULL)
+		return;
+
+	platform_device_unregister(msi_platform_device);
+	msi_platform_device = NULL;
 }
 
-static int kbd_bl_sysfs_set(struct led_classdev *led_cdev,
-			    enum led_brightness brightness)
+static DEFINE_MUTEX(backend_lock);
+
+int msi_ec_backend_register(const struct msi_ec_backend *new_backend)
 {
-	u8 wdata;
-	if (brightness > 3)
-		return -1;
-	wdata = MSI_EC_KBD_BL_STATE[brightness];
-	return ec_write(MSI_EC_KBD_BL_ADDRESS, wdata);
-}
+	int result;
 
-static struct led_classdev micmute_led_cdev = {
-	.name = "platform::micmute",
-	.max_brightness = 1,
-	.brightness_set_blocking = &micmute_led_sysfs_set,
-	.default_trigger = "audio-micmute",
-};
+	if (!external_backend)
+		return -EBUSY;
 
-static struct led_classdev mute_led_cdev = {
-	.name = "platform::mute",
-	.max_brightness = 1,
-	.brightness_set_blocking = &mute_led_sysfs_set,
-	.default_trigger = "audio-mute",
-};
+	mutex_lock(&backend_lock);
+	if (backend != &acpi_backend) {
+		mutex_unlock(&backend_lock);
+		return -EBUSY;
+	}
 
-static struct led_classdev msiacpi_led_kbdlight = {
-	.name = "msiacpi::kbd_backlight",
-	.max_brightness = 3,
-	.flags = LED_BRIGHT_HW_CHANGED & LED_RETAIN_AT_SHUTDOWN,
-	.brightness_set_blocking = &kbd_bl_sysfs_set,
-	.brightness_get = &kbd_bl_sysfs_get,
-};
+	backend = new_backend;
+	result = msi_ec_device_add();
+	if (result < 0)
+		backend = &acpi_backend;
+	mutex_unlock(&backend_lock);
 
-// ============================================================ //
-// Module load/unload
-// ============================================================ //
+	if (result == 0)
+		pr_info("msi-ec: using %s EC backend\n", new_backend->name);
+	return result;
+}
+EXPORT_SYMBOL_GPL(msi_ec_backend_register);
+
+void msi_ec_backend_unregister(const struct msi_ec_backend *old_backend)
+{
+	mutex_lock(&backend_lock);
+	if (backend == old_backend) {
+		msi_ec_device_del();
+		backend = &acpi_backend;
+	}
+	mutex_unlock(&backend_lock);
+}
+EXPORT_SYMBOL_GPL(msi_ec_backend_unregister);
 
 static int __init msi_ec_init(void)
 {
 	int result;
 
-	if (acpi_disabled) {
+	if (acpi_disabled && !external_backend) {
 		pr_err("Unable to init because ACPI needs to be enabled first!\n");
 		return -ENODEV;
 	}
@@ -833,25 +2423,22 @@ static int __init msi_ec_init(void)
 		return result;
 	}
 
-	msi_platform_device = platform_device_alloc(MSI_DRIVER_NAME, -1);
-	if (msi_platform_device == NULL) {
-		platform_driver_unregister(&msi_platform_driver);
-		return -ENOMEM;
-	}
-
-	result = platform_device_add(msi_platform_device);
-	if (result < 0) {
-		platform_device_del(msi_platform_device);
-		platform_driver_unregister(&msi_platform_driver);
-		return result;
+	// The device is created once an external backend registers
+	if (!external_backend) {
+		result = msi_ec_device_add();
+		if (result < 0) {
+			platform_driver_unregister(&msi_platform_driver);
+			return result;
+		}
 	}
 
-	led_classdev_register(&msi_platform_device->dev, &micmute_led_cdev);
-	led_classdev_register(&msi_platform_device->dev, &mute_led_cdev);
-	led_classdev_register(&msi_platform_device->dev, &msiacpi_led_kbdlight);
-
-	// Enable backlight by default, the kernel doesn't properly retain its state despite flag for some reason
-	ec_write(MSI_EC_KBD_BL_ADDRESS, MSI_EC_KBD_BL_STATE[2]);
+	msi_ec_debugfs = debugfs_create_dir(MSI_DRIVER_NAME, NULL);
+	debugfs_create_file("ec_reads", 0400, msi_ec_debugfs, NULL,
+			    &ec_reads_fops);
+	debugfs_create_file("ec_queue", 0400, msi_ec_debugfs, NULL,
+			    &ec_queue_fops);
+	debugfs_create_file("ec_budget", 0400, msi_ec_debugfs, NULL,
+			    &ec_budget_fops);
 
 	pr_info("msi-ec: module_init\n");
 	return 0;
@@ -859,12 +2446,9 @@ static int __init msi_ec_init(void)
 
 static void __exit msi_ec_exit(void)
 {
-	led_classdev_unregister(&mute_led_cdev);
-	led_classdev_unregister(&micmute_led_cdev);
-	led_classdev_unregister(&msiacpi_led_kbdlight);
-
+	debugfs_remove_recursive(msi_ec_debugfs);
+	msi_ec_device_del();
 	platform_driver_unregister(&msi_platform_driver);
-	platform_device_del(msi_platform_device);
 
 	pr_info("msi-ec: module_exit\n");
 }
@@ -878,3 +2462,7 @@ MODULE_VERSION("0.09");
 
 module_init(msi_ec_init);
 module_exit(msi_ec_exit);
+
+#if IS_ENABLED(CONFIG_MSI_EC_KUNIT_TEST)
+#include "msi-ec-test.c"
+#endif
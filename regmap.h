@@ -0,0 +1,99 @@
+#ifndef __MSI_EC_REGMAP__
+#define __MSI_EC_REGMAP__
+
+#include <linux/types.h>
+
+/*
+ * Binary register map loaded through request_firmware() from
+ * /lib/firmware/msi-ec/<fw_version>.bin (see tools/mkregmap.py).
+ *
+ * The map is a header followed by `count` entries, all little-endian. Each
+ * entry overrides one field of the model configuration, on top of the
+ * compiled-in configuration for the firmware (or an all-unsupported one if
+ * there is none). crc32 is crc32_le(~0, entries, count * 4) ^ ~0.
+ */
+
+#define MSI_EC_REGMAP_MAGIC "MSEC"
+#define MSI_EC_REGMAP_VERSION 1
+#define MSI_EC_REGMAP_MAX_ENTRIES 256
+
+/* Entry values with a special meaning */
+#define MSI_EC_REGMAP_ADDR_UNSUPP 0xff01
+#define MSI_EC_REGMAP_BIT_UNSUPP 0xffff
+
+struct msi_ec_regmap_header {
+	char magic[4];
+	u8 version;
+	u8 reserved;
+	__le16 count;
+	__le32 crc32;
+} __packed;
+
+struct msi_ec_regmap_entry {
+	u8 field; /* enum msi_ec_regmap_field */
+	u8 index; /* element of array fields, 0 otherwise */
+	__le16 value;
+} __packed;
+
+/* Field ids are part of the file format, never renumber them */
+enum msi_ec_regmap_field {
+	MSI_EC_RM_WEBCAM_ADDRESS = 0x01,
+	MSI_EC_RM_WEBCAM_BIT = 0x02,
+	MSI_EC_RM_WEBCAM_HARD_ADDRESS = 0x03,
+	MSI_EC_RM_WEBCAM_HARD_BIT = 0x04,
+
+	MSI_EC_RM_FN_WIN_ADDRESS = 0x08,
+	MSI_EC_RM_FN_WIN_BIT = 0x09,
+	MSI_EC_RM_FN_WIN_FN_LEFT = 0x0a,
+	MSI_EC_RM_FN_WIN_WIN_LEFT = 0x0b,
+
+	MSI_EC_RM_CHARGE_CONTROL_ADDRESS = 0x10,
+	MSI_EC_RM_CHARGE_CONTROL_MAX = 0x11,
+	MSI_EC_RM_CHARGE_CONTROL_MEDIUM = 0x12,
+	MSI_EC_RM_CHARGE_CONTROL_MIN = 0x13,
+
+	MSI_EC_RM_COOLER_BOOST_ADDRESS = 0x18,
+	MSI_EC_RM_COOLER_BOOST_BIT = 0x19,
+
+	MSI_EC_RM_SHIFT_MODE_ADDRESS = 0x20,
+	MSI_EC_RM_SHIFT_MODE_OVERCLOCK = 0x21,
+	MSI_EC_RM_SHIFT_MODE_BALANCED = 0x22,
+	MSI_EC_RM_SHIFT_MODE_ECO = 0x23,
+	MSI_EC_RM_SHIFT_MODE_OFF = 0x24,
+
+	MSI_EC_RM_FAN_MODE_ADDRESS = 0x28,
+	MSI_EC_RM_FAN_MODE_SILENT_BIT = 0x29,
+	MSI_EC_RM_FAN_MODE_BASIC_BIT = 0x2a,
+	MSI_EC_RM_FAN_MODE_ADVANCED_BIT = 0x2b,
+
+	MSI_EC_RM_CPU_RT_TEMP_ADDRESS = 0x30,
+	MSI_EC_RM_CPU_RT_FAN_SPEED_ADDRESS = 0x31,
+	MSI_EC_RM_CPU_RT_FAN_SPEED_BASE_MIN = 0x32,
+	MSI_EC_RM_CPU_RT_FAN_SPEED_BASE_MAX = 0x33,
+
+	MSI_EC_RM_GPU_RT_TEMP_ADDRESS = 0x38,
+	MSI_EC_RM_GPU_RT_FAN_SPEED_ADDRESS = 0x39,
+
+	MSI_EC_RM_POWER_ADDRESS = 0x40,
+	MSI_EC_RM_POWER_LID_OPEN_BIT = 0x41,
+	MSI_EC_RM_POWER_AC_CONNECTED_BIT = 0x42,
+
+	MSI_EC_RM_LEDS_MICMUTE_ADDRESS = 0x48,
+	MSI_EC_RM_LEDS_MICMUTE_ON = 0x49,
+	MSI_EC_RM_LEDS_MICMUTE_OFF = 0x4a,
+	MSI_EC_RM_LEDS_MUTE_ADDRESS = 0x4b,
+	MSI_EC_RM_LEDS_MUTE_ON = 0x4c,
+	MSI_EC_RM_LEDS_MUTE_OFF = 0x4d,
+
+	MSI_EC_RM_KBD_BL_ADDRESS = 0x50,
+	MSI_EC_RM_KBD_BL_STATE_MASK = 0x51,
+	MSI_EC_RM_KBD_BL_STATES = 0x52, /* index: brightness level */
+
+	MSI_EC_RM_PRESET_ADDRESSES = 0x58, /* index: column */
+	MSI_EC_RM_PRESET_VALUES = 0x59, /* index: preset * MSI_EC_PRESET_COLUMNS + column */
+	MSI_EC_RM_PRESET_SILENT_FLAG_BIT = 0x5a,
+
+	MSI_EC_RM_FIELD_MAX
+};
+
+#endif // __MSI_EC_REGMAP__
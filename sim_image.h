@@ -0,0 +1,55 @@
+#ifndef __MSI_EC_SIM_IMAGE__
+#define __MSI_EC_SIM_IMAGE__
+
+#include <linux/kernel.h>
+
+/*
+ * Register image of an MSI Modern 14 B5M on the balanced preset, shared by
+ * the msi-ec-sim module and the userspace simulated EC in tools/shim.
+ */
+
+#define SIM_EC_SIZE 256
+
+static const struct {
+	u8 addr;
+	u8 value;
+} sim_seed[] = {
+	{ 0x2b, 0x90 }, /* micmute led off */
+	{ 0x2c, 0x50 }, /* mute led off */
+	{ 0x2e, 0x02 }, /* webcam on */
+	{ 0x2f, 0x02 }, /* webcam not hard blocked */
+	{ 0x30, 0x03 }, /* lid open, AC connected */
+	{ 0x33, 0x0d },
+	{ 0x68, 0x2d }, /* cpu 45 C */
+	{ 0x80, 0x28 }, /* gpu 40 C */
+	{ 0x89, 0x00 },
+	{ 0x98, 0x00 }, /* cooler boost off */
+	{ 0xbf, 0x10 }, /* fn key left */
+	{ 0xcd, 0x28 },
+	{ 0xd4, 0x00 }, /* fan mode auto */
+	{ 0xd5, 0xa1 },
+	{ 0xed, 0xa1 },
+	{ 0xef, 0xe4 }, /* charge to max */
+	{ 0xf2, 0xc1 }, /* shift mode balanced */
+	{ 0xf3, 0x82 }, /* kbd backlight half */
+	{ 0xf4, 0x00 },
+};
+
+static const char sim_fw_version[] = "14DLEMS1.105";
+static const char sim_fw_date[] = "03302023";
+static const char sim_fw_time[] = "10:05:00";
+
+static inline void sim_image_seed(u8 *regs)
+{
+	int i;
+
+	memset(regs, 0, SIM_EC_SIZE);
+	memcpy(regs + 0xa0, sim_fw_version, sizeof(sim_fw_version) - 1);
+	memcpy(regs + 0xac, sim_fw_date, sizeof(sim_fw_date) - 1);
+	memcpy(regs + 0xb4, sim_fw_time, sizeof(sim_fw_time) - 1);
+
+	for (i = 0; i < ARRAY_SIZE(sim_seed); i++)
+		regs[sim_seed[i].addr] = sim_seed[i].value;
+}
+
+#endif // __MSI_EC_SIM_IMAGE__
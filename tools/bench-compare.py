@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# bench-compare.py - compare two msi-ec-bench/msiec-bench JSON results
+#
+#   bench-compare.py [-t percent] baseline.json candidate.json
+#
+# Results are matched by target, op, EC latency, reader count and number
+# of background threads. A result regresses when its p50 or mean latency
+# grew, or its throughput or transaction count moved the wrong way, by more
+# than the threshold (10% by default). Exits 1 if anything regressed.
+
+import json
+import sys
+
+# metric: True if higher is worse
+METRICS = {
+    "p50_us": True,
+    "mean_us": True,
+    "ops_per_s": False,
+    "ec_reads_per_op": True,
+    "ec_writes_per_op": True,
+}
+
+
+def key(result):
+    return (result["target"], result["op"], result.get("ec_latency_us"),
+            result.get("readers", 1), result.get("background", 0))
+
+
+def load(path):
+    with open(path) as f:
+        return {key(r): r for r in json.load(f)["results"]}
+
+
+def change(old, new, higher_is_worse):
+    if old is None or new is None:
+        return None
+    if old == 0:
+        return 0.0 if new == 0 else float("inf") * (1 if new > 0 else -1)
+    percent = (new - old) * 100.0 / old
+    return percent if higher_is_worse else -percent
+
+
+def main():
+    args = sys.argv[1:]
+    threshold = 10.0
+    if len(args) == 4 and args[0] == "-t":
+        threshold = float(args[1])
+        args = args[2:]
+    if len(args) != 2:
+        sys.exit(f"usage: {sys.argv[0]} [-t percent] baseline.json candidate.json")
+
+    baseline, candidate = load(args[0]), load(args[1])
+    regressions = 0
+
+    for k in sorted(baseline.keys() & candidate.keys(), key=str):
+        old, new = baseline[k], candidate[k]
+        worse = []
+        for metric, higher_is_worse in METRICS.items():
+            delta = change(old.get(metric), new.get(metric), higher_is_worse)
+            if delta is not None and delta > threshold:
+                worse.append(f"{metric} {old[metric]:g} -> {new[metric]:g} "
+                             f"({delta:+.1f}%)")
+        if worse:
+            regressions += 1
+            target, op, latency, readers, background = k
+            print(f"REGRESSION {target} {op} ec_latency_us={latency} "
+                  f"readers={readers} background={background}: "
+                  + ", ".join(worse))
+
+    for k in sorted(baseline.keys() - candidate.keys(), key=str):
+        print(f"missing in candidate: {' '.join(map(str, k))}")
+
+    print(f"{len(baseline.keys() & candidate.keys())} compared, "
+          f"{regressions} regressed beyond {threshold:g}%")
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,469 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi-ec-bench.c - Handler-level benchmark of msi-ec against a simulated EC
+ *
+ * Builds msi-ec.c unmodified on top of tools/shim and times every visible
+ * attribute's show and store handler, every LED class device and a preset
+ * switch (alternating between two presets), under a set of simulated EC
+ * transaction latencies:
+ *
+ *   msi-ec-bench [-n iterations] [-l latency_us,...] [-j jitter_us]
+ *                [-c readers,...] [-b threads] [-f filter] [-J]
+ *
+ * For each operation it reports mean/p50/p99 latency, throughput and the
+ * number of EC reads and writes it issued. With -c every show handler is
+ * also run from that many threads at once, to see how throughput scales.
+ * With -b that many threads keep reading the preset (the most expensive
+ * show) in the background during the whole run, to see how much EC
+ * traffic delays the other handlers.
+ * -J prints the results as JSON in the format tools/bench-compare.py and
+ * msiec-bench share.
+ */
+
+#include "../../msi-ec.c"
+
+#include "shim.h"
+#include "sim_ec.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_ATTRS 64
+#define BENCH_MAX_LEDS 8
+#define BENCH_MAX_LATENCIES 16
+#define BENCH_MAX_READERS 8
+
+enum bench_op {
+	OP_SHOW,
+	OP_STORE,
+	OP_LED_GET,
+	OP_LED_SET,
+	OP_SWITCH,
+};
+
+static const char *const op_names[] = {
+	[OP_SHOW] = "show",
+	[OP_STORE] = "store",
+	[OP_LED_GET] = "get",
+	[OP_LED_SET] = "set",
+	[OP_SWITCH] = "switch",
+};
+
+struct bench_target {
+	const char *label;
+	enum bench_op op;
+	struct shim_attr *attr;
+	struct led_classdev *led;
+	char value[64]; /* written by store/set */
+	const char *const *cycle; /* written in turn by switch */
+	unsigned int next;
+};
+
+struct bench_result {
+	const struct bench_target *target;
+	unsigned int latency_us;
+	int readers;
+	double mean_us, p50_us, p99_us;
+	double ops_per_s;
+	double reads_per_op, writes_per_op;
+	int failures;
+};
+
+static const char *const preset_cycle[] = { "silent\n", "balanced\n", NULL };
+
+static int iterations = 200;
+static int background;
+static bool background_stop;
+static unsigned int jitter_us;
+static const char *filter;
+static bool json;
+static int results_printed;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a;
+	u64 y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static ssize_t run_once(struct bench_target *t)
+{
+	char buf[PAGE_SIZE];
+	const char *value;
+
+	switch (t->op) {
+	case OP_SHOW:
+		return t->attr->dattr->show(t->attr->dev, t->attr->dattr, buf);
+	case OP_STORE:
+		return t->attr->dattr->store(t->attr->dev, t->attr->dattr,
+					     t->value, strlen(t->value));
+	case OP_LED_GET:
+		t->led->brightness_get(t->led);
+		return 0;
+	case OP_LED_SET:
+		return t->led->brightness_set_blocking(t->led, atoi(t->value));
+	case OP_SWITCH:
+		if (!t->cycle[t->next])
+			t->next = 0;
+		value = t->cycle[t->next++];
+		return t->attr->dattr->store(t->attr->dev, t->attr->dattr,
+					     value, strlen(value));
+	}
+
+	return -EINVAL;
+}
+
+static void print_result(const struct bench_result *r)
+{
+	const struct bench_target *t = r->target;
+
+	if (!json) {
+		printf("%8u  %-34s %-6s %3d %3d %10.2f %10.2f %10.2f %12.0f %7.2f %7.2f %6d\n",
+		       r->latency_us, t->label, op_names[t->op], r->readers,
+		       background, r->mean_us, r->p50_us, r->p99_us, r->ops_per_s,
+		       r->reads_per_op, r->writes_per_op, r->failures);
+		return;
+	}
+
+	printf("%s\n    {\"target\": \"%s\", \"op\": \"%s\", \"ec_latency_us\": %u, "
+	       "\"readers\": %d, \"background\": %d, \"mean_us\": %.3f, "
+	       "\"p50_us\": %.3f, "
+	       "\"p99_us\": %.3f, \"ops_per_s\": %.1f, "
+	       "\"ec_reads_per_op\": %.3f, \"ec_writes_per_op\": %.3f, "
+	       "\"errors\": %d}",
+	       results_printed ? "," : "", t->label, op_names[t->op],
+	       r->latency_us, r->readers, background, r->mean_us, r->p50_us,
+	       r->p99_us,
+	       r->ops_per_s, r->reads_per_op, r->writes_per_op, r->failures);
+	results_printed++;
+}
+
+struct bench_reader {
+	pthread_t thread;
+	struct bench_target *target;
+	u64 *samples;
+	int failures;
+};
+
+static void *bench_reader_run(void *arg)
+{
+	struct bench_reader *reader = arg;
+	u64 start;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		start = now_ns();
+		if (run_once(reader->target) < 0)
+			reader->failures++;
+		reader->samples[i] = now_ns() - start;
+	}
+	return NULL;
+}
+
+static void *background_run(void *arg)
+{
+	struct shim_attr *preset = arg;
+	char buf[PAGE_SIZE];
+
+	while (!READ_ONCE(background_stop))
+		preset->dattr->show(preset->dev, preset->dattr, buf);
+	return NULL;
+}
+
+/*
+ * Runs the target from readers threads at once, iterations times each.
+ * Throughput is over the wall time of the whole run.
+ */
+static void bench_target(struct bench_target *t, unsigned int latency_us,
+			 int readers)
+{
+	struct bench_reader threads[BENCH_MAX_READERS];
+	struct sim_ec_stats before, after;
+	struct bench_result r = {
+		.target = t,
+		.latency_us = latency_us,
+		.readers = readers,
+	};
+	int count = iterations * readers;
+	u64 *samples;
+	u64 total = 0;
+	u64 start, wall;
+	int i;
+
+	samples = calloc(count, sizeof(*samples));
+	if (samples == NULL)
+		exit(1);
+
+	sim_ec_get_stats(&before);
+	start = now_ns();
+	for (i = 0; i < readers; i++) {
+		threads[i] = (struct bench_reader){
+			.target = t,
+			.samples = samples + i * iterations,
+		};
+		if (readers == 1)
+			bench_reader_run(&threads[i]);
+		else if (pthread_create(&threads[i].thread, NULL,
+					bench_reader_run, &threads[i]) != 0)
+			exit(1);
+	}
+	for (i = 0; i < readers; i++) {
+		if (readers > 1)
+			pthread_join(threads[i].thread, NULL);
+		r.failures += threads[i].failures;
+	}
+	wall = now_ns() - start;
+	sim_ec_get_stats(&after);
+
+	for (i = 0; i < count; i++)
+		total += samples[i];
+	qsort(samples, count, sizeof(*samples), cmp_u64);
+
+	r.mean_us = total / 1000.0 / count;
+	r.p50_us = samples[count / 2] / 1000.0;
+	r.p99_us = samples[(count * 99) / 100] / 1000.0;
+	r.ops_per_s = wall ? count * 1e9 / wall : 0.0;
+	r.reads_per_op = (double)(after.reads - before.reads) / count;
+	r.writes_per_op = (double)(after.writes - before.writes) / count;
+	print_result(&r);
+
+	free(samples);
+}
+
+// Store handlers are fed back the value the attribute currently shows
+static int collect_targets(struct bench_target *targets, int max,
+			   struct shim_attr *attrs, int attr_count,
+			   struct led_classdev **leds, int led_count)
+{
+	static char labels[BENCH_MAX_ATTRS + BENCH_MAX_LEDS][96];
+	char buf[PAGE_SIZE];
+	int count = 0;
+	ssize_t len;
+	int i;
+
+	for (i = 0; i < attr_count && i < BENCH_MAX_ATTRS; i++) {
+		snprintf(labels[i], sizeof(labels[i]), "%s%s%s",
+			 attrs[i].group ? attrs[i].group : "",
+			 attrs[i].group ? "/" : "", attrs[i].name);
+		if (filter && strstr(labels[i], filter) == NULL)
+			continue;
+
+		if (count < max) {
+			targets[count] = (struct bench_target){
+				.label = labels[i],
+				.op = OP_SHOW,
+				.attr = &attrs[i],
+			};
+			count++;
+		}
+
+		if (!(attrs[i].mode & 0222) || !attrs[i].dattr->store ||
+		    count == max)
+			continue;
+
+		len = attrs[i].dattr->show(attrs[i].dev, attrs[i].dattr, buf);
+		if (len <= 0)
+			continue;
+		buf[strcspn(buf, " \n")] = '\0';
+
+		targets[count] = (struct bench_target){
+			.label = labels[i],
+			.op = OP_STORE,
+			.attr = &attrs[i],
+		};
+		snprintf(targets[count].value, sizeof(targets[count].value),
+			 "%.62s\n", buf);
+		count++;
+
+		if (strcmp(attrs[i].name, "preset") == 0 && count < max) {
+			targets[count] = (struct bench_target){
+				.label = labels[i],
+				.op = OP_SWITCH,
+				.attr = &attrs[i],
+				.cycle = preset_cycle,
+			};
+			count++;
+		}
+	}
+
+	for (i = 0; i < led_count; i++) {
+		char *label = labels[BENCH_MAX_ATTRS + i];
+
+		snprintf(label, sizeof(labels[0]), "leds/%s", leds[i]->name);
+		if (filter && strstr(label, filter) == NULL)
+			continue;
+
+		if (leds[i]->brightness_get && count < max) {
+			targets[count] = (struct bench_target){
+				.label = label,
+				.op = OP_LED_GET,
+				.led = leds[i],
+			};
+			count++;
+		}
+
+		if (leds[i]->brightness_set_blocking && count < max) {
+			targets[count] = (struct bench_target){
+				.label = label,
+				.op = OP_LED_SET,
+				.led = leds[i],
+				.value = "1",
+			};
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static int parse_list(const char *arg, unsigned int *values, int max)
+{
+	char *copy = strdup(arg);
+	char *save = NULL;
+	char *tok;
+	int count = 0;
+
+	for (tok = strtok_r(copy, ",", &save);
+	     tok && count < max;
+	     tok = strtok_r(NULL, ",", &save))
+		values[count++] = strtoul(tok, NULL, 10);
+
+	free(copy);
+	return count;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n iterations] [-l latency_us,...] [-j jitter_us]\n"
+		"          [-c readers,...] [-b threads] [-f filter] [-J]\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	static struct shim_attr attrs[BENCH_MAX_ATTRS];
+	static struct bench_target targets[2 * (BENCH_MAX_ATTRS + BENCH_MAX_LEDS)];
+	struct led_classdev *leds[BENCH_MAX_LEDS];
+	pthread_t background_threads[BENCH_MAX_READERS];
+	struct shim_attr *preset;
+	unsigned int latencies[BENCH_MAX_LATENCIES] = { 0, 50, 200 };
+	unsigned int readers[BENCH_MAX_LATENCIES];
+	int latency_count = 3;
+	int reader_count = 0;
+	int attr_count, led_count, target_count;
+	int opt;
+	int i, l, c;
+
+	while ((opt = getopt(argc, argv, "n:l:j:c:b:f:Jh")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'l':
+			latency_count = parse_list(optarg, latencies,
+						   BENCH_MAX_LATENCIES);
+			break;
+		case 'c':
+			reader_count = parse_list(optarg, readers,
+						  BENCH_MAX_LATENCIES);
+			break;
+		case 'b':
+			background = atoi(optarg);
+			break;
+		case 'J':
+			json = true;
+			break;
+		case 'j':
+			jitter_us = strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (iterations <= 0 || latency_count == 0 || background < 0 ||
+	    background > BENCH_MAX_READERS)
+		usage(argv[0]);
+	for (c = 0; c < reader_count; c++)
+		if (readers[c] < 1 || readers[c] > BENCH_MAX_READERS)
+			usage(argv[0]);
+
+	sim_ec_reset();
+	if (shim_module_init() < 0) {
+		fprintf(stderr, "msi-ec failed to initialise\n");
+		return 1;
+	}
+
+	// Let deferred probe work finish so it does not skew the first target
+	shim_flush_workqueue();
+
+	attr_count = shim_attrs(attrs, BENCH_MAX_ATTRS);
+	if (attr_count == 0) {
+		fprintf(stderr, "msi-ec did not bind to the simulated EC\n");
+		shim_module_exit();
+		return 1;
+	}
+	led_count = shim_leds(leds, BENCH_MAX_LEDS);
+	target_count = collect_targets(targets, ARRAY_SIZE(targets), attrs,
+				       attr_count, leds, led_count);
+
+	preset = shim_attr_find(attrs, attr_count, NULL, "preset");
+	if (background && !preset) {
+		fprintf(stderr, "no preset attribute to read in the background\n");
+		shim_module_exit();
+		return 1;
+	}
+	// Let the threads interleave, as they would sleeping on the EC
+	sim_ec_set_yield(background > 0);
+	for (i = 0; i < background; i++)
+		if (pthread_create(&background_threads[i], NULL, background_run,
+				   preset) != 0)
+			exit(1);
+
+	if (json)
+		printf("{\"tool\": \"msi-ec-bench\", \"backend\": \"sim\", "
+		       "\"iterations\": %d, \"results\": [", iterations);
+	else
+		printf("%8s  %-34s %-6s %3s %3s %10s %10s %10s %12s %7s %7s %6s\n",
+		       "ec_us", "attribute", "op", "thr", "bg", "mean_us", "p50_us",
+		       "p99_us", "ops/s", "rd/op", "wr/op", "errors");
+
+	for (l = 0; l < latency_count; l++) {
+		sim_ec_set_latency(latencies[l] * 1000, jitter_us * 1000);
+		for (i = 0; i < target_count; i++)
+			bench_target(&targets[i], latencies[l], 1);
+
+		sim_ec_set_yield(TRUE);
+		for (c = 0; c < reader_count; c++)
+			for (i = 0; i < target_count; i++)
+				if (targets[i].op == OP_SHOW && readers[c] > 1)
+					bench_target(&targets[i], latencies[l],
+						     readers[c]);
+		sim_ec_set_yield(background > 0);
+	}
+
+	if (json)
+		printf("\n]}\n");
+
+	WRITE_ONCE(background_stop, TRUE);
+	for (i = 0; i < background; i++)
+		pthread_join(background_threads[i], NULL);
+
+	shim_module_exit();
+	return 0;
+}
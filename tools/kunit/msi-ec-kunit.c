@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi-ec-kunit.c - Runs the msi-ec KUnit suite in userspace on tools/shim
+ */
+
+#define CONFIG_MSI_EC_KUNIT_TEST 1
+
+#include "../../msi-ec.c"
+
+int main(void)
+{
+	return kunit_run_all() ? 1 : 0;
+}
@@ -0,0 +1,378 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msiec.c - Client library for the msi-ec sysfs interface
+ */
+
+#include "msiec.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Value names in the driver's index order
+static const char *const preset_names[] = {
+	"super_battery", "silent", "balanced", "high_performance", "custom", NULL
+};
+static const char *const switch_names[] = { "off", "on", NULL };
+static const char *const key_side_names[] = { "right", "left", NULL };
+static const char *const charge_names[] = { "max", "medium", "min", NULL };
+static const char *const shift_names[] = {
+	"overclock", "balanced", "eco", "off", NULL
+};
+static const char *const fan_names[] = {
+	"auto", "silent", "basic", "advanced", NULL
+};
+
+struct msiec_attr_info {
+	const char *name;
+	const char *path; /* relative to the sysfs root */
+	enum msiec_type type;
+	bool writable;
+	bool notifies; /* the driver calls sysfs_notify() on it */
+	const char *const *values; /* MSIEC_TYPE_ENUM only */
+};
+
+static const struct msiec_attr_info attr_info[MSIEC_ATTR_COUNT] = {
+	[MSIEC_PRESET] = { "preset", "preset", MSIEC_TYPE_ENUM, true, false,
+			   preset_names },
+	[MSIEC_WEBCAM] = { "webcam", "webcam", MSIEC_TYPE_ENUM, true, true,
+			   switch_names },
+	[MSIEC_WEBCAM_HARD_BLOCK] = { "webcam_hard_block", "webcam_hard_block",
+				      MSIEC_TYPE_INT, false, true },
+	[MSIEC_FN_KEY] = { "fn_key", "fn_key", MSIEC_TYPE_ENUM, true, false,
+			   key_side_names },
+	[MSIEC_WIN_KEY] = { "win_key", "win_key", MSIEC_TYPE_ENUM, true, false,
+			    key_side_names },
+	[MSIEC_BATTERY_CHARGE_MODE] = { "battery_charge_mode",
+					"battery_charge_mode", MSIEC_TYPE_ENUM,
+					true, false, charge_names },
+	[MSIEC_COOLER_BOOST] = { "cooler_boost", "cooler_boost",
+				 MSIEC_TYPE_ENUM, true, false, switch_names },
+	[MSIEC_SHIFT_MODE] = { "shift_mode", "shift_mode", MSIEC_TYPE_ENUM,
+			       true, false, shift_names },
+	[MSIEC_FAN_MODE] = { "fan_mode", "fan_mode", MSIEC_TYPE_ENUM, true,
+			     false, fan_names },
+	[MSIEC_FW_VERSION] = { "fw_version", "fw_version", MSIEC_TYPE_STRING },
+	[MSIEC_FW_RELEASE_DATE] = { "fw_release_date", "fw_release_date",
+				    MSIEC_TYPE_STRING },
+	[MSIEC_AC_CONNECTED] = { "ac_connected", "ac_connected",
+				 MSIEC_TYPE_INT, false, true },
+	[MSIEC_LID_OPEN] = { "lid_open", "lid_open", MSIEC_TYPE_INT, false,
+			     true },
+	[MSIEC_CPU_TEMPERATURE] = { "cpu_temperature",
+				    "cpu/realtime_temperature",
+				    MSIEC_TYPE_INT },
+	[MSIEC_CPU_FAN_SPEED] = { "cpu_fan_speed", "cpu/realtime_fan_speed",
+				  MSIEC_TYPE_INT },
+	[MSIEC_GPU_TEMPERATURE] = { "gpu_temperature",
+				    "gpu/realtime_temperature",
+				    MSIEC_TYPE_INT },
+	[MSIEC_GPU_FAN_SPEED] = { "gpu_fan_speed", "gpu/realtime_fan_speed",
+				  MSIEC_TYPE_INT },
+	[MSIEC_KBD_BACKLIGHT] = { "kbd_backlight",
+				  "leds/msiacpi::kbd_backlight/brightness",
+				  MSIEC_TYPE_INT, true, false },
+	[MSIEC_KBD_BACKLIGHT_HW_CHANGED] = {
+		"kbd_backlight_hw_changed",
+		"leds/msiacpi::kbd_backlight/brightness_hw_changed",
+		MSIEC_TYPE_INT, false, true },
+};
+
+struct msiec {
+	int fds[MSIEC_ATTR_COUNT];
+};
+
+static void msiec_arm(int fd)
+{
+	char buf[MSIEC_STRING_LEN];
+
+	// Only the read matters, not the value
+	if (pread(fd, buf, sizeof(buf), 0) < 0)
+		return;
+}
+
+// ============================================================ //
+// Attribute descriptions
+// ============================================================ //
+
+const char *msiec_attr_name(enum msiec_attr attr)
+{
+	return attr < MSIEC_ATTR_COUNT ? attr_info[attr].name : NULL;
+}
+
+int msiec_attr_find(const char *name)
+{
+	int i;
+
+	if (!name)
+		return -1;
+
+	for (i = 0; i < MSIEC_ATTR_COUNT; i++)
+		if (strcmp(attr_info[i].name, name) == 0)
+			return i;
+	return -1;
+}
+
+enum msiec_type msiec_attr_type(enum msiec_attr attr)
+{
+	return attr_info[attr].type;
+}
+
+bool msiec_attr_writable(enum msiec_attr attr)
+{
+	return attr_info[attr].writable;
+}
+
+bool msiec_attr_notifies(enum msiec_attr attr)
+{
+	return attr_info[attr].notifies;
+}
+
+const char *msiec_value_name(enum msiec_attr attr, int value)
+{
+	const char *const *values = attr_info[attr].values;
+	int i;
+
+	if (!values || value < 0)
+		return NULL;
+	for (i = 0; values[i]; i++)
+		if (i == value)
+			return values[i];
+	return NULL;
+}
+
+// Accepts a name, or an index the way the driver does
+int msiec_value_parse(enum msiec_attr attr, const char *name)
+{
+	const char *const *values = attr_info[attr].values;
+	char *end;
+	long index;
+	int i;
+
+	if (attr_info[attr].type == MSIEC_TYPE_STRING)
+		return MSIEC_VALUE_UNKNOWN;
+
+	if (values)
+		for (i = 0; values[i]; i++)
+			if (strcmp(values[i], name) == 0)
+				return i;
+
+	if (*name < '0' || *name > '9')
+		return MSIEC_VALUE_UNKNOWN;
+	index = strtol(name, &end, 10);
+	if (*end || index > 0xffff)
+		return MSIEC_VALUE_UNKNOWN;
+	if (values && !msiec_value_name(attr, index))
+		return MSIEC_VALUE_UNKNOWN;
+	return index;
+}
+
+// ============================================================ //
+// Handles
+// ============================================================ //
+
+struct msiec *msiec_open(const char *root)
+{
+	struct msiec *ec;
+	char path[512];
+	int found = 0;
+	int i;
+
+	if (!root)
+		root = MSIEC_DEFAULT_ROOT;
+
+	ec = malloc(sizeof(*ec));
+	if (!ec)
+		return NULL;
+
+	for (i = 0; i < MSIEC_ATTR_COUNT; i++) {
+		snprintf(path, sizeof(path), "%s/%s", root, attr_info[i].path);
+		ec->fds[i] = open(path, (attr_info[i].writable ? O_RDWR :
+				  O_RDONLY) | O_CLOEXEC);
+		// Not every model implements every attribute
+		if (ec->fds[i] < 0)
+			continue;
+		found++;
+
+		// sysfs only reports notifications that come after a read
+		if (attr_info[i].notifies)
+			msiec_arm(ec->fds[i]);
+	}
+
+	if (!found) {
+		free(ec);
+		errno = ENODEV;
+		return NULL;
+	}
+
+	return ec;
+}
+
+void msiec_close(struct msiec *ec)
+{
+	int i;
+
+	if (!ec)
+		return;
+	for (i = 0; i < MSIEC_ATTR_COUNT; i++)
+		if (ec->fds[i] >= 0)
+			close(ec->fds[i]);
+	free(ec);
+}
+
+bool msiec_has(const struct msiec *ec, enum msiec_attr attr)
+{
+	return attr < MSIEC_ATTR_COUNT && ec->fds[attr] >= 0;
+}
+
+int msiec_fd(const struct msiec *ec, enum msiec_attr attr)
+{
+	return msiec_has(ec, attr) ? ec->fds[attr] : -1;
+}
+
+// ============================================================ //
+// Reading and writing
+// ============================================================ //
+
+// The value without the trailing newline
+int msiec_read_string(struct msiec *ec, enum msiec_attr attr, char *buf,
+		      size_t size)
+{
+	ssize_t len;
+
+	if (!msiec_has(ec, attr))
+		return -ENOENT;
+
+	len = pread(ec->fds[attr], buf, size - 1, 0);
+	if (len < 0)
+		return -errno;
+
+	while (len > 0 && buf[len - 1] == '\n')
+		len--;
+	buf[len] = '\0';
+	return 0;
+}
+
+int msiec_read(struct msiec *ec, enum msiec_attr attr, int *value)
+{
+	char buf[MSIEC_STRING_LEN];
+	int result;
+
+	if (attr_info[attr].type == MSIEC_TYPE_STRING)
+		return -EINVAL;
+
+	result = msiec_read_string(ec, attr, buf, sizeof(buf));
+	if (result < 0)
+		return result;
+
+	*value = msiec_value_parse(attr, buf);
+	return 0;
+}
+
+int msiec_write_string(struct msiec *ec, enum msiec_attr attr,
+		       const char *value)
+{
+	if (!msiec_has(ec, attr))
+		return -ENOENT;
+	if (!attr_info[attr].writable)
+		return -EACCES;
+	if (pwrite(ec->fds[attr], value, strlen(value), 0) < 0)
+		return -errno;
+	return 0;
+}
+
+int msiec_write(struct msiec *ec, enum msiec_attr attr, int value)
+{
+	char buf[16];
+	const char *name;
+
+	if (attr_info[attr].type == MSIEC_TYPE_ENUM) {
+		name = msiec_value_name(attr, value);
+		if (!name)
+			return -EINVAL;
+		return msiec_write_string(ec, attr, name);
+	}
+	if (attr_info[attr].type != MSIEC_TYPE_INT)
+		return -EINVAL;
+
+	snprintf(buf, sizeof(buf), "%d", value);
+	return msiec_write_string(ec, attr, buf);
+}
+
+int msiec_snapshot(struct msiec *ec, struct msiec_snapshot *snapshot)
+{
+	int i;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+
+	for (i = 0; i < MSIEC_ATTR_COUNT; i++) {
+		int result;
+
+		snapshot->values[i] = MSIEC_VALUE_UNKNOWN;
+		if (!msiec_has(ec, i))
+			continue;
+
+		if (i == MSIEC_FW_VERSION)
+			result = msiec_read_string(ec, i, snapshot->fw_version,
+						   sizeof(snapshot->fw_version));
+		else if (i == MSIEC_FW_RELEASE_DATE)
+			result = msiec_read_string(ec, i,
+						   snapshot->fw_release_date,
+						   sizeof(snapshot->fw_release_date));
+		else
+			result = msiec_read(ec, i, &snapshot->values[i]);
+
+		if (result == 0)
+			snapshot->valid |= MSIEC_BIT(i);
+	}
+
+	return snapshot->valid ? 0 : -EIO;
+}
+
+// ============================================================ //
+// Change notifications
+// ============================================================ //
+
+/*
+ * Notifications are re-armed by any read of the attribute, so one that
+ * arrives between two calls is reported by the next call unless the
+ * attribute was read in between.
+ */
+int msiec_wait(struct msiec *ec, unsigned int mask, int timeout_ms)
+{
+	struct pollfd fds[MSIEC_ATTR_COUNT];
+	enum msiec_attr attrs[MSIEC_ATTR_COUNT];
+	unsigned int changed = 0;
+	int count = 0;
+	int i, result;
+
+	for (i = 0; i < MSIEC_ATTR_COUNT; i++) {
+		if (!(mask & MSIEC_BIT(i)) || !attr_info[i].notifies ||
+		    !msiec_has(ec, i))
+			continue;
+
+		fds[count].fd = ec->fds[i];
+		fds[count].events = POLLPRI;
+		attrs[count++] = i;
+	}
+	if (!count)
+		return -EINVAL;
+
+	result = poll(fds, count, timeout_ms);
+	if (result < 0)
+		return -errno;
+
+	for (i = 0; i < count; i++) {
+		if (!(fds[i].revents & (POLLPRI | POLLERR)))
+			continue;
+		changed |= MSIEC_BIT(attrs[i]);
+		msiec_arm(fds[i].fd);
+	}
+
+	return changed;
+}
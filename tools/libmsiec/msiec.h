@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+ * msiec.h - Client library for the msi-ec sysfs interface
+ *
+ * msiec_open() opens every attribute the driver exposes once; reads are a
+ * pread() on the open descriptor. Multiple-choice attributes are parsed
+ * into the enums below, whose order matches the driver's value indexes,
+ * and numeric attributes into plain integers. Values the driver reports
+ * but the library does not know (e.g. "unknown (3)") read as
+ * MSIEC_VALUE_UNKNOWN.
+ *
+ * A handle is not thread safe.
+ */
+
+#ifndef __MSIEC_H__
+#define __MSIEC_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSIEC_DEFAULT_ROOT "/sys/devices/platform/msi-ec"
+
+#define MSIEC_VALUE_UNKNOWN -1
+#define MSIEC_STRING_LEN 64
+
+enum msiec_attr {
+	MSIEC_PRESET,
+	MSIEC_WEBCAM,
+	MSIEC_WEBCAM_HARD_BLOCK,
+	MSIEC_FN_KEY,
+	MSIEC_WIN_KEY,
+	MSIEC_BATTERY_CHARGE_MODE,
+	MSIEC_COOLER_BOOST,
+	MSIEC_SHIFT_MODE,
+	MSIEC_FAN_MODE,
+	MSIEC_FW_VERSION,
+	MSIEC_FW_RELEASE_DATE,
+	MSIEC_AC_CONNECTED,
+	MSIEC_LID_OPEN,
+	MSIEC_CPU_TEMPERATURE,
+	MSIEC_CPU_FAN_SPEED,
+	MSIEC_GPU_TEMPERATURE,
+	MSIEC_GPU_FAN_SPEED,
+	MSIEC_KBD_BACKLIGHT,
+	MSIEC_KBD_BACKLIGHT_HW_CHANGED,
+	MSIEC_ATTR_COUNT,
+};
+
+#define MSIEC_BIT(attr) (1u << (attr))
+
+enum msiec_preset {
+	MSIEC_PRESET_SUPER_BATTERY,
+	MSIEC_PRESET_SILENT,
+	MSIEC_PRESET_BALANCED,
+	MSIEC_PRESET_HIGH_PERFORMANCE,
+	MSIEC_PRESET_CUSTOM, /* read only, no preset matches */
+};
+
+enum msiec_switch {
+	MSIEC_OFF,
+	MSIEC_ON,
+};
+
+enum msiec_key_side {
+	MSIEC_KEY_RIGHT,
+	MSIEC_KEY_LEFT,
+};
+
+enum msiec_battery_charge_mode {
+	MSIEC_CHARGE_MAX,
+	MSIEC_CHARGE_MEDIUM,
+	MSIEC_CHARGE_MIN,
+};
+
+enum msiec_shift_mode {
+	MSIEC_SHIFT_OVERCLOCK,
+	MSIEC_SHIFT_BALANCED,
+	MSIEC_SHIFT_ECO,
+	MSIEC_SHIFT_OFF,
+};
+
+enum msiec_fan_mode {
+	MSIEC_FAN_AUTO,
+	MSIEC_FAN_SILENT,
+	MSIEC_FAN_BASIC,
+	MSIEC_FAN_ADVANCED,
+};
+
+enum msiec_type {
+	MSIEC_TYPE_ENUM, /* one of msiec_value_name() */
+	MSIEC_TYPE_INT,
+	MSIEC_TYPE_STRING, /* only readable as a string */
+};
+
+/* Every attribute that was readable, from one pass over the driver */
+struct msiec_snapshot {
+	unsigned int valid; /* MSIEC_BIT() of the attributes below */
+	int values[MSIEC_ATTR_COUNT];
+	char fw_version[MSIEC_STRING_LEN];
+	char fw_release_date[MSIEC_STRING_LEN];
+};
+
+struct msiec;
+
+/* Describing attributes, no handle needed */
+const char *msiec_attr_name(enum msiec_attr attr);
+int msiec_attr_find(const char *name); /* -1 if unknown or NULL */
+enum msiec_type msiec_attr_type(enum msiec_attr attr);
+bool msiec_attr_writable(enum msiec_attr attr);
+bool msiec_attr_notifies(enum msiec_attr attr); /* wakes up msiec_wait() */
+const char *msiec_value_name(enum msiec_attr attr, int value);
+int msiec_value_parse(enum msiec_attr attr, const char *name);
+
+/* NULL root means MSIEC_DEFAULT_ROOT. Returns NULL with errno set. */
+struct msiec *msiec_open(const char *root);
+void msiec_close(struct msiec *ec);
+
+/* Whether the model has the attribute, and its descriptor for poll() */
+bool msiec_has(const struct msiec *ec, enum msiec_attr attr);
+int msiec_fd(const struct msiec *ec, enum msiec_attr attr);
+
+/* All return 0 or a negative errno */
+int msiec_read(struct msiec *ec, enum msiec_attr attr, int *value);
+int msiec_read_string(struct msiec *ec, enum msiec_attr attr, char *buf,
+		      size_t size);
+int msiec_write(struct msiec *ec, enum msiec_attr attr, int value);
+int msiec_write_string(struct msiec *ec, enum msiec_attr attr,
+		       const char *value);
+int msiec_snapshot(struct msiec *ec, struct msiec_snapshot *snapshot);
+
+/*
+ * Blocks until one of the attributes in mask (MSIEC_BIT()s of notifying
+ * attributes) changes, or for timeout_ms (-1 waits forever). Returns the
+ * mask of changed attributes, 0 on timeout or a negative errno.
+ */
+int msiec_wait(struct msiec *ec, unsigned int mask, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __MSIEC_H__
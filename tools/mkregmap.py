@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# mkregmap.py - build an msi-ec register map (see regmap.h)
+#
+# Input is one override per line, '#' starts a comment:
+#
+#   shift_mode.address = 0xd2
+#   fan_mode.basic_bit = unsupported
+#   preset.values[1][2] = 0xc1
+#
+# Install the output as /lib/firmware/msi-ec/<fw_version>.bin
+
+import re
+import struct
+import sys
+import zlib
+
+MAGIC = b"MSEC"
+VERSION = 1
+MAX_ENTRIES = 256
+PRESET_COLUMNS = 6
+
+ADDR, BIT, VALUE = range(3)
+UNSUPP = {ADDR: 0xFF01, BIT: 0xFFFF}
+
+# name: (field id, element count, kind); must match regmap.h
+FIELDS = {
+    "webcam.address": (0x01, 1, ADDR),
+    "webcam.bit": (0x02, 1, BIT),
+    "webcam.hard_address": (0x03, 1, ADDR),
+    "webcam.hard_bit": (0x04, 1, BIT),
+    "fn_win.address": (0x08, 1, ADDR),
+    "fn_win.bit": (0x09, 1, BIT),
+    "fn_win.fn_left": (0x0A, 1, VALUE),
+    "fn_win.win_left": (0x0B, 1, VALUE),
+    "charge_control.address": (0x10, 1, ADDR),
+    "charge_control.max": (0x11, 1, VALUE),
+    "charge_control.medium": (0x12, 1, VALUE),
+    "charge_control.min": (0x13, 1, VALUE),
+    "cooler_boost.address": (0x18, 1, ADDR),
+    "cooler_boost.bit": (0x19, 1, BIT),
+    "shift_mode.address": (0x20, 1, ADDR),
+    "shift_mode.overclock": (0x21, 1, VALUE),
+    "shift_mode.balanced": (0x22, 1, VALUE),
+    "shift_mode.eco": (0x23, 1, VALUE),
+    "shift_mode.off": (0x24, 1, VALUE),
+    "fan_mode.address": (0x28, 1, ADDR),
+    "fan_mode.silent_bit": (0x29, 1, BIT),
+    "fan_mode.basic_bit": (0x2A, 1, BIT),
+    "fan_mode.advanced_bit": (0x2B, 1, BIT),
+    "cpu.rt_temp_address": (0x30, 1, ADDR),
+    "cpu.rt_fan_speed_address": (0x31, 1, ADDR),
+    "cpu.rt_fan_speed_base_min": (0x32, 1, VALUE),
+    "cpu.rt_fan_speed_base_max": (0x33, 1, VALUE),
+    "gpu.rt_temp_address": (0x38, 1, ADDR),
+    "gpu.rt_fan_speed_address": (0x39, 1, ADDR),
+    "power.address": (0x40, 1, ADDR),
+    "power.lid_open_bit": (0x41, 1, BIT),
+    "power.ac_connected_bit": (0x42, 1, BIT),
+    "leds.micmute_address": (0x48, 1, ADDR),
+    "leds.micmute_on": (0x49, 1, VALUE),
+    "leds.micmute_off": (0x4A, 1, VALUE),
+    "leds.mute_address": (0x4B, 1, ADDR),
+    "leds.mute_on": (0x4C, 1, VALUE),
+    "leds.mute_off": (0x4D, 1, VALUE),
+    "kbd_bl.address": (0x50, 1, ADDR),
+    "kbd_bl.state_mask": (0x51, 1, VALUE),
+    "kbd_bl.states": (0x52, 4, VALUE),
+    "preset.addresses": (0x58, PRESET_COLUMNS, ADDR),
+    "preset.values": (0x59, 4 * PRESET_COLUMNS, VALUE),
+    "preset.silent_flag_bit": (0x5A, 1, BIT),
+}
+
+LINE = re.compile(r"^([a-z_.]+)((?:\[\d+\])*)\s*=\s*(\S+)$")
+
+
+def parse_line(lineno, line):
+    m = LINE.match(line)
+    if not m:
+        raise ValueError(f"line {lineno}: expected 'field[index] = value'")
+
+    name, subscripts, raw = m.groups()
+    if name not in FIELDS:
+        raise ValueError(f"line {lineno}: unknown field '{name}'")
+    field, count, kind = FIELDS[name]
+
+    indices = [int(i) for i in re.findall(r"\d+", subscripts)]
+    if name == "preset.values" and len(indices) == 2:
+        index = indices[0] * PRESET_COLUMNS + indices[1]
+    elif len(indices) <= 1:
+        index = indices[0] if indices else 0
+    else:
+        raise ValueError(f"line {lineno}: too many subscripts")
+    if index >= count:
+        raise ValueError(f"line {lineno}: index out of range")
+
+    if raw == "unsupported":
+        if kind not in UNSUPP:
+            raise ValueError(f"line {lineno}: '{name}' cannot be unsupported")
+        value = UNSUPP[kind]
+    else:
+        value = int(raw, 0)
+        if not 0 <= value <= (7 if kind == BIT else 0xFF):
+            raise ValueError(f"line {lineno}: value out of range")
+
+    return struct.pack("<BBH", field, index, value)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(f"usage: {sys.argv[0]} <input.txt> <output.bin>")
+
+    entries = []
+    with open(sys.argv[1]) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip()
+            if line:
+                entries.append(parse_line(lineno, line))
+
+    if len(entries) > MAX_ENTRIES:
+        sys.exit(f"too many entries ({len(entries)} > {MAX_ENTRIES})")
+
+    body = b"".join(entries)
+    header = MAGIC + struct.pack("<BBHI", VERSION, 0, len(entries),
+                                 zlib.crc32(body))
+    with open(sys.argv[2], "wb") as f:
+        f.write(header + body)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except ValueError as e:
+        sys.exit(str(e))
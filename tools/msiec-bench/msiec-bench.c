@@ -0,0 +1,343 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msiec-bench.c - Benchmark of the msi-ec sysfs interface
+ *
+ *   msiec-bench [-r sysfs_root] [-n iterations] [-c readers,...] [-w] [-p]
+ *               [-f filter] [-J]
+ *
+ * Times reads of every attribute through libmsiec against the loaded
+ * driver, whether it talks to the real EC or to msi-ec-sim. -w also times
+ * writes (each attribute is written its current value), -p a preset switch
+ * (alternating between silent and balanced, the original preset is put back
+ * afterwards) and -c reads from that many threads at once.
+ *
+ * When msi-ec-sim is loaded its transaction counters in debugfs give the
+ * EC reads and writes per operation, and its latency parameter is
+ * reported; otherwise both are null in the JSON output (-J), which has the
+ * same format as msi-ec-bench's and can be compared with
+ * tools/bench-compare.py.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <msiec.h>
+
+#define BENCH_SIM_DEBUGFS "/sys/kernel/debug/msi-ec-sim"
+#define BENCH_SIM_LATENCY "/sys/module/msi_ec_sim/parameters/latency_us"
+#define BENCH_MAX_READERS 64
+#define BENCH_MAX_LISTS 16
+
+enum bench_op {
+	OP_READ,
+	OP_WRITE,
+	OP_SWITCH,
+};
+
+static const char *const op_names[] = {
+	[OP_READ] = "read",
+	[OP_WRITE] = "write",
+	[OP_SWITCH] = "switch",
+};
+
+struct bench_reader {
+	pthread_t thread;
+	struct msiec *ec;
+	enum msiec_attr attr;
+	enum bench_op op;
+	const char *value;
+	uint64_t *samples;
+	int failures;
+};
+
+static const char *root = MSIEC_DEFAULT_ROOT;
+static int iterations = 200;
+static bool json;
+static int results_printed;
+static long ec_latency_us = -1;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// A number from a sysfs or debugfs file, -1 if it cannot be read
+static long long read_number(const char *path)
+{
+	long long value = -1;
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+		return -1;
+	if (fscanf(f, "%lld", &value) != 1)
+		value = -1;
+	fclose(f);
+	return value;
+}
+
+static void sim_stats(long long *reads, long long *writes)
+{
+	*reads = read_number(BENCH_SIM_DEBUGFS "/reads");
+	*writes = read_number(BENCH_SIM_DEBUGFS "/writes");
+}
+
+static void *bench_reader_run(void *arg)
+{
+	static const char *const cycle[] = { "silent", "balanced" };
+	struct bench_reader *reader = arg;
+	char buf[MSIEC_STRING_LEN];
+	uint64_t start;
+	int i, result;
+
+	for (i = 0; i < iterations; i++) {
+		start = now_ns();
+		if (reader->op == OP_READ)
+			result = msiec_read_string(reader->ec, reader->attr,
+						   buf, sizeof(buf));
+		else if (reader->op == OP_WRITE)
+			result = msiec_write_string(reader->ec, reader->attr,
+						    reader->value);
+		else
+			result = msiec_write_string(reader->ec, reader->attr,
+						    cycle[i & 1]);
+		reader->samples[i] = now_ns() - start;
+		if (result < 0)
+			reader->failures++;
+	}
+	return NULL;
+}
+
+static void print_count(const char *name, long long before, long long after,
+			int count)
+{
+	if (!json) {
+		if (before < 0 || after < 0)
+			printf(" %7s", "-");
+		else
+			printf(" %7.2f", (double)(after - before) / count);
+		return;
+	}
+
+	if (before < 0 || after < 0)
+		printf(", \"%s\": null", name);
+	else
+		printf(", \"%s\": %.3f", name, (double)(after - before) / count);
+}
+
+/*
+ * Each thread gets its own handle, as handles are not shared between
+ * threads. Throughput is over the wall time of the whole run.
+ */
+static int bench(enum msiec_attr attr, enum bench_op op, const char *value,
+		 int readers)
+{
+	struct bench_reader threads[BENCH_MAX_READERS];
+	long long reads[2], writes[2];
+	int count = iterations * readers;
+	uint64_t *samples;
+	uint64_t total = 0, start, wall;
+	int failures = 0;
+	int i, created = 0;
+
+	samples = calloc(count, sizeof(*samples));
+	if (!samples)
+		return -ENOMEM;
+
+	for (i = 0; i < readers; i++) {
+		threads[i] = (struct bench_reader){
+			.ec = msiec_open(root),
+			.attr = attr,
+			.op = op,
+			.value = value,
+			.samples = samples + i * iterations,
+		};
+		if (!threads[i].ec)
+			goto out;
+		created++;
+	}
+
+	sim_stats(&reads[0], &writes[0]);
+	start = now_ns();
+	for (i = 0; i < readers; i++)
+		if (readers == 1)
+			bench_reader_run(&threads[i]);
+		else if (pthread_create(&threads[i].thread, NULL,
+					bench_reader_run, &threads[i]) != 0)
+			exit(1);
+	for (i = 0; i < readers; i++) {
+		if (readers > 1)
+			pthread_join(threads[i].thread, NULL);
+		failures += threads[i].failures;
+	}
+	wall = now_ns() - start;
+	sim_stats(&reads[1], &writes[1]);
+
+	for (i = 0; i < count; i++)
+		total += samples[i];
+	qsort(samples, count, sizeof(*samples), cmp_u64);
+
+	if (json) {
+		printf("%s\n    {\"target\": \"%s\", \"op\": \"%s\", ",
+		       results_printed++ ? "," : "", msiec_attr_name(attr),
+		       op_names[op]);
+		if (ec_latency_us < 0)
+			printf("\"ec_latency_us\": null, ");
+		else
+			printf("\"ec_latency_us\": %ld, ", ec_latency_us);
+		printf("\"readers\": %d, \"mean_us\": %.3f, \"p50_us\": %.3f, "
+		       "\"p99_us\": %.3f, \"ops_per_s\": %.1f",
+		       readers, total / 1000.0 / count,
+		       samples[count / 2] / 1000.0,
+		       samples[(count * 99) / 100] / 1000.0,
+		       wall ? count * 1e9 / wall : 0.0);
+		print_count("ec_reads_per_op", reads[0], reads[1], count);
+		print_count("ec_writes_per_op", writes[0], writes[1], count);
+		printf(", \"errors\": %d}", failures);
+	} else {
+		printf("%-26s %-6s %3d %10.2f %10.2f %10.2f %12.0f",
+		       msiec_attr_name(attr), op_names[op], readers,
+		       total / 1000.0 / count, samples[count / 2] / 1000.0,
+		       samples[(count * 99) / 100] / 1000.0,
+		       wall ? count * 1e9 / wall : 0.0);
+		print_count("ec_reads_per_op", reads[0], reads[1], count);
+		print_count("ec_writes_per_op", writes[0], writes[1], count);
+		printf(" %6d\n", failures);
+	}
+
+out:
+	for (i = 0; i < created; i++)
+		msiec_close(threads[i].ec);
+	free(samples);
+	return created == readers ? 0 : -errno;
+}
+
+static int parse_list(const char *arg, unsigned int *values, int max)
+{
+	char *copy = strdup(arg);
+	char *save = NULL;
+	char *tok;
+	int count = 0;
+
+	for (tok = strtok_r(copy, ",", &save); tok && count < max;
+	     tok = strtok_r(NULL, ",", &save))
+		values[count++] = strtoul(tok, NULL, 10);
+
+	free(copy);
+	return count;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-r sysfs_root] [-n iterations] [-c readers,...] [-w] [-p]\n"
+		"          [-f filter] [-J]\n", argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int readers[BENCH_MAX_LISTS];
+	char current[MSIEC_STRING_LEN];
+	const char *filter = NULL;
+	bool writes = false, presets = false;
+	int reader_count = 0;
+	struct msiec *ec;
+	int opt, a, c;
+
+	while ((opt = getopt(argc, argv, "r:n:c:wpf:J")) != -1) {
+		switch (opt) {
+		case 'r':
+			root = optarg;
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'c':
+			reader_count = parse_list(optarg, readers, BENCH_MAX_LISTS);
+			break;
+		case 'w':
+			writes = true;
+			break;
+		case 'p':
+			presets = true;
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 'J':
+			json = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (iterations <= 0)
+		usage(argv[0]);
+	for (c = 0; c < reader_count; c++)
+		if (readers[c] < 1 || readers[c] > BENCH_MAX_READERS)
+			usage(argv[0]);
+
+	ec = msiec_open(root);
+	if (!ec) {
+		fprintf(stderr, "msiec-bench: no msi-ec attributes under %s\n",
+			root);
+		return 1;
+	}
+	ec_latency_us = read_number(BENCH_SIM_LATENCY);
+
+	if (json)
+		printf("{\"tool\": \"msiec-bench\", \"backend\": \"%s\", "
+		       "\"iterations\": %d, \"results\": [",
+		       ec_latency_us < 0 ? "sysfs" : "sysfs-sim", iterations);
+	else
+		printf("%-26s %-6s %3s %10s %10s %10s %12s %7s %7s %6s\n",
+		       "attribute", "op", "thr", "mean_us", "p50_us", "p99_us",
+		       "ops/s", "rd/op", "wr/op", "errors");
+
+	for (a = 0; a < MSIEC_ATTR_COUNT; a++) {
+		if (!msiec_has(ec, a) ||
+		    (filter && !strstr(msiec_attr_name(a), filter)))
+			continue;
+
+		bench(a, OP_READ, NULL, 1);
+		for (c = 0; c < reader_count; c++)
+			if (readers[c] > 1)
+				bench(a, OP_READ, NULL, readers[c]);
+
+		if (writes && msiec_attr_writable(a) &&
+		    msiec_read_string(ec, a, current, sizeof(current)) == 0)
+			bench(a, OP_WRITE, current, 1);
+
+		if (presets && a == MSIEC_PRESET &&
+		    msiec_read_string(ec, a, current, sizeof(current)) == 0) {
+			bench(a, OP_SWITCH, NULL, 1);
+			if (msiec_value_parse(a, current) != MSIEC_PRESET_CUSTOM)
+				msiec_write_string(ec, a, current);
+		}
+	}
+
+	if (json)
+		printf("\n]}\n");
+
+	msiec_close(ec);
+	return 0;
+}
@@ -0,0 +1,371 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msiec-exporter.c - OpenMetrics exporter for the msi-ec driver
+ *
+ *   msiec-exporter [-l [host:]port | -l unix:path] [-r sysfs_root]
+ *
+ * Serves GET requests on every path with the current temperatures, fan
+ * speeds, power state and modes. Attributes are opened once at startup
+ * through libmsiec and read once per scrape; the response is rendered into
+ * a static buffer, so a scrape costs one read per attribute and no
+ * allocation. The firmware version is read once, it cannot change while
+ * the driver is bound.
+ *
+ * The exporter's own scrape latency is reported as a summary.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <msiec.h>
+
+#define EXPORTER_DEFAULT_LISTEN "127.0.0.1:9722"
+
+#define EXPORTER_REQUEST_LEN 1024
+#define EXPORTER_BODY_LEN 8192
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+enum metric_type {
+	METRIC_GAUGE, /* numbers and on/off switches */
+	METRIC_STATESET, /* one of the attribute's value names */
+};
+
+struct metric {
+	const char *name;
+	enum msiec_attr attr;
+	enum metric_type type;
+	const char *help;
+
+	unsigned long long errors;
+};
+
+static struct metric metrics[] = {
+	{ "msi_ec_cpu_temperature_celsius", MSIEC_CPU_TEMPERATURE,
+	  METRIC_GAUGE, "CPU temperature." },
+	{ "msi_ec_cpu_fan_speed_percent", MSIEC_CPU_FAN_SPEED,
+	  METRIC_GAUGE, "CPU fan speed." },
+	{ "msi_ec_gpu_temperature_celsius", MSIEC_GPU_TEMPERATURE,
+	  METRIC_GAUGE, "GPU temperature." },
+	{ "msi_ec_gpu_fan_speed_raw", MSIEC_GPU_FAN_SPEED,
+	  METRIC_GAUGE, "GPU fan speed, raw EC register value." },
+	{ "msi_ec_ac_connected", MSIEC_AC_CONNECTED,
+	  METRIC_GAUGE, "Whether the power adapter is connected." },
+	{ "msi_ec_lid_open", MSIEC_LID_OPEN,
+	  METRIC_GAUGE, "Whether the lid is open." },
+	{ "msi_ec_kbd_backlight_level", MSIEC_KBD_BACKLIGHT,
+	  METRIC_GAUGE, "Keyboard backlight level." },
+	{ "msi_ec_cooler_boost", MSIEC_COOLER_BOOST,
+	  METRIC_GAUGE, "Whether cooler boost is enabled." },
+	{ "msi_ec_webcam", MSIEC_WEBCAM,
+	  METRIC_GAUGE, "Whether the webcam is enabled." },
+	{ "msi_ec_preset", MSIEC_PRESET, METRIC_STATESET, "Active preset." },
+	{ "msi_ec_shift_mode", MSIEC_SHIFT_MODE, METRIC_STATESET, "Shift mode." },
+	{ "msi_ec_fan_mode", MSIEC_FAN_MODE, METRIC_STATESET, "Fan mode." },
+	{ "msi_ec_battery_charge_mode", MSIEC_BATTERY_CHARGE_MODE,
+	  METRIC_STATESET, "Battery charge mode." },
+};
+
+static struct msiec *ec;
+
+static char fw_version[MSIEC_STRING_LEN];
+static char fw_release_date[MSIEC_STRING_LEN];
+
+static char body[EXPORTER_BODY_LEN];
+static size_t body_len;
+static char response[EXPORTER_BODY_LEN + 256];
+
+static unsigned long long scrape_count;
+static double scrape_seconds;
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ============================================================ //
+// Rendering
+// ============================================================ //
+
+// Output that does not fit is dropped, the buffer is sized for all metrics
+static void emit(const char *fmt, ...)
+	__attribute__((format(printf, 1, 2)));
+
+static void emit(const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(body + body_len, sizeof(body) - body_len, fmt, args);
+	va_end(args);
+
+	if (len > 0 && (size_t)len < sizeof(body) - body_len)
+		body_len += len;
+}
+
+static void render_metric(struct metric *metric)
+{
+	const char *type = metric->type == METRIC_STATESET ? "stateset" : "gauge";
+	const char *state;
+	int value;
+	int i;
+
+	if (!msiec_has(ec, metric->attr))
+		return;
+
+	emit("# TYPE %s %s\n# HELP %s %s\n", metric->name, type, metric->name,
+	     metric->help);
+
+	if (msiec_read(ec, metric->attr, &value) < 0) {
+		metric->errors++;
+		return;
+	}
+
+	switch (metric->type) {
+	case METRIC_GAUGE:
+		if (value == MSIEC_VALUE_UNKNOWN) {
+			metric->errors++;
+			return;
+		}
+		emit("%s %d\n", metric->name, value);
+		break;
+	case METRIC_STATESET:
+		// Unknown values ("unknown (%i)") leave every state at 0
+		for (i = 0; (state = msiec_value_name(metric->attr, i)); i++)
+			emit("%s{%s=\"%s\"} %d\n", metric->name, metric->name,
+			     state, value == i);
+		break;
+	}
+}
+
+static void render(void)
+{
+	size_t i;
+
+	body_len = 0;
+
+	for (i = 0; i < ARRAY_SIZE(metrics); i++)
+		render_metric(&metrics[i]);
+
+	if (fw_version[0]) {
+		emit("# TYPE msi_ec_firmware info\n"
+		     "# HELP msi_ec_firmware Embedded controller firmware.\n");
+		emit("msi_ec_firmware_info{version=\"%s\",release_date=\"%s\"} 1\n",
+		     fw_version, fw_release_date);
+	}
+
+	emit("# TYPE msi_ec_read_errors counter\n"
+	     "# HELP msi_ec_read_errors Failed or unparsable attribute reads.\n");
+	for (i = 0; i < ARRAY_SIZE(metrics); i++)
+		if (msiec_has(ec, metrics[i].attr))
+			emit("msi_ec_read_errors_total{metric=\"%s\"} %llu\n",
+			     metrics[i].name, metrics[i].errors);
+
+	// Previous scrapes only, this one is still in progress
+	emit("# TYPE msiec_exporter_scrape_duration_seconds summary\n"
+	     "# HELP msiec_exporter_scrape_duration_seconds Time spent serving scrapes.\n"
+	     "# UNIT msiec_exporter_scrape_duration_seconds seconds\n");
+	emit("msiec_exporter_scrape_duration_seconds_count %llu\n"
+	     "msiec_exporter_scrape_duration_seconds_sum %.9f\n",
+	     scrape_count, scrape_seconds);
+	emit("# EOF\n");
+}
+
+// ============================================================ //
+// Serving
+// ============================================================ //
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(fd, buf, len);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return -errno;
+		buf += written;
+		len -= written;
+	}
+	return 0;
+}
+
+static void serve(int fd)
+{
+	char request[EXPORTER_REQUEST_LEN];
+	double start = now_seconds();
+	size_t len = 0;
+	ssize_t got;
+	int header;
+
+	// Only the request line matters, the rest of the headers are not parsed
+	while (len < sizeof(request) - 1) {
+		got = read(fd, request + len, sizeof(request) - 1 - len);
+		if (got <= 0)
+			return;
+		len += got;
+		request[len] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+			break;
+	}
+
+	if (strncmp(request, "GET ", 4) != 0) {
+		static const char bad[] =
+			"HTTP/1.0 405 Method Not Allowed\r\n"
+			"Content-Length: 0\r\nConnection: close\r\n\r\n";
+
+		write_all(fd, bad, sizeof(bad) - 1);
+		return;
+	}
+
+	render();
+	header = snprintf(response, sizeof(response) - body_len,
+			  "HTTP/1.0 200 OK\r\n"
+			  "Content-Type: application/openmetrics-text; "
+			  "version=1.0.0; charset=utf-8\r\n"
+			  "Content-Length: %zu\r\n"
+			  "Connection: close\r\n\r\n",
+			  body_len);
+	memcpy(response + header, body, body_len);
+	write_all(fd, response, header + body_len);
+
+	scrape_count++;
+	scrape_seconds += now_seconds() - start;
+}
+
+static int listen_on(const char *spec)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+		.ai_flags = AI_PASSIVE,
+	};
+	struct addrinfo *res;
+	char host[256] = "";
+	const char *port = spec;
+	const char *colon;
+	int fd, err, one = 1;
+
+	if (strncmp(spec, "unix:", 5) == 0) {
+		struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+		if (strlen(spec + 5) >= sizeof(addr.sun_path)) {
+			fprintf(stderr, "msiec-exporter: socket path too long\n");
+			return -1;
+		}
+		strcpy(addr.sun_path, spec + 5);
+		unlink(addr.sun_path);
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		    listen(fd, 8) < 0) {
+			perror("msiec-exporter: listen");
+			return -1;
+		}
+		return fd;
+	}
+
+	colon = strrchr(spec, ':');
+	if (colon) {
+		snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+		port = colon + 1;
+	}
+
+	err = getaddrinfo(host[0] ? host : NULL, port, &hints, &res);
+	if (err) {
+		fprintf(stderr, "msiec-exporter: %s: %s\n", spec, gai_strerror(err));
+		return -1;
+	}
+
+	fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC,
+		    res->ai_protocol);
+	if (fd >= 0)
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (fd < 0 || bind(fd, res->ai_addr, res->ai_addrlen) < 0 ||
+	    listen(fd, 8) < 0) {
+		perror("msiec-exporter: listen");
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	freeaddrinfo(res);
+	return fd;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-l [host:]port | -l unix:path] [-r sysfs_root]\n",
+		argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *listen_spec = EXPORTER_DEFAULT_LISTEN;
+	const char *root = MSIEC_DEFAULT_ROOT;
+	struct timeval timeout = { .tv_sec = 5 };
+	int listen_fd, fd, opt;
+
+	while ((opt = getopt(argc, argv, "l:r:")) != -1) {
+		switch (opt) {
+		case 'l':
+			listen_spec = optarg;
+			break;
+		case 'r':
+			root = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	ec = msiec_open(root);
+	if (!ec) {
+		fprintf(stderr, "msiec-exporter: no msi-ec attributes under %s\n",
+			root);
+		return 1;
+	}
+
+	msiec_read_string(ec, MSIEC_FW_VERSION, fw_version, sizeof(fw_version));
+	msiec_read_string(ec, MSIEC_FW_RELEASE_DATE, fw_release_date,
+			  sizeof(fw_release_date));
+
+	listen_fd = listen_on(listen_spec);
+	if (listen_fd < 0)
+		return 1;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	for (;;) {
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("msiec-exporter: accept");
+			return 1;
+		}
+
+		// A stalled client must not block the next scrape for long
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		serve(fd);
+		close(fd);
+	}
+}
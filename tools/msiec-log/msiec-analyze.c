@@ -0,0 +1,507 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msiec-analyze.c - Summarise telemetry logs
+ *
+ *   msiec-analyze [-T threshold_c] [-j threads] [-H bucket] file ...
+ *
+ * For the temperature and fan speed columns of all given logs together:
+ * minimum, maximum, mean, percentiles, the fastest rise and fall per
+ * second and, with -H, a histogram. Then, per preset and shift mode, the
+ * time recorded and the part of it the CPU or GPU spent at or above the
+ * throttling threshold (90 C by default).
+ *
+ * Files are spread over worker threads. The aggregation kernels work on
+ * whole decoded columns using GCC vector extensions, which compile to
+ * SSE/AVX or NEON depending on the target and to scalar code elsewhere.
+ * Unknown samples (-1) are skipped everywhere.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <msiec.h>
+
+#include "msiec-log.h"
+
+#define ANALYZE_NUMERIC 4 /* the temperature and fan speed columns */
+#define ANALYZE_BINS 256 /* values are bytes read from the EC */
+#define ANALYZE_PRESETS (MSIEC_PRESET_CUSTOM + 2) /* + unknown */
+#define ANALYZE_SHIFT_MODES (MSIEC_SHIFT_OFF + 2) /* + unknown */
+
+#define LANES 8
+
+typedef int32_t v8si __attribute__((vector_size(LANES * sizeof(int32_t))));
+typedef float v8sf __attribute__((vector_size(LANES * sizeof(float))));
+
+struct column_stats {
+	int32_t min;
+	int32_t max;
+	int64_t sum;
+	uint64_t count;
+	uint64_t hist[ANALYZE_BINS];
+	float max_rise; /* per second */
+	float max_fall;
+};
+
+struct mode_time {
+	double total_s;
+	double hot_s;
+};
+
+struct analysis {
+	uint64_t samples;
+	struct column_stats columns[ANALYZE_NUMERIC];
+	struct mode_time modes[ANALYZE_PRESETS][ANALYZE_SHIFT_MODES];
+};
+
+static const char *const *files;
+static int file_count;
+static atomic_int next_file;
+static int threshold = 90;
+
+static void stats_init(struct analysis *analysis)
+{
+	int c;
+
+	memset(analysis, 0, sizeof(*analysis));
+	for (c = 0; c < ANALYZE_NUMERIC; c++) {
+		analysis->columns[c].min = INT32_MAX;
+		analysis->columns[c].max = INT32_MIN;
+	}
+}
+
+// ============================================================ //
+// Kernels
+// ============================================================ //
+
+static v8si load(const int32_t *p)
+{
+	v8si v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// Lanes of a where mask is set (-1), of b elsewhere
+static v8si select_i(v8si mask, v8si a, v8si b)
+{
+	return (mask & a) | (~mask & b);
+}
+
+static v8sf select_f(v8si mask, v8sf a, v8sf b)
+{
+	return (v8sf)select_i(mask, (v8si)a, (v8si)b);
+}
+
+static void kernel_min_max_sum(const int32_t *values, uint32_t n,
+			       struct column_stats *stats)
+{
+	v8si vmin = (v8si){ 0 } + INT32_MAX;
+	v8si vmax = (v8si){ 0 } + INT32_MIN;
+	v8si vsum = { 0 };
+	v8si vcount = { 0 };
+	uint32_t i;
+	int lane;
+
+	for (i = 0; i + LANES <= n; i += LANES) {
+		v8si v = load(values + i);
+		v8si known = v >= 0;
+		v8si low = select_i(known, v, vmin);
+
+		vmin = select_i(low < vmin, low, vmin);
+		vmax = select_i(v > vmax, v, vmax);
+		// Byte-sized values over at most a block cannot overflow a lane
+		vsum += known & v;
+		vcount -= known;
+	}
+
+	for (lane = 0; lane < LANES; lane++) {
+		if (vmin[lane] < stats->min)
+			stats->min = vmin[lane];
+		if (vmax[lane] > stats->max)
+			stats->max = vmax[lane];
+		stats->sum += vsum[lane];
+		stats->count += vcount[lane];
+	}
+
+	for (; i < n; i++) {
+		if (values[i] < 0)
+			continue;
+		if (values[i] < stats->min)
+			stats->min = values[i];
+		if (values[i] > stats->max)
+			stats->max = values[i];
+		stats->sum += values[i];
+		stats->count++;
+	}
+}
+
+static void kernel_histogram(const int32_t *values, uint32_t n,
+			     uint64_t *hist)
+{
+	// Four partial histograms, so equal neighbours do not serialise
+	uint32_t partial[4][ANALYZE_BINS] = { { 0 } };
+	uint32_t i;
+	int b;
+
+	for (i = 0; i < n; i++) {
+		uint32_t v = values[i];
+
+		if (v < ANALYZE_BINS)
+			partial[i & 3][v]++;
+	}
+
+	for (b = 0; b < ANALYZE_BINS; b++)
+		hist[b] += partial[0][b] + partial[1][b] + partial[2][b] +
+			   partial[3][b];
+}
+
+/*
+ * dt[i] is the time from sample i to i + 1 in ms, 0 where the pair must
+ * not count (a gap in the recording).
+ */
+static void kernel_rate(const int32_t *values, const int32_t *dt, uint32_t n,
+			struct column_stats *stats)
+{
+	v8sf vrise = { 0 };
+	v8sf vfall = { 0 };
+	uint32_t i;
+	int lane;
+
+	for (i = 0; i + 1 + LANES <= n; i += LANES) {
+		v8si a = load(values + i);
+		v8si b = load(values + i + 1);
+		v8si d = load(dt + i);
+		v8si valid = (a >= 0) & (b >= 0) & (d > 0);
+		v8sf rate;
+
+		// Invalid lanes divide 0 by 1
+		rate = __builtin_convertvector((b - a) & valid, v8sf) * 1000.0f /
+		       __builtin_convertvector((d & valid) | (~valid & 1), v8sf);
+		vrise = select_f(rate > vrise, rate, vrise);
+		vfall = select_f(rate < vfall, rate, vfall);
+	}
+
+	for (lane = 0; lane < LANES; lane++) {
+		if (vrise[lane] > stats->max_rise)
+			stats->max_rise = vrise[lane];
+		if (-vfall[lane] > stats->max_fall)
+			stats->max_fall = -vfall[lane];
+	}
+
+	for (; i + 1 < n; i++) {
+		float rate;
+
+		if (values[i] < 0 || values[i + 1] < 0 || dt[i] <= 0)
+			continue;
+		rate = (values[i + 1] - values[i]) * 1000.0f / dt[i];
+		if (rate > stats->max_rise)
+			stats->max_rise = rate;
+		if (-rate > stats->max_fall)
+			stats->max_fall = -rate;
+	}
+}
+
+// ============================================================ //
+// Per file
+// ============================================================ //
+
+static bool hot(const struct msiec_log_block *block, uint32_t i)
+{
+	return block->values[MSIEC_LOG_CPU_TEMPERATURE][i] >= threshold ||
+	       block->values[MSIEC_LOG_GPU_TEMPERATURE][i] >= threshold;
+}
+
+static void mode_account(struct analysis *analysis,
+			 const struct msiec_log_block *block, uint32_t i,
+			 int32_t dt)
+{
+	int preset = block->values[MSIEC_LOG_PRESET][i] + 1;
+	int shift = block->values[MSIEC_LOG_SHIFT_MODE][i] + 1;
+	struct mode_time *mode;
+
+	if (preset < 0 || preset >= ANALYZE_PRESETS)
+		preset = 0;
+	if (shift < 0 || shift >= ANALYZE_SHIFT_MODES)
+		shift = 0;
+
+	mode = &analysis->modes[preset][shift];
+	mode->total_s += dt / 1000.0;
+	if (hot(block, i))
+		mode->hot_s += dt / 1000.0;
+}
+
+static int analyze_file(const char *path, struct analysis *analysis)
+{
+	static _Thread_local struct msiec_log_block block;
+	static _Thread_local int32_t dt[MSIEC_LOG_BLOCK_SAMPLES + 1];
+	struct msiec_log_reader reader;
+	int32_t last[MSIEC_LOG_COLUMNS];
+	uint64_t last_ms = 0;
+	int32_t gap_ms;
+	uint32_t n, i;
+	int c, result;
+
+	result = msiec_log_open(&reader, path);
+	if (result < 0)
+		return result;
+
+	// Longer pauses are holes in the recording, not slow changes
+	gap_ms = 3 * reader.header.interval_ms;
+
+	for (n = 0; n < reader.block_count; n++) {
+		result = msiec_log_read_block(&reader, n, &block);
+		if (result < 0)
+			break;
+
+		for (i = 0; i + 1 < block.count; i++) {
+			uint64_t d = block.time_ms[i + 1] - block.time_ms[i];
+
+			dt[i] = d <= (uint64_t)gap_ms ? (int32_t)d : 0;
+			mode_account(analysis, &block, i, dt[i]);
+		}
+		// The last sample of the file counts for one interval
+		mode_account(analysis, &block, block.count - 1,
+			     n + 1 == reader.block_count ?
+			     (int32_t)reader.header.interval_ms : 0);
+
+		for (c = 0; c < ANALYZE_NUMERIC; c++) {
+			struct column_stats *stats = &analysis->columns[c];
+			const int32_t *values = block.values[c];
+			uint64_t d = block.time_ms[0] - last_ms;
+
+			kernel_min_max_sum(values, block.count, stats);
+			kernel_histogram(values, block.count, stats->hist);
+			kernel_rate(values, dt, block.count, stats);
+
+			// The pair across the block boundary
+			if (n > 0 && d > 0 && d <= (uint64_t)gap_ms &&
+			    last[c] >= 0 && values[0] >= 0) {
+				float rate = (values[0] - last[c]) * 1000.0f / d;
+
+				if (rate > stats->max_rise)
+					stats->max_rise = rate;
+				if (-rate > stats->max_fall)
+					stats->max_fall = -rate;
+			}
+		}
+
+		// Time between the blocks goes to the last sample of this one
+		if (n + 1 < reader.block_count) {
+			uint64_t d = reader.index[n + 1].first_ms -
+				     block.time_ms[block.count - 1];
+
+			if (d <= (uint64_t)gap_ms)
+				mode_account(analysis, &block, block.count - 1, d);
+		}
+
+		for (c = 0; c < MSIEC_LOG_COLUMNS; c++)
+			last[c] = block.values[c][block.count - 1];
+		last_ms = block.time_ms[block.count - 1];
+		analysis->samples += block.count;
+	}
+
+	msiec_log_close(&reader);
+	return result;
+}
+
+static void analysis_merge(struct analysis *into, const struct analysis *from)
+{
+	int c, b, p, s;
+
+	into->samples += from->samples;
+
+	for (c = 0; c < ANALYZE_NUMERIC; c++) {
+		struct column_stats *a = &into->columns[c];
+		const struct column_stats *f = &from->columns[c];
+
+		if (f->min < a->min)
+			a->min = f->min;
+		if (f->max > a->max)
+			a->max = f->max;
+		if (f->max_rise > a->max_rise)
+			a->max_rise = f->max_rise;
+		if (f->max_fall > a->max_fall)
+			a->max_fall = f->max_fall;
+		a->sum += f->sum;
+		a->count += f->count;
+		for (b = 0; b < ANALYZE_BINS; b++)
+			a->hist[b] += f->hist[b];
+	}
+
+	for (p = 0; p < ANALYZE_PRESETS; p++) {
+		for (s = 0; s < ANALYZE_SHIFT_MODES; s++) {
+			into->modes[p][s].total_s += from->modes[p][s].total_s;
+			into->modes[p][s].hot_s += from->modes[p][s].hot_s;
+		}
+	}
+}
+
+static void *worker(void *arg)
+{
+	struct analysis *analysis = arg;
+	int f, result;
+
+	while ((f = atomic_fetch_add(&next_file, 1)) < file_count) {
+		result = analyze_file(files[f], analysis);
+		if (result < 0)
+			fprintf(stderr, "msiec-analyze: %s: %s\n", files[f],
+				strerror(-result));
+	}
+	return NULL;
+}
+
+// ============================================================ //
+// Report
+// ============================================================ //
+
+static int percentile(const struct column_stats *stats, double p)
+{
+	uint64_t rank = stats->count * p;
+	uint64_t seen = 0;
+	int b;
+
+	for (b = 0; b < ANALYZE_BINS; b++) {
+		seen += stats->hist[b];
+		if (seen > rank)
+			return b;
+	}
+	return stats->max;
+}
+
+static void report(const struct analysis *analysis, int bucket)
+{
+	int c, b, p, s;
+
+	printf("%llu samples\n\n", (unsigned long long)analysis->samples);
+	printf("%-16s %5s %5s %7s %5s %5s %5s %9s %9s\n", "column", "min",
+	       "max", "mean", "p50", "p90", "p99", "rise/s", "fall/s");
+
+	for (c = 0; c < ANALYZE_NUMERIC; c++) {
+		const struct column_stats *stats = &analysis->columns[c];
+
+		if (!stats->count) {
+			printf("%-16s no samples\n", msiec_log_column_name(c));
+			continue;
+		}
+		printf("%-16s %5d %5d %7.2f %5d %5d %5d %9.2f %9.2f\n",
+		       msiec_log_column_name(c), stats->min, stats->max,
+		       (double)stats->sum / stats->count,
+		       percentile(stats, 0.50), percentile(stats, 0.90),
+		       percentile(stats, 0.99), stats->max_rise,
+		       stats->max_fall);
+	}
+
+	for (c = 0; bucket > 0 && c < ANALYZE_NUMERIC; c++) {
+		const struct column_stats *stats = &analysis->columns[c];
+
+		if (!stats->count)
+			continue;
+		printf("\n%s\n", msiec_log_column_name(c));
+		for (b = stats->min - stats->min % bucket; b <= stats->max;
+		     b += bucket) {
+			uint64_t count = 0;
+			int i;
+
+			for (i = b; i < b + bucket && i < ANALYZE_BINS; i++)
+				count += stats->hist[i];
+			printf("  %3d-%-3d %10llu %5.1f%%\n", b, b + bucket - 1,
+			       (unsigned long long)count,
+			       100.0 * count / stats->count);
+		}
+	}
+
+	printf("\n%-18s %-10s %12s %12s %7s\n", "preset", "shift_mode",
+	       "time_s", "hot_s", "hot");
+	for (p = 0; p < ANALYZE_PRESETS; p++) {
+		for (s = 0; s < ANALYZE_SHIFT_MODES; s++) {
+			const struct mode_time *mode = &analysis->modes[p][s];
+			const char *preset = msiec_value_name(MSIEC_PRESET, p - 1);
+			const char *shift = msiec_value_name(MSIEC_SHIFT_MODE,
+							     s - 1);
+
+			if (mode->total_s <= 0)
+				continue;
+			printf("%-18s %-10s %12.1f %12.1f %6.1f%%\n",
+			       preset ? preset : "unknown",
+			       shift ? shift : "unknown", mode->total_s,
+			       mode->hot_s, 100.0 * mode->hot_s / mode->total_s);
+		}
+	}
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-T threshold_c] [-j threads] [-H bucket] file ...\n",
+		argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct analysis *results, total;
+	pthread_t *threads;
+	long threads_count = sysconf(_SC_NPROCESSORS_ONLN);
+	int bucket = 0;
+	int opt, t;
+
+	while ((opt = getopt(argc, argv, "T:j:H:")) != -1) {
+		switch (opt) {
+		case 'T':
+			threshold = atoi(optarg);
+			break;
+		case 'j':
+			threads_count = atol(optarg);
+			break;
+		case 'H':
+			bucket = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind >= argc)
+		usage(argv[0]);
+
+	files = (const char *const *)argv + optind;
+	file_count = argc - optind;
+	if (threads_count < 1)
+		threads_count = 1;
+	if (threads_count > file_count)
+		threads_count = file_count;
+
+	results = calloc(threads_count, sizeof(*results));
+	threads = calloc(threads_count, sizeof(*threads));
+	if (!results || !threads) {
+		fprintf(stderr, "msiec-analyze: out of memory\n");
+		return 1;
+	}
+
+	for (t = 0; t < threads_count; t++) {
+		stats_init(&results[t]);
+		if (pthread_create(&threads[t], NULL, worker, &results[t]) != 0) {
+			fprintf(stderr, "msiec-analyze: cannot start threads\n");
+			return 1;
+		}
+	}
+
+	stats_init(&total);
+	for (t = 0; t < threads_count; t++) {
+		pthread_join(threads[t], NULL);
+		analysis_merge(&total, &results[t]);
+	}
+
+	report(&total, bucket);
+
+	free(results);
+	free(threads);
+	return 0;
+}
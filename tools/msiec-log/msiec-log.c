@@ -0,0 +1,465 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msiec-log.c - Binary telemetry log format
+ */
+
+#include "msiec-log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BLOCK_HEADER_SIZE 64
+#define INDEX_ENTRY_SIZE 16
+#define INDEX_FOOTER_SIZE 8
+#define VARINT_MAX 10
+
+// Runs in a block: the value columns, then the time column
+#define RUNS (MSIEC_LOG_COLUMNS + 1)
+#define RUN_TIME MSIEC_LOG_COLUMNS
+
+static const char *const column_names[MSIEC_LOG_COLUMNS] = {
+	[MSIEC_LOG_CPU_TEMPERATURE] = "cpu_temperature",
+	[MSIEC_LOG_CPU_FAN_SPEED] = "cpu_fan_speed",
+	[MSIEC_LOG_GPU_TEMPERATURE] = "gpu_temperature",
+	[MSIEC_LOG_GPU_FAN_SPEED] = "gpu_fan_speed",
+	[MSIEC_LOG_PRESET] = "preset",
+	[MSIEC_LOG_SHIFT_MODE] = "shift_mode",
+};
+
+const char *msiec_log_column_name(enum msiec_log_column column)
+{
+	return column < MSIEC_LOG_COLUMNS ? column_names[column] : NULL;
+}
+
+// ============================================================ //
+// Encoding helpers
+// ============================================================ //
+
+static void put_le(uint8_t *buf, uint64_t value, int bytes)
+{
+	int i;
+
+	for (i = 0; i < bytes; i++)
+		buf[i] = value >> (8 * i);
+}
+
+static uint64_t get_le(const uint8_t *buf, int bytes)
+{
+	uint64_t value = 0;
+	int i;
+
+	for (i = 0; i < bytes; i++)
+		value |= (uint64_t)buf[i] << (8 * i);
+	return value;
+}
+
+static int put_varint(uint8_t *buf, int64_t value)
+{
+	// Zigzag, so small negative differences stay short
+	uint64_t zz = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	int len = 0;
+
+	while (zz >= 0x80) {
+		buf[len++] = zz | 0x80;
+		zz >>= 7;
+	}
+	buf[len++] = zz;
+	return len;
+}
+
+// Returns the bytes consumed, 0 if the varint runs past end
+static int get_varint(const uint8_t *buf, const uint8_t *end, int64_t *value)
+{
+	uint64_t zz = 0;
+	int len = 0;
+
+	while (buf + len < end && len < VARINT_MAX) {
+		zz |= (uint64_t)(buf[len] & 0x7f) << (7 * len);
+		if (!(buf[len++] & 0x80)) {
+			*value = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+			return len;
+		}
+	}
+	return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(fd, p, len);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0)
+			return -errno;
+		p += written;
+		len -= written;
+	}
+	return 0;
+}
+
+static int read_at(int fd, void *buf, size_t len, off_t offset)
+{
+	ssize_t got = pread(fd, buf, len, offset);
+
+	if (got < 0)
+		return -errno;
+	return (size_t)got == len ? 0 : -EIO;
+}
+
+// ============================================================ //
+// Writing
+// ============================================================ //
+
+int msiec_log_create(struct msiec_log_writer *writer, const char *path,
+		     uint32_t interval_ms, int64_t start_ns)
+{
+	uint8_t buf[MSIEC_LOG_HEADER_SIZE] = { 0 };
+
+	memset(writer, 0, sizeof(*writer));
+	writer->header.version = MSIEC_LOG_VERSION;
+	writer->header.columns = MSIEC_LOG_COLUMNS;
+	writer->header.block_size = MSIEC_LOG_BLOCK_SIZE;
+	writer->header.interval_ms = interval_ms;
+	writer->header.start_ns = start_ns;
+
+	memcpy(buf, MSIEC_LOG_MAGIC, 8);
+	put_le(buf + 8, writer->header.version, 2);
+	put_le(buf + 10, writer->header.columns, 2);
+	put_le(buf + 12, writer->header.block_size, 4);
+	put_le(buf + 16, writer->header.interval_ms, 4);
+	put_le(buf + 24, writer->header.start_ns, 8);
+
+	writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (writer->fd < 0)
+		return -errno;
+
+	return write_all(writer->fd, buf, sizeof(buf));
+}
+
+static int writer_flush(struct msiec_log_writer *writer)
+{
+	struct msiec_log_index_entry *index;
+	uint8_t block[MSIEC_LOG_BLOCK_SIZE] = { 0 };
+	size_t pos = BLOCK_HEADER_SIZE;
+	uint32_t size;
+	int i;
+
+	if (!writer->count)
+		return 0;
+
+	// Grown first, so a failure leaves the block in place
+	if (writer->block_count == writer->index_size) {
+		size = writer->index_size ? 2 * writer->index_size : 64;
+		index = realloc(writer->index, size * sizeof(*index));
+		if (!index)
+			return -ENOMEM;
+		writer->index = index;
+		writer->index_size = size;
+	}
+
+	put_le(block, MSIEC_LOG_BLOCK_MAGIC, 4);
+	put_le(block + 4, writer->count, 2);
+	put_le(block + 8, writer->first.time_ms, 8);
+	put_le(block + 16, writer->last.time_ms, 8);
+	for (i = 0; i < MSIEC_LOG_COLUMNS; i++)
+		put_le(block + 24 + 4 * i, (uint32_t)writer->first.values[i], 4);
+
+	for (i = 0; i < RUNS; i++) {
+		put_le(block + 48 + 2 * i, writer->column_len[i], 2);
+		memcpy(block + pos, writer->column[i], writer->column_len[i]);
+		pos += writer->column_len[i];
+		writer->column_len[i] = 0;
+	}
+
+	writer->index[writer->block_count].first_ms = writer->first.time_ms;
+	writer->index[writer->block_count].last_ms = writer->last.time_ms;
+	writer->block_count++;
+	writer->count = 0;
+
+	return write_all(writer->fd, block, sizeof(block));
+}
+
+int msiec_log_append(struct msiec_log_writer *writer,
+		     const struct msiec_log_sample *sample)
+{
+	uint8_t encoded[RUNS][VARINT_MAX];
+	int len[RUNS];
+	size_t used = BLOCK_HEADER_SIZE;
+	int i, result;
+
+	if (writer->count && sample->time_ms < writer->last.time_ms)
+		return -EINVAL;
+
+	if (writer->count) {
+		for (i = 0; i < MSIEC_LOG_COLUMNS; i++)
+			len[i] = put_varint(encoded[i], (int64_t)sample->values[i] -
+					    writer->last.values[i]);
+		len[RUN_TIME] = put_varint(encoded[RUN_TIME],
+					   (int64_t)(sample->time_ms -
+						     writer->last.time_ms) -
+					   writer->header.interval_ms);
+
+		for (i = 0; i < RUNS; i++)
+			used += writer->column_len[i] + len[i];
+
+		if (used <= MSIEC_LOG_BLOCK_SIZE &&
+		    writer->count < MSIEC_LOG_BLOCK_SAMPLES) {
+			for (i = 0; i < RUNS; i++) {
+				memcpy(writer->column[i] + writer->column_len[i],
+				       encoded[i], len[i]);
+				writer->column_len[i] += len[i];
+			}
+			writer->count++;
+			writer->last = *sample;
+			return 0;
+		}
+
+		result = writer_flush(writer);
+		if (result < 0)
+			return result;
+	}
+
+	// First sample of a block, stored in full in the block header
+	writer->first = *sample;
+	writer->last = *sample;
+	writer->count = 1;
+	return 0;
+}
+
+int msiec_log_finish(struct msiec_log_writer *writer)
+{
+	uint8_t entry[INDEX_ENTRY_SIZE];
+	uint8_t footer[INDEX_FOOTER_SIZE];
+	uint32_t i;
+	int result;
+
+	result = writer_flush(writer);
+
+	for (i = 0; result == 0 && i < writer->block_count; i++) {
+		put_le(entry, writer->index[i].first_ms, 8);
+		put_le(entry + 8, writer->index[i].last_ms, 8);
+		result = write_all(writer->fd, entry, sizeof(entry));
+	}
+	if (result == 0) {
+		put_le(footer, writer->block_count, 4);
+		put_le(footer + 4, MSIEC_LOG_INDEX_MAGIC, 4);
+		result = write_all(writer->fd, footer, sizeof(footer));
+	}
+
+	if (close(writer->fd) < 0 && result == 0)
+		result = -errno;
+	free(writer->index);
+	writer->index = NULL;
+	return result;
+}
+
+// ============================================================ //
+// Reading
+// ============================================================ //
+
+static off_t block_offset(uint32_t n)
+{
+	return MSIEC_LOG_HEADER_SIZE + (off_t)n * MSIEC_LOG_BLOCK_SIZE;
+}
+
+static int reader_load_index(struct msiec_log_reader *reader, off_t size)
+{
+	uint8_t footer[INDEX_FOOTER_SIZE];
+	uint8_t *entries;
+	uint32_t count, i;
+	off_t index_offset;
+	int result;
+
+	if (size < MSIEC_LOG_HEADER_SIZE + INDEX_FOOTER_SIZE)
+		return -ENOENT;
+	result = read_at(reader->fd, footer, sizeof(footer),
+			 size - INDEX_FOOTER_SIZE);
+	if (result < 0)
+		return result;
+	if (get_le(footer + 4, 4) != MSIEC_LOG_INDEX_MAGIC)
+		return -ENOENT;
+
+	count = get_le(footer, 4);
+	index_offset = block_offset(count);
+	if (index_offset + (off_t)count * INDEX_ENTRY_SIZE + INDEX_FOOTER_SIZE !=
+	    size)
+		return -ENOENT;
+
+	entries = malloc((size_t)count * INDEX_ENTRY_SIZE + 1);
+	reader->index = malloc(((size_t)count + 1) * sizeof(*reader->index));
+	if (!entries || !reader->index) {
+		free(entries);
+		return -ENOMEM;
+	}
+
+	result = read_at(reader->fd, entries, (size_t)count * INDEX_ENTRY_SIZE,
+			 index_offset);
+	for (i = 0; result == 0 && i < count; i++) {
+		reader->index[i].first_ms = get_le(entries + i * 16, 8);
+		reader->index[i].last_ms = get_le(entries + i * 16 + 8, 8);
+	}
+	free(entries);
+
+	reader->block_count = count;
+	return result;
+}
+
+// For logs whose recorder did not finish, one header read per block
+static int reader_scan_index(struct msiec_log_reader *reader, off_t size)
+{
+	uint8_t header[BLOCK_HEADER_SIZE];
+	uint32_t count, i;
+	int result;
+
+	count = (size - MSIEC_LOG_HEADER_SIZE) / MSIEC_LOG_BLOCK_SIZE;
+	reader->index = malloc(((size_t)count + 1) * sizeof(*reader->index));
+	if (!reader->index)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		result = read_at(reader->fd, header, sizeof(header),
+				 block_offset(i));
+		if (result < 0)
+			return result;
+		if (get_le(header, 4) != MSIEC_LOG_BLOCK_MAGIC)
+			break;
+		reader->index[i].first_ms = get_le(header + 8, 8);
+		reader->index[i].last_ms = get_le(header + 16, 8);
+	}
+
+	reader->block_count = i;
+	return 0;
+}
+
+int msiec_log_open(struct msiec_log_reader *reader, const char *path)
+{
+	uint8_t buf[MSIEC_LOG_HEADER_SIZE];
+	struct stat st;
+	int result;
+
+	memset(reader, 0, sizeof(*reader));
+	reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (reader->fd < 0)
+		return -errno;
+
+	result = read_at(reader->fd, buf, sizeof(buf), 0);
+	if (result == 0 && fstat(reader->fd, &st) < 0)
+		result = -errno;
+	if (result == 0 && memcmp(buf, MSIEC_LOG_MAGIC, 8) != 0)
+		result = -EINVAL;
+	if (result < 0)
+		goto fail;
+
+	reader->header.version = get_le(buf + 8, 2);
+	reader->header.columns = get_le(buf + 10, 2);
+	reader->header.block_size = get_le(buf + 12, 4);
+	reader->header.interval_ms = get_le(buf + 16, 4);
+	reader->header.start_ns = get_le(buf + 24, 8);
+
+	if (reader->header.version != MSIEC_LOG_VERSION ||
+	    reader->header.columns != MSIEC_LOG_COLUMNS ||
+	    reader->header.block_size != MSIEC_LOG_BLOCK_SIZE) {
+		result = -EINVAL;
+		goto fail;
+	}
+
+	result = reader_load_index(reader, st.st_size);
+	if (result == -ENOENT) {
+		free(reader->index);
+		reader->index = NULL;
+		result = reader_scan_index(reader, st.st_size);
+	}
+	if (result < 0)
+		goto fail;
+
+	return 0;
+
+fail:
+	msiec_log_close(reader);
+	return result;
+}
+
+void msiec_log_close(struct msiec_log_reader *reader)
+{
+	if (reader->fd >= 0)
+		close(reader->fd);
+	reader->fd = -1;
+	free(reader->index);
+	reader->index = NULL;
+}
+
+uint32_t msiec_log_find(const struct msiec_log_reader *reader,
+			uint64_t time_ms)
+{
+	uint32_t low = 0, high = reader->block_count;
+
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+
+		if (reader->index[mid].last_ms < time_ms)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+int msiec_log_read_block(struct msiec_log_reader *reader, uint32_t n,
+			 struct msiec_log_block *block)
+{
+	uint8_t buf[MSIEC_LOG_BLOCK_SIZE];
+	const uint8_t *pos = buf + BLOCK_HEADER_SIZE;
+	const uint8_t *end = buf + sizeof(buf);
+	uint32_t count, i;
+	int64_t delta;
+	int run, len, result;
+
+	if (n >= reader->block_count)
+		return -ERANGE;
+
+	result = read_at(reader->fd, buf, sizeof(buf), block_offset(n));
+	if (result < 0)
+		return result;
+
+	count = get_le(buf + 4, 2);
+	if (get_le(buf, 4) != MSIEC_LOG_BLOCK_MAGIC || count == 0 ||
+	    count > MSIEC_LOG_BLOCK_SAMPLES)
+		return -EINVAL;
+
+	block->count = count;
+	block->time_ms[0] = get_le(buf + 8, 8);
+	for (run = 0; run < MSIEC_LOG_COLUMNS; run++)
+		block->values[run][0] = (int32_t)get_le(buf + 24 + 4 * run, 4);
+
+	for (run = 0; run < RUNS; run++) {
+		const uint8_t *run_end = pos + get_le(buf + 48 + 2 * run, 2);
+
+		if (run_end > end)
+			return -EINVAL;
+
+		for (i = 1; i < count; i++) {
+			len = get_varint(pos, run_end, &delta);
+			if (!len)
+				return -EINVAL;
+			pos += len;
+
+			if (run == RUN_TIME)
+				block->time_ms[i] = block->time_ms[i - 1] + delta +
+						    reader->header.interval_ms;
+			else
+				block->values[run][i] = block->values[run][i - 1] +
+							delta;
+		}
+		pos = run_end;
+	}
+
+	return 0;
+}
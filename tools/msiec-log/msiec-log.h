@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+ * msiec-log.h - Binary telemetry log format
+ *
+ * A log is a 64-byte file header followed by fixed-size blocks and, once
+ * the recording is finished, a block index:
+ *
+ *   header   "MSIECLOG", version, column count, block size, sampling
+ *            interval, wall clock time of the first sample
+ *   block    header (sample count, first/last time, first sample) and then
+ *            one run per column holding the remaining samples as zigzag
+ *            varints of the difference to the previous sample; the time
+ *            column stores the difference minus the sampling interval, so
+ *            regular samples cost one byte per column
+ *   index    first and last time of every block, then the block count and
+ *            "MSII"
+ *
+ * Block n starts at MSIEC_LOG_HEADER_SIZE + n * block size, so a reader
+ * can seek to any block; a log without an index (the recorder was killed)
+ * is indexed by reading the block headers. Times are milliseconds since
+ * the first sample. All integers are little endian.
+ */
+
+#ifndef __MSIEC_LOG_H__
+#define __MSIEC_LOG_H__
+
+#include <stdint.h>
+
+#define MSIEC_LOG_MAGIC "MSIECLOG"
+#define MSIEC_LOG_VERSION 1
+#define MSIEC_LOG_HEADER_SIZE 64
+#define MSIEC_LOG_BLOCK_SIZE 4096
+#define MSIEC_LOG_BLOCK_MAGIC 0x4249534d /* "MSIB" */
+#define MSIEC_LOG_INDEX_MAGIC 0x4949534d /* "MSII" */
+
+/* A regular block holds about 580 samples, this is the hard limit */
+#define MSIEC_LOG_BLOCK_SAMPLES 1024
+
+enum msiec_log_column {
+	MSIEC_LOG_CPU_TEMPERATURE,
+	MSIEC_LOG_CPU_FAN_SPEED,
+	MSIEC_LOG_GPU_TEMPERATURE,
+	MSIEC_LOG_GPU_FAN_SPEED,
+	MSIEC_LOG_PRESET,
+	MSIEC_LOG_SHIFT_MODE,
+	MSIEC_LOG_COLUMNS,
+};
+
+struct msiec_log_header {
+	uint16_t version;
+	uint16_t columns;
+	uint32_t block_size;
+	uint32_t interval_ms;
+	int64_t start_ns; /* CLOCK_REALTIME */
+};
+
+struct msiec_log_sample {
+	uint64_t time_ms;
+	int32_t values[MSIEC_LOG_COLUMNS]; /* -1 if the read failed */
+};
+
+/* One decoded block, column by column */
+struct msiec_log_block {
+	uint32_t count;
+	uint64_t time_ms[MSIEC_LOG_BLOCK_SAMPLES];
+	int32_t values[MSIEC_LOG_COLUMNS][MSIEC_LOG_BLOCK_SAMPLES];
+};
+
+struct msiec_log_index_entry {
+	uint64_t first_ms;
+	uint64_t last_ms;
+};
+
+struct msiec_log_writer {
+	int fd;
+	struct msiec_log_header header;
+
+	// The block being filled
+	uint32_t count;
+	struct msiec_log_sample first;
+	struct msiec_log_sample last;
+	uint32_t column_len[MSIEC_LOG_COLUMNS + 1]; /* the time column last */
+	uint8_t column[MSIEC_LOG_COLUMNS + 1][MSIEC_LOG_BLOCK_SIZE];
+
+	struct msiec_log_index_entry *index;
+	uint32_t block_count;
+	uint32_t index_size;
+};
+
+struct msiec_log_reader {
+	int fd;
+	struct msiec_log_header header;
+	struct msiec_log_index_entry *index;
+	uint32_t block_count;
+};
+
+const char *msiec_log_column_name(enum msiec_log_column column);
+
+/* All return 0 or a negative errno */
+int msiec_log_create(struct msiec_log_writer *writer, const char *path,
+		     uint32_t interval_ms, int64_t start_ns);
+int msiec_log_append(struct msiec_log_writer *writer,
+		     const struct msiec_log_sample *sample);
+/* Writes the last block and the index, and closes the file */
+int msiec_log_finish(struct msiec_log_writer *writer);
+
+int msiec_log_open(struct msiec_log_reader *reader, const char *path);
+void msiec_log_close(struct msiec_log_reader *reader);
+/* First block that ends at or after time_ms, block_count if none */
+uint32_t msiec_log_find(const struct msiec_log_reader *reader,
+			uint64_t time_ms);
+int msiec_log_read_block(struct msiec_log_reader *reader, uint32_t n,
+			 struct msiec_log_block *block);
+
+#endif // __MSIEC_LOG_H__
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msiec-record.c - Record msi-ec telemetry into a binary log
+ *
+ *   msiec-record [-r sysfs_root] [-i interval_ms] [-d seconds] file
+ *
+ * Samples the CPU/GPU temperatures and fan speeds, the preset and the
+ * shift mode every interval (100 ms by default) until the duration is up
+ * or SIGINT/SIGTERM arrives, then writes the block index. Samples are
+ * taken on an absolute schedule, so a slow read does not shift the ones
+ * after it. A recording that is killed loses at most its last, unwritten
+ * block; msiec-replay reads it without the index.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <msiec.h>
+
+#include "msiec-log.h"
+
+static const enum msiec_attr column_attrs[MSIEC_LOG_COLUMNS] = {
+	[MSIEC_LOG_CPU_TEMPERATURE] = MSIEC_CPU_TEMPERATURE,
+	[MSIEC_LOG_CPU_FAN_SPEED] = MSIEC_CPU_FAN_SPEED,
+	[MSIEC_LOG_GPU_TEMPERATURE] = MSIEC_GPU_TEMPERATURE,
+	[MSIEC_LOG_GPU_FAN_SPEED] = MSIEC_GPU_FAN_SPEED,
+	[MSIEC_LOG_PRESET] = MSIEC_PRESET,
+	[MSIEC_LOG_SHIFT_MODE] = MSIEC_SHIFT_MODE,
+};
+
+static volatile sig_atomic_t stopping;
+
+static void stop(int sig)
+{
+	stopping = 1;
+}
+
+static uint64_t ms_between(const struct timespec *from,
+			   const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) * 1000LL +
+	       (to->tv_nsec - from->tv_nsec) / 1000000;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-r sysfs_root] [-i interval_ms] [-d seconds] file\n",
+		argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *root = MSIEC_DEFAULT_ROOT;
+	struct sigaction sa = { .sa_handler = stop };
+	struct msiec_log_writer writer;
+	struct msiec_log_sample sample;
+	struct timespec start, next, now, wall;
+	unsigned long interval_ms = 100;
+	unsigned long long samples = 0;
+	double duration = 0;
+	struct msiec *ec;
+	int i, opt, result;
+
+	while ((opt = getopt(argc, argv, "r:i:d:")) != -1) {
+		switch (opt) {
+		case 'r':
+			root = optarg;
+			break;
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			duration = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind + 1 != argc || interval_ms == 0)
+		usage(argv[0]);
+
+	ec = msiec_open(root);
+	if (!ec) {
+		fprintf(stderr, "msiec-record: no msi-ec attributes under %s\n",
+			root);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &wall);
+	result = msiec_log_create(&writer, argv[optind], interval_ms,
+				  wall.tv_sec * 1000000000LL + wall.tv_nsec);
+	if (result < 0) {
+		fprintf(stderr, "msiec-record: %s: %s\n", argv[optind],
+			strerror(-result));
+		return 1;
+	}
+
+	// No SA_RESTART, so the sleep below returns on a signal
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = start;
+
+	while (!stopping) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		sample.time_ms = ms_between(&start, &now);
+		if (duration > 0 && sample.time_ms >= duration * 1000)
+			break;
+
+		for (i = 0; i < MSIEC_LOG_COLUMNS; i++)
+			if (msiec_read(ec, column_attrs[i], &sample.values[i]) < 0)
+				sample.values[i] = MSIEC_VALUE_UNKNOWN;
+
+		result = msiec_log_append(&writer, &sample);
+		if (result < 0) {
+			fprintf(stderr, "msiec-record: %s\n", strerror(-result));
+			break;
+		}
+		samples++;
+
+		next.tv_nsec += interval_ms * 1000000;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	msiec_close(ec);
+
+	if (msiec_log_finish(&writer) < 0 || result < 0) {
+		fprintf(stderr, "msiec-record: failed to write %s\n", argv[optind]);
+		return 1;
+	}
+
+	fprintf(stderr, "msiec-record: %llu samples in %u blocks\n", samples,
+		writer.block_count);
+	return 0;
+}
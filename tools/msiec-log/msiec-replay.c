@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msiec-replay.c - Export or replay a range of a telemetry log
+ *
+ *   msiec-replay [-f from_s] [-t to_s] [-s speed] [-i] file
+ *
+ * Prints the samples between from and to (seconds since the start of the
+ * recording) as CSV. Only the blocks overlapping the range are read, found
+ * through the block index. With -s the samples are printed at their
+ * recorded pace, sped up by the given factor; -i prints the log's header
+ * and block index instead.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <msiec.h>
+
+#include "msiec-log.h"
+
+static struct msiec_log_block block;
+
+static void print_value(enum msiec_log_column column, int32_t value)
+{
+	const char *name = NULL;
+
+	if (column == MSIEC_LOG_PRESET)
+		name = msiec_value_name(MSIEC_PRESET, value);
+	else if (column == MSIEC_LOG_SHIFT_MODE)
+		name = msiec_value_name(MSIEC_SHIFT_MODE, value);
+
+	if (name)
+		printf(",%s", name);
+	else if (value != MSIEC_VALUE_UNKNOWN)
+		printf(",%d", value);
+	else
+		printf(",");
+}
+
+static void print_info(const struct msiec_log_reader *reader)
+{
+	time_t start = reader->header.start_ns / 1000000000;
+	char date[64];
+	uint32_t i;
+
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&start));
+	printf("version %u, %u columns, %u-byte blocks, %u ms interval\n",
+	       reader->header.version, reader->header.columns,
+	       reader->header.block_size, reader->header.interval_ms);
+	printf("started %s, %u blocks\n", date, reader->block_count);
+	for (i = 0; i < reader->block_count; i++)
+		printf("block %u: %.3f - %.3f s\n", i,
+		       reader->index[i].first_ms / 1000.0,
+		       reader->index[i].last_ms / 1000.0);
+}
+
+// Sleeps until the sample's time, relative to the first replayed sample
+static void pace(uint64_t time_ms, double speed)
+{
+	static struct timespec start;
+	static uint64_t first_ms = UINT64_MAX;
+	struct timespec at;
+	double offset;
+
+	if (first_ms == UINT64_MAX) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		first_ms = time_ms;
+		return;
+	}
+
+	offset = (time_ms - first_ms) / 1000.0 / speed;
+	at.tv_sec = start.tv_sec + (time_t)offset;
+	at.tv_nsec = start.tv_nsec + (offset - (time_t)offset) * 1e9;
+	if (at.tv_nsec >= 1000000000) {
+		at.tv_nsec -= 1000000000;
+		at.tv_sec++;
+	}
+
+	fflush(stdout);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL) == EINTR)
+		;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-f from_s] [-t to_s] [-s speed] [-i] file\n",
+		argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct msiec_log_reader reader;
+	double from = 0, to = -1, speed = 0;
+	uint64_t from_ms, to_ms;
+	int info = 0;
+	uint32_t n, i;
+	int column, opt, result;
+
+	while ((opt = getopt(argc, argv, "f:t:s:i")) != -1) {
+		switch (opt) {
+		case 'f':
+			from = strtod(optarg, NULL);
+			break;
+		case 't':
+			to = strtod(optarg, NULL);
+			break;
+		case 's':
+			speed = strtod(optarg, NULL);
+			break;
+		case 'i':
+			info = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind + 1 != argc || from < 0 || speed < 0)
+		usage(argv[0]);
+
+	result = msiec_log_open(&reader, argv[optind]);
+	if (result < 0) {
+		fprintf(stderr, "msiec-replay: %s: %s\n", argv[optind],
+			strerror(-result));
+		return 1;
+	}
+
+	if (info) {
+		print_info(&reader);
+		msiec_log_close(&reader);
+		return 0;
+	}
+
+	from_ms = from * 1000;
+	to_ms = to < 0 ? UINT64_MAX : (uint64_t)(to * 1000);
+
+	printf("time_s");
+	for (column = 0; column < MSIEC_LOG_COLUMNS; column++)
+		printf(",%s", msiec_log_column_name(column));
+	printf("\n");
+
+	for (n = msiec_log_find(&reader, from_ms); n < reader.block_count &&
+	     reader.index[n].first_ms <= to_ms; n++) {
+		result = msiec_log_read_block(&reader, n, &block);
+		if (result < 0) {
+			fprintf(stderr, "msiec-replay: block %u: %s\n", n,
+				strerror(-result));
+			break;
+		}
+
+		for (i = 0; i < block.count; i++) {
+			if (block.time_ms[i] < from_ms || block.time_ms[i] > to_ms)
+				continue;
+			if (speed > 0)
+				pace(block.time_ms[i], speed);
+
+			printf("%.3f", block.time_ms[i] / 1000.0);
+			for (column = 0; column < MSIEC_LOG_COLUMNS; column++)
+				print_value(column, block.values[column][i]);
+			printf("\n");
+		}
+	}
+
+	msiec_log_close(&reader);
+	return result < 0 ? 1 : 0;
+}
@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msiec.c - Apply several msi-ec settings in one pass
+ *
+ *   msiec [-r sysfs_root] set name=value ...
+ *
+ * Every setting is checked before anything is written: unknown names,
+ * invalid values, attributes the model does not have and contradicting
+ * settings (fn_key and win_key are the same switch) abort with exit code 2.
+ * Settings are then applied in an order where a later write cannot be
+ * undone by an earlier one (preset rewrites shift mode, the fan flags and
+ * the keyboard backlight, so it goes first), and a setting that already
+ * has the requested value is not written at all. When fn_key and win_key
+ * are both given only fn_key is written; win_key reports its result.
+ *
+ * One line is printed per setting:
+ *
+ *   name=<name> value=<value> result=changed|unchanged|error time_us=<n> [errno=<n>]
+ *
+ * followed by a summary line. The exit code is 1 if any setting failed.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <msiec.h>
+
+#define MSIEC_KBD_BACKLIGHT_MAX 3
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+enum result {
+	RESULT_CHANGED,
+	RESULT_UNCHANGED,
+	RESULT_ERROR,
+};
+
+static const char *const result_names[] = {
+	[RESULT_CHANGED] = "changed",
+	[RESULT_UNCHANGED] = "unchanged",
+	[RESULT_ERROR] = "error",
+};
+
+// Writable settings, in the order they are applied
+struct setting {
+	enum msiec_attr id;
+
+	// Filled in from the command line
+	const char *value;
+	enum result result;
+	int error;
+	long long time_us;
+
+	// Set when another setting writes the same bit; its result is reported
+	struct setting *follows;
+};
+
+static struct setting settings[] = {
+	{ MSIEC_PRESET },
+	{ MSIEC_SHIFT_MODE },
+	{ MSIEC_FAN_MODE },
+	{ MSIEC_COOLER_BOOST },
+	{ MSIEC_BATTERY_CHARGE_MODE },
+	{ MSIEC_WEBCAM },
+	{ MSIEC_FN_KEY },
+	{ MSIEC_WIN_KEY },
+	{ MSIEC_KBD_BACKLIGHT },
+};
+
+static struct msiec *ec;
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static struct setting *setting_find(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(settings); i++)
+		if (strcmp(msiec_attr_name(settings[i].id), name) == 0)
+			return &settings[i];
+	return NULL;
+}
+
+// Returns the canonical form of value (a name or an index), or NULL
+static const char *setting_value(const struct setting *setting,
+				 const char *value)
+{
+	static const char *const levels[] = { "0", "1", "2", "3" };
+	int parsed = msiec_value_parse(setting->id, value);
+
+	if (parsed == MSIEC_VALUE_UNKNOWN)
+		return NULL;
+	if (setting->id == MSIEC_KBD_BACKLIGHT)
+		return parsed <= MSIEC_KBD_BACKLIGHT_MAX ? levels[parsed] : NULL;
+	// Read-only states such as the "custom" preset
+	if (setting->id == MSIEC_PRESET && parsed == MSIEC_PRESET_CUSTOM)
+		return NULL;
+	return msiec_value_name(setting->id, parsed);
+}
+
+// ============================================================ //
+// Validation
+// ============================================================ //
+
+static int parse(int argc, char **argv)
+{
+	struct setting *fn_key, *win_key;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		struct setting *setting;
+		char *value = strchr(argv[i], '=');
+
+		if (!value) {
+			fprintf(stderr, "msiec: expected name=value: %s\n", argv[i]);
+			return -EINVAL;
+		}
+		*value++ = '\0';
+
+		setting = setting_find(argv[i]);
+		if (!setting) {
+			fprintf(stderr, "msiec: unknown setting %s\n", argv[i]);
+			return -EINVAL;
+		}
+		if (setting->value) {
+			fprintf(stderr, "msiec: %s given twice\n", argv[i]);
+			return -EINVAL;
+		}
+		setting->value = setting_value(setting, value);
+		if (!setting->value) {
+			fprintf(stderr, "msiec: invalid value for %s: %s\n",
+				argv[i], value);
+			return -EINVAL;
+		}
+	}
+
+	// Both name the same bit: they must agree, and one write is enough
+	fn_key = setting_find("fn_key");
+	win_key = setting_find("win_key");
+	if (fn_key->value && win_key->value) {
+		if (strcmp(fn_key->value, win_key->value) == 0) {
+			fprintf(stderr, "msiec: fn_key and win_key cannot both be %s\n",
+				fn_key->value);
+			return -EINVAL;
+		}
+		win_key->follows = fn_key;
+	}
+
+	// Nothing is written if the model lacks one of the attributes
+	for (i = 0; i < (int)ARRAY_SIZE(settings); i++) {
+		if (settings[i].value && !msiec_has(ec, settings[i].id)) {
+			fprintf(stderr, "msiec: %s is not supported on this model\n",
+				msiec_attr_name(settings[i].id));
+			return -ENOENT;
+		}
+	}
+
+	return 0;
+}
+
+// ============================================================ //
+// Applying
+// ============================================================ //
+
+static void setting_apply(struct setting *setting)
+{
+	char current[MSIEC_STRING_LEN];
+	long long start = now_us();
+	int result;
+
+	setting->result = RESULT_UNCHANGED;
+	setting->error = 0;
+
+	// The current value is read after the earlier settings were applied
+	if (msiec_read_string(ec, setting->id, current, sizeof(current)) < 0 ||
+	    strcmp(current, setting->value) != 0) {
+		setting->result = RESULT_CHANGED;
+		result = msiec_write_string(ec, setting->id, setting->value);
+		if (result < 0) {
+			setting->result = RESULT_ERROR;
+			setting->error = -result;
+		}
+	}
+
+	setting->time_us = now_us() - start;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-r sysfs_root] set name=value ...\n", argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *root = MSIEC_DEFAULT_ROOT;
+	int counts[ARRAY_SIZE(result_names)] = { 0 };
+	long long start;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			root = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind + 1 >= argc || strcmp(argv[optind], "set") != 0)
+		usage(argv[0]);
+
+	ec = msiec_open(root);
+	if (!ec) {
+		fprintf(stderr, "msiec: no msi-ec attributes under %s\n", root);
+		return 2;
+	}
+
+	if (parse(argc - optind - 1, argv + optind + 1) < 0)
+		return 2;
+
+	start = now_us();
+	for (i = 0; i < ARRAY_SIZE(settings); i++) {
+		struct setting *setting = &settings[i];
+
+		if (!setting->value)
+			continue;
+
+		if (setting->follows) {
+			setting->result = setting->follows->result;
+			setting->error = setting->follows->error;
+			setting->time_us = 0;
+		} else {
+			setting_apply(setting);
+		}
+		counts[setting->result]++;
+
+		printf("name=%s value=%s result=%s time_us=%lld",
+		       msiec_attr_name(setting->id), setting->value,
+		       result_names[setting->result], setting->time_us);
+		if (setting->result == RESULT_ERROR)
+			printf(" errno=%d", setting->error);
+		printf("\n");
+	}
+
+	printf("changed=%d unchanged=%d failed=%d time_us=%lld\n",
+	       counts[RESULT_CHANGED], counts[RESULT_UNCHANGED],
+	       counts[RESULT_ERROR], now_us() - start);
+
+	msiec_close(ec);
+	return counts[RESULT_ERROR] ? 1 : 0;
+}
@@ -0,0 +1,560 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msiecd.c - Control daemon for the msi-ec driver
+ *
+ * Keeps every msi-ec attribute open through libmsiec and waits for the
+ * driver's change notifications with epoll, then serves a line protocol on a
+ * unix socket:
+ *
+ *   msiecd [-s socket] [-r sysfs_root] [-m mode]
+ *
+ *   get                  ok name=value ... (every attribute)
+ *   get <name>           ok <value>
+ *   set <name> <value>   ok | err <reason>
+ *   subscribe            ok, then "event <name> <value>" on every change
+ *   list                 ok name:rw|ro[:watch] ...
+ *
+ * Attributes the driver notifies (ac_connected, lid_open, webcam,
+ * webcam_hard_block, brightness_hw_changed) are served from a cache that is
+ * only refreshed on a notification, so idle clients cause no EC traffic.
+ * Everything else is read on request. Writes go through the daemon's open
+ * descriptor and are broadcast to subscribers, those to notified attributes
+ * (webcam) once the driver's own notification comes in.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <msiec.h>
+
+#define MSIECD_DEFAULT_SOCKET "/run/msiecd.sock"
+
+#define MSIECD_MAX_CLIENTS 32
+#define MSIECD_MAX_EVENTS 16
+#define MSIECD_LINE_LEN 256
+#define MSIECD_OUT_LEN 4096
+
+enum source_type {
+	SOURCE_LISTEN,
+	SOURCE_SIGNAL,
+	SOURCE_ATTR,
+	SOURCE_CLIENT,
+};
+
+/* First member of everything registered with epoll */
+struct source {
+	enum source_type type;
+	int fd;
+};
+
+struct attr {
+	struct source src;
+	enum msiec_attr id;
+	bool watch; /* in the epoll set */
+
+	bool cached;
+	char value[MSIEC_STRING_LEN];
+};
+
+struct client {
+	struct source src;
+	bool subscribed;
+	bool overflow; /* output was lost, the client is dropped */
+	bool closed; /* freed once the current epoll batch is done */
+	size_t in_len;
+	char in[MSIECD_LINE_LEN];
+	size_t out_len;
+	char out[MSIECD_OUT_LEN];
+};
+
+static struct msiec *ec;
+static struct attr attrs[MSIEC_ATTR_COUNT];
+
+static struct client *clients[MSIECD_MAX_CLIENTS];
+static struct client *closed_clients[MSIECD_MAX_CLIENTS];
+static int closed_count;
+static int epfd = -1;
+
+// ============================================================ //
+// Attributes
+// ============================================================ //
+
+// Reads the current value into attr->value
+static int attr_read(struct attr *attr)
+{
+	int result;
+
+	result = msiec_read_string(ec, attr->id, attr->value,
+				   sizeof(attr->value));
+	if (result < 0)
+		attr->value[0] = '\0';
+	attr->cached = result == 0 && attr->watch;
+	return result;
+}
+
+static const char *attr_get(struct attr *attr, int *result)
+{
+	*result = 0;
+	if (!attr->cached)
+		*result = attr_read(attr);
+	return attr->value;
+}
+
+static int attr_write(struct attr *attr, const char *value)
+{
+	int result;
+
+	result = msiec_write_string(ec, attr->id, value);
+	if (result < 0)
+		return result;
+	return attr_read(attr);
+}
+
+static struct attr *attr_find(const char *name)
+{
+	int id = msiec_attr_find(name);
+
+	if (id < 0 || !msiec_has(ec, id))
+		return NULL;
+	return &attrs[id];
+}
+
+static void attrs_watch(void)
+{
+	struct epoll_event ev;
+	int i;
+
+	for (i = 0; i < MSIEC_ATTR_COUNT; i++) {
+		struct attr *attr = &attrs[i];
+
+		attr->id = i;
+		attr->src.type = SOURCE_ATTR;
+		attr->src.fd = msiec_fd(ec, i);
+		if (attr->src.fd < 0 || !msiec_attr_notifies(i))
+			continue;
+
+		// sysfs_notify() shows up as EPOLLPRI; a read re-arms it
+		ev.events = EPOLLPRI | EPOLLERR;
+		ev.data.ptr = &attr->src;
+		// Regular files (a fake root) cannot be watched
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, attr->src.fd, &ev) < 0)
+			continue;
+
+		attr->watch = true;
+		attr_read(attr);
+	}
+}
+
+// ============================================================ //
+// Clients
+// ============================================================ //
+
+// Events for the client may still be pending in this epoll batch
+static void client_close(struct client *client)
+{
+	size_t i;
+
+	if (client->closed)
+		return;
+
+	for (i = 0; i < MSIECD_MAX_CLIENTS; i++)
+		if (clients[i] == client)
+			clients[i] = NULL;
+
+	close(client->src.fd);
+	client->closed = true;
+	closed_clients[closed_count++] = client;
+}
+
+static void clients_reap(void)
+{
+	while (closed_count)
+		free(closed_clients[--closed_count]);
+}
+
+// Sends what the socket takes now and waits for EPOLLOUT for the rest
+static void client_flush(struct client *client)
+{
+	struct epoll_event ev;
+	bool was_pending = client->out_len != 0;
+	ssize_t sent;
+
+	while (client->out_len) {
+		sent = send(client->src.fd, client->out, client->out_len,
+			    MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent < 0 && errno != EAGAIN && errno != EINTR) {
+			client->overflow = true;
+			return;
+		}
+		if (sent < 0)
+			break;
+		memmove(client->out, client->out + sent, client->out_len - sent);
+		client->out_len -= sent;
+	}
+
+	if (!was_pending && !client->out_len)
+		return;
+
+	ev.events = EPOLLIN | (client->out_len ? EPOLLOUT : 0);
+	ev.data.ptr = &client->src;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, client->src.fd, &ev);
+}
+
+// Queues a line, a client too slow to keep up loses its connection
+static bool client_printf(struct client *client, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static bool client_printf(struct client *client, const char *fmt, ...)
+{
+	size_t room = sizeof(client->out) - client->out_len;
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(client->out + client->out_len, room, fmt, args);
+	va_end(args);
+
+	if (len < 0 || (size_t)len >= room) {
+		client->overflow = true;
+		return false;
+	}
+
+	client->out_len += len;
+	return true;
+}
+
+static void broadcast(const struct attr *attr)
+{
+	size_t i;
+
+	for (i = 0; i < MSIECD_MAX_CLIENTS; i++) {
+		struct client *client = clients[i];
+
+		if (!client || !client->subscribed)
+			continue;
+
+		client_printf(client, "event %s %s\n", msiec_attr_name(attr->id),
+			      attr->value);
+		client_flush(client);
+		if (client->overflow)
+			client_close(client);
+	}
+}
+
+static void cmd_get_all(struct client *client)
+{
+	const char *value;
+	int i, result;
+
+	client_printf(client, "ok");
+	for (i = 0; i < MSIEC_ATTR_COUNT; i++) {
+		if (attrs[i].src.fd < 0)
+			continue;
+
+		value = attr_get(&attrs[i], &result);
+		if (result == 0 && !strchr(value, ' '))
+			client_printf(client, " %s=%s", msiec_attr_name(i), value);
+		else if (result == 0)
+			client_printf(client, " %s=\"%s\"", msiec_attr_name(i),
+				      value);
+	}
+	client_printf(client, "\n");
+}
+
+static void cmd_list(struct client *client)
+{
+	int i;
+
+	client_printf(client, "ok");
+	for (i = 0; i < MSIEC_ATTR_COUNT; i++) {
+		if (attrs[i].src.fd < 0)
+			continue;
+		client_printf(client, " %s:%s%s", msiec_attr_name(i),
+			      msiec_attr_writable(i) ? "rw" : "ro",
+			      attrs[i].watch ? ":watch" : "");
+	}
+	client_printf(client, "\n");
+}
+
+static void client_command(struct client *client, char *line)
+{
+	char *cmd, *name, *value, *save;
+	struct attr *attr;
+	const char *current;
+	int result;
+
+	cmd = strtok_r(line, " \t", &save);
+	name = strtok_r(NULL, " \t", &save);
+	value = strtok_r(NULL, "", &save);
+
+	if (!cmd) {
+		client_printf(client, "err empty command\n");
+	} else if (strcmp(cmd, "get") == 0 && !name) {
+		cmd_get_all(client);
+	} else if (strcmp(cmd, "list") == 0) {
+		cmd_list(client);
+	} else if (strcmp(cmd, "subscribe") == 0) {
+		client->subscribed = true;
+		client_printf(client, "ok\n");
+	} else if (strcmp(cmd, "get") == 0 || strcmp(cmd, "set") == 0) {
+		attr = name ? attr_find(name) : NULL;
+		if (!name) {
+			client_printf(client, "err missing attribute\n");
+		} else if (!attr) {
+			client_printf(client, "err unknown attribute %s\n", name);
+		} else if (cmd[0] == 'g') {
+			current = attr_get(attr, &result);
+			if (result < 0)
+				client_printf(client, "err %s\n", strerror(-result));
+			else
+				client_printf(client, "ok %s\n", current);
+		} else if (!value) {
+			client_printf(client, "err missing value\n");
+		} else {
+			result = attr_write(attr, value);
+			if (result < 0) {
+				client_printf(client, "err %s\n", strerror(-result));
+			} else {
+				client_printf(client, "ok\n");
+				// The driver notifies watched attributes itself
+				if (!attr->watch)
+					broadcast(attr);
+			}
+		}
+	} else {
+		client_printf(client, "err unknown command %s\n", cmd);
+	}
+}
+
+static void client_input(struct client *client)
+{
+	char *line, *end;
+	ssize_t len;
+
+	len = recv(client->src.fd, client->in + client->in_len,
+		   sizeof(client->in) - client->in_len - 1, MSG_DONTWAIT);
+	if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+		client_close(client);
+		return;
+	}
+	if (len < 0)
+		return;
+
+	client->in_len += len;
+	client->in[client->in_len] = '\0';
+
+	line = client->in;
+	while ((end = strchr(line, '\n'))) {
+		*end = '\0';
+		if (end > line && end[-1] == '\r')
+			end[-1] = '\0';
+		client_command(client, line);
+		line = end + 1;
+	}
+
+	client->in_len -= line - client->in;
+	memmove(client->in, line, client->in_len);
+
+	// A line longer than the buffer can never complete
+	if (client->in_len == sizeof(client->in) - 1) {
+		client_printf(client, "err line too long\n");
+		client->in_len = 0;
+	}
+
+	client_flush(client);
+	if (client->overflow)
+		client_close(client);
+}
+
+static void client_accept(int listen_fd)
+{
+	struct epoll_event ev;
+	struct client *client;
+	size_t i;
+	int fd;
+
+	fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	for (i = 0; i < MSIECD_MAX_CLIENTS && clients[i]; i++)
+		;
+	client = i < MSIECD_MAX_CLIENTS ? calloc(1, sizeof(*client)) : NULL;
+	if (!client) {
+		close(fd);
+		return;
+	}
+
+	client->src.type = SOURCE_CLIENT;
+	client->src.fd = fd;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &client->src;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		close(fd);
+		free(client);
+		return;
+	}
+
+	clients[i] = client;
+}
+
+// ============================================================ //
+// Main loop
+// ============================================================ //
+
+static int listen_unix(const char *path, mode_t mode)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "msiecd: socket path too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    chmod(path, mode) < 0 || listen(fd, 8) < 0) {
+		perror("msiecd: socket");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-s socket] [-r sysfs_root] [-m mode]\n",
+		argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *socket_path = MSIECD_DEFAULT_SOCKET;
+	const char *root = MSIEC_DEFAULT_ROOT;
+	struct epoll_event events[MSIECD_MAX_EVENTS];
+	struct source listen_src = { SOURCE_LISTEN, -1 };
+	struct source signal_src = { SOURCE_SIGNAL, -1 };
+	struct epoll_event ev;
+	mode_t mode = 0660;
+	sigset_t mask;
+	bool running = true;
+	int count, i, opt;
+
+	while ((opt = getopt(argc, argv, "s:r:m:")) != -1) {
+		switch (opt) {
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'r':
+			root = optarg;
+			break;
+		case 'm':
+			mode = strtoul(optarg, NULL, 8);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		perror("msiecd: epoll");
+		return 1;
+	}
+
+	ec = msiec_open(root);
+	if (!ec) {
+		fprintf(stderr, "msiecd: no msi-ec attributes under %s\n", root);
+		return 1;
+	}
+	attrs_watch();
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	signal_src.fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	listen_src.fd = listen_unix(socket_path, mode);
+	if (listen_src.fd < 0 || signal_src.fd < 0)
+		return 1;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &listen_src;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, listen_src.fd, &ev);
+	ev.data.ptr = &signal_src;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, signal_src.fd, &ev);
+
+	while (running) {
+		count = epoll_wait(epfd, events, MSIECD_MAX_EVENTS, -1);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count < 0) {
+			perror("msiecd: epoll_wait");
+			break;
+		}
+
+		for (i = 0; i < count; i++) {
+			struct source *src = events[i].data.ptr;
+			struct client *client;
+			struct attr *attr;
+
+			switch (src->type) {
+			case SOURCE_LISTEN:
+				client_accept(src->fd);
+				break;
+			case SOURCE_SIGNAL:
+				running = false;
+				break;
+			case SOURCE_ATTR:
+				attr = (struct attr *)src;
+				if (attr_read(attr) == 0)
+					broadcast(attr);
+				break;
+			case SOURCE_CLIENT:
+				client = (struct client *)src;
+				if (!client->closed && (events[i].events & EPOLLOUT))
+					client_flush(client);
+				if (!client->closed && (events[i].events & ~EPOLLOUT))
+					client_input(client);
+				if (!client->closed && client->overflow)
+					client_close(client);
+				break;
+			}
+		}
+
+		clients_reap();
+	}
+
+	for (i = 0; i < MSIECD_MAX_CLIENTS; i++)
+		if (clients[i])
+			client_close(clients[i]);
+	clients_reap();
+	unlink(socket_path);
+	msiec_close(ec);
+	return 0;
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+ * kunit/static_stub.h - KUnit static stubs, for userspace
+ *
+ * A function that starts with KUNIT_STATIC_STUB_REDIRECT() calls the
+ * replacement activated by the running test case instead. Stubs are
+ * deactivated when the case ends.
+ */
+
+#ifndef __MSI_EC_KSHIM_KUNIT_STATIC_STUB__
+#define __MSI_EC_KSHIM_KUNIT_STATIC_STUB__
+
+#include <kshim.h>
+
+struct kunit;
+
+void *kunit_static_stub_address(void *real_fn_addr);
+void __kunit_activate_static_stub(struct kunit *test, void *real_fn_addr,
+				  void *replacement_addr);
+
+#define KUNIT_STATIC_STUB_REDIRECT(real_fn_name, args...)                   \
+	do {                                                                 \
+		__typeof__(&real_fn_name) __replacement =                    \
+			kunit_static_stub_address((void *)&real_fn_name);    \
+		if (__replacement)                                           \
+			return __replacement(args);                          \
+	} while (0)
+
+#define kunit_activate_static_stub(test, real_fn_addr, replacement_addr)      \
+	do {                                                                   \
+		__typeof__(&real_fn_addr) __checked = (replacement_addr);      \
+		__kunit_activate_static_stub(test, (void *)&real_fn_addr,      \
+					     (void *)__checked);               \
+	} while (0)
+
+#endif // __MSI_EC_KSHIM_KUNIT_STATIC_STUB__
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+ * kunit/test.h - The subset of KUnit used by msi-ec-test.c, for userspace
+ *
+ * Suites register themselves at startup; kunit_run_all() runs them and
+ * prints KTAP-style results. Failed assertions abort the case with longjmp.
+ */
+
+#ifndef __MSI_EC_KSHIM_KUNIT__
+#define __MSI_EC_KSHIM_KUNIT__
+
+#include <kshim.h>
+
+#include <setjmp.h>
+
+#define KUNIT_MAX_ALLOCS 32
+
+struct kunit {
+	const char *name;
+	bool failed;
+	void *priv;
+	jmp_buf abort;
+	void *allocs[KUNIT_MAX_ALLOCS];
+	int alloc_count;
+};
+
+struct kunit_case {
+	void (*run_case)(struct kunit *test);
+	const char *name;
+};
+
+struct kunit_suite {
+	const char *name;
+	int (*init)(struct kunit *test);
+	void (*exit)(struct kunit *test);
+	struct kunit_case *test_cases;
+};
+
+#define KUNIT_CASE(fn) { .run_case = fn, .name = #fn }
+
+void kunit_register_suite(struct kunit_suite *suite);
+int kunit_run_all(void);
+
+#define kunit_test_suite(suite)                                              \
+	static void __attribute__((constructor)) __kunit_register_##suite(void) \
+	{                                                                    \
+		kunit_register_suite(&suite);                                \
+	}
+
+void *kunit_kzalloc(struct kunit *test, size_t size, gfp_t gfp);
+
+void kunit_fail(struct kunit *test, bool fatal, const char *file, int line,
+		const char *fmt, ...) __attribute__((format(printf, 5, 6)));
+
+#define kunit_info(test, fmt, ...) printf("    # %s: " fmt, (test)->name, ##__VA_ARGS__)
+
+#define KUNIT_BINARY(test, fatal, left, op, right, fmt, ...)                    \
+	do {                                                                  \
+		long long __left = (long long)(left);                         \
+		long long __right = (long long)(right);                       \
+		if (!(__left op __right))                                     \
+			kunit_fail(test, fatal, __FILE__, __LINE__,           \
+				   "%s " #op " %s (%lld vs %lld) " fmt, #left, \
+				   #right, __left, __right, ##__VA_ARGS__);  \
+	} while (0)
+
+#define KUNIT_EXPECT_EQ(test, l, r) KUNIT_BINARY(test, FALSE, l, ==, r, "")
+#define KUNIT_EXPECT_LT(test, l, r) KUNIT_BINARY(test, FALSE, l, <, r, "")
+#define KUNIT_EXPECT_LE(test, l, r) KUNIT_BINARY(test, FALSE, l, <=, r, "")
+#define KUNIT_EXPECT_GT(test, l, r) KUNIT_BINARY(test, FALSE, l, >, r, "")
+#define KUNIT_EXPECT_GE(test, l, r) KUNIT_BINARY(test, FALSE, l, >=, r, "")
+#define KUNIT_EXPECT_EQ_MSG(test, l, r, fmt, ...) \
+	KUNIT_BINARY(test, FALSE, l, ==, r, fmt, ##__VA_ARGS__)
+#define KUNIT_EXPECT_LE_MSG(test, l, r, fmt, ...) \
+	KUNIT_BINARY(test, FALSE, l, <=, r, fmt, ##__VA_ARGS__)
+#define KUNIT_EXPECT_NE_MSG(test, l, r, fmt, ...) \
+	KUNIT_BINARY(test, FALSE, l, !=, r, fmt, ##__VA_ARGS__)
+#define KUNIT_EXPECT_TRUE(test, cond) KUNIT_BINARY(test, FALSE, !!(cond), ==, 1, "")
+#define KUNIT_EXPECT_FALSE(test, cond) KUNIT_BINARY(test, FALSE, !!(cond), ==, 0, "")
+#define KUNIT_ASSERT_EQ(test, l, r) KUNIT_BINARY(test, TRUE, l, ==, r, "")
+#define KUNIT_ASSERT_TRUE(test, cond) KUNIT_BINARY(test, TRUE, !!(cond), ==, 1, "")
+#define KUNIT_ASSERT_NOT_NULL(test, ptr) \
+	KUNIT_BINARY(test, TRUE, (ptr) != NULL, ==, 1, "")
+
+#define KUNIT_EXPECT_STREQ(test, l, r)                                        \
+	do {                                                                  \
+		const char *__left = (l);                                     \
+		const char *__right = (r);                                    \
+		if (strcmp(__left, __right) != 0)                             \
+			kunit_fail(test, FALSE, __FILE__, __LINE__,           \
+				   "%s == %s (\"%s\" vs \"%s\")", #l, #r,      \
+				   __left, __right);                          \
+	} while (0)
+
+#endif // __MSI_EC_KSHIM_KUNIT__
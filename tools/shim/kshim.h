@@ -0,0 +1,551 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+ * kshim.h - Minimal userspace stand-ins for the kernel APIs used by msi-ec.c
+ *
+ * Just enough of <linux/...> to compile the driver unmodified as part of a
+ * userspace program. EC transactions go to the simulated EC in sim_ec.c,
+ * sysfs groups and LED class devices are recorded so that tools can drive
+ * the handlers directly (see shim.h).
+ */
+
+#ifndef __MSI_EC_KSHIM__
+#define __MSI_EC_KSHIM__
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef uint16_t __le16;
+typedef uint32_t __le32;
+typedef unsigned short umode_t;
+
+#define TRUE 1
+#define FALSE 0
+
+/* The shim provides ec_read()/ec_write(), as the ACPI EC driver would */
+#define CONFIG_ACPI 1
+
+/* Kernel version the shim's APIs follow */
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 8, 0)
+
+#define __ARG_PLACEHOLDER_1 0,
+#define __take_second_arg(__ignored, val, ...) val
+#define __is_defined(x) ___is_defined(x)
+#define ___is_defined(val) ____is_defined(__ARG_PLACEHOLDER_##val)
+#define ____is_defined(arg1_or_junk) __take_second_arg(arg1_or_junk 1, 0)
+#define IS_ENABLED(option) __is_defined(option)
+
+#define __init
+#define __exit
+#define __packed __attribute__((packed))
+#define __read_mostly
+#define __maybe_unused __attribute__((unused))
+#define __user
+
+#define BIT(n) (1UL << (n))
+#define min(x, y)                        \
+	({                               \
+		__typeof__(x) __x = (x); \
+		__typeof__(y) __y = (y); \
+		__x < __y ? __x : __y;   \
+	})
+#define max(x, y)                        \
+	({                               \
+		__typeof__(x) __x = (x); \
+		__typeof__(y) __y = (y); \
+		__x > __y ? __x : __y;   \
+	})
+#define min_t(type, x, y) min((type)(x), (type)(y))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define sizeof_field(type, member) sizeof(((type *)0)->member)
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#define READ_ONCE(x) (*(volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val) (*(volatile __typeof__(x) *)&(x) = (val))
+
+#define le16_to_cpu(x) ((u16)(x))
+#define le32_to_cpu(x) ((u32)(x))
+#define cpu_to_le16(x) ((__le16)(x))
+#define cpu_to_le32(x) ((__le32)(x))
+
+#define PAGE_SIZE 4096
+
+#define WARN_ON(cond)                                                 \
+	({                                                            \
+		bool __c = !!(cond);                                  \
+		if (__c)                                              \
+			fprintf(stderr, "WARN_ON(%s) at %s:%d\n", #cond, \
+				__FILE__, __LINE__);                  \
+		__c;                                                  \
+	})
+
+// ============================================================ //
+// Atomics
+// ============================================================ //
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+#define ATOMIC_INIT(i) { (i) }
+#define atomic_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_SEQ_CST)
+#define atomic_set(v, i) __atomic_store_n(&(v)->counter, i, __ATOMIC_SEQ_CST)
+#define atomic_inc(v) __atomic_fetch_add(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec(v) __atomic_fetch_sub(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_or(i, v) __atomic_fetch_or(&(v)->counter, i, __ATOMIC_SEQ_CST)
+#define atomic_xchg(v, i) __atomic_exchange_n(&(v)->counter, i, __ATOMIC_SEQ_CST)
+
+// ============================================================ //
+// Memory and time
+// ============================================================ //
+
+typedef unsigned int gfp_t;
+#define GFP_KERNEL 0
+
+#define kzalloc(size, gfp) calloc(1, size)
+#define kmalloc(size, gfp) malloc(size)
+#define kfree(ptr) free(ptr)
+
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC 1000000000ULL
+
+u64 ktime_get_ns(void);
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+typedef s64 time64_t;
+
+// Seconds since the epoch of a UTC date, as the kernel's mktime64()
+static inline time64_t mktime64(unsigned int year, unsigned int mon,
+				unsigned int day, unsigned int hour,
+				unsigned int min, unsigned int sec)
+{
+	// Counting from March, so the leap day ends the year
+	if ((int)(mon -= 2) <= 0) {
+		mon += 12;
+		year -= 1;
+	}
+
+	return ((((time64_t)(year / 4 - year / 100 + year / 400 +
+			     367 * mon / 12 + day) +
+		  year * 365 - 719499) * 24 + hour) * 60 + min) * 60 + sec;
+}
+
+// ============================================================ //
+// Strings
+// ============================================================ //
+
+bool sysfs_streq(const char *s1, const char *s2);
+int __sysfs_match_string(const char *const *array, size_t n, const char *str);
+#define sysfs_match_string(_a, _s) __sysfs_match_string(_a, ARRAY_SIZE(_a), _s)
+int kstrtouint(const char *s, unsigned int base, unsigned int *res);
+
+// ============================================================ //
+// Workqueues
+// ============================================================ //
+
+/* One worker thread runs all work items in order */
+struct work_struct {
+	void (*func)(struct work_struct *work);
+	struct work_struct *next;
+	bool pending;
+};
+
+#define DECLARE_WORK(n, f) struct work_struct n = { .func = f }
+#define INIT_WORK(w, f)                  \
+	do {                             \
+		(w)->func = (f);         \
+		(w)->next = NULL;        \
+		(w)->pending = FALSE;    \
+	} while (0)
+
+bool schedule_work(struct work_struct *work);
+bool cancel_work_sync(struct work_struct *work);
+bool flush_work(struct work_struct *work);
+
+// ============================================================ //
+// Modules
+// ============================================================ //
+
+#define THIS_MODULE NULL
+#define MODULE_LICENSE(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_VERSION(x)
+#define MODULE_PARM_DESC(name, desc)
+#define module_param(name, type, perm)
+#define EXPORT_SYMBOL_GPL(sym)
+
+#define module_init(fn)                  \
+	int shim_module_init(void)       \
+	{                                \
+		return fn();             \
+	}
+#define module_exit(fn)                  \
+	void shim_module_exit(void)      \
+	{                                \
+		fn();                    \
+	}
+
+// ============================================================ //
+// Logging
+// ============================================================ //
+
+extern int shim_log_level;
+
+#define shim_log(level, ...)                          \
+	do {                                          \
+		if ((level) <= shim_log_level)        \
+			fprintf(stderr, __VA_ARGS__); \
+	} while (0)
+
+#define pr_err(...) shim_log(3, __VA_ARGS__)
+#define pr_warn(...) shim_log(4, __VA_ARGS__)
+#define pr_info(...) shim_log(6, __VA_ARGS__)
+#define pr_debug(...) shim_log(7, __VA_ARGS__)
+#define dev_err(dev, ...) pr_err(__VA_ARGS__)
+#define dev_warn(dev, ...) pr_warn(__VA_ARGS__)
+#define dev_info(dev, ...) pr_info(__VA_ARGS__)
+#define dev_dbg(dev, ...) pr_debug(__VA_ARGS__)
+
+// ============================================================ //
+// Locking
+// ============================================================ //
+
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define DEFINE_MUTEX(name) struct mutex name = { PTHREAD_MUTEX_INITIALIZER }
+#define mutex_init(m) pthread_mutex_init(&(m)->lock, NULL)
+#define mutex_lock(m) pthread_mutex_lock(&(m)->lock)
+#define mutex_unlock(m) pthread_mutex_unlock(&(m)->lock)
+
+/* wait_event() rechecks the condition under the queue's lock */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} wait_queue_head_t;
+
+#define DECLARE_WAIT_QUEUE_HEAD(name) \
+	wait_queue_head_t name = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER }
+#define wait_event(wq, condition)                                  \
+	do {                                                       \
+		pthread_mutex_lock(&(wq).lock);                    \
+		while (!(condition))                               \
+			pthread_cond_wait(&(wq).cond, &(wq).lock); \
+		pthread_mutex_unlock(&(wq).lock);                  \
+	} while (0)
+#define wake_up_all(wq)                               \
+	do {                                          \
+		pthread_mutex_lock(&(wq)->lock);      \
+		pthread_cond_broadcast(&(wq)->cond);  \
+		pthread_mutex_unlock(&(wq)->lock);    \
+	} while (0)
+
+// ============================================================ //
+// Devices and sysfs
+// ============================================================ //
+
+struct kobject {
+	const char *name;
+};
+
+struct attribute {
+	const char *name;
+	umode_t mode;
+};
+
+struct attribute_group {
+	const char *name;
+	umode_t (*is_visible)(struct kobject *kobj, struct attribute *attr,
+			      int idx);
+	struct attribute **attrs;
+};
+
+struct device;
+
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count);
+};
+
+#define __ATTR(_name, _mode, _show, _store)                              \
+	{                                                                \
+		.attr = { .name = #_name, .mode = _mode }, .show = _show, \
+		.store = _store,                                         \
+	}
+
+#define DEVICE_ATTR_RW(_name)                       \
+	struct device_attribute dev_attr_##_name =  \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+#define DEVICE_ATTR_RO(_name) \
+	struct device_attribute dev_attr_##_name = \
+		__ATTR(_name, 0444, _name##_show, NULL)
+
+struct dev_pm_ops {
+	int (*suspend)(struct device *dev);
+	int (*resume)(struct device *dev);
+};
+
+#define SIMPLE_DEV_PM_OPS(name, suspend_fn, resume_fn)      \
+	const struct dev_pm_ops name = { .suspend = suspend_fn, \
+					 .resume = resume_fn }
+
+enum probe_type {
+	PROBE_DEFAULT_STRATEGY,
+	PROBE_PREFER_ASYNCHRONOUS,
+	PROBE_FORCE_SYNCHRONOUS,
+};
+
+struct device_driver {
+	const char *name;
+	const struct dev_pm_ops *pm;
+	const struct attribute_group **dev_groups;
+	enum probe_type probe_type;
+};
+
+#define UEVENT_NUM_ENVP 64
+#define UEVENT_BUFFER_SIZE 2048
+
+struct kobj_uevent_env {
+	char *envp[UEVENT_NUM_ENVP];
+	int envp_idx;
+	char buf[UEVENT_BUFFER_SIZE];
+	int buflen;
+};
+
+int add_uevent_var(struct kobj_uevent_env *env, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+
+struct device_type {
+	const char *name;
+	int (*uevent)(const struct device *dev, struct kobj_uevent_env *env);
+};
+
+struct device {
+	struct kobject kobj;
+	const struct device_type *type;
+	struct device_driver *driver;
+	void *driver_data;
+};
+
+void sysfs_notify(struct kobject *kobj, const char *dir, const char *attr);
+int sysfs_create_groups(struct kobject *kobj,
+			const struct attribute_group **groups);
+void sysfs_remove_groups(struct kobject *kobj,
+			 const struct attribute_group **groups);
+
+struct platform_device {
+	const char *name;
+	int id;
+	struct device dev;
+};
+
+struct platform_driver {
+	int (*probe)(struct platform_device *pdev);
+	int (*remove)(struct platform_device *pdev);
+	struct device_driver driver;
+};
+
+int platform_driver_register(struct platform_driver *drv);
+void platform_driver_unregister(struct platform_driver *drv);
+struct platform_device *platform_device_alloc(const char *name, int id);
+int platform_device_add(struct platform_device *pdev);
+void platform_device_put(struct platform_device *pdev);
+void platform_device_del(struct platform_device *pdev);
+void platform_device_unregister(struct platform_device *pdev);
+
+// ============================================================ //
+// debugfs
+// ============================================================ //
+
+/* seq_printf() output goes to buf, tools call the show function directly */
+struct seq_file {
+	char *buf;
+	size_t size;
+	size_t count;
+};
+
+void seq_printf(struct seq_file *m, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+struct file_operations {
+	int (*show)(struct seq_file *m, void *v);
+};
+
+#define DEFINE_SHOW_ATTRIBUTE(__name)                                   \
+	static const struct file_operations __name##_fops = {          \
+		.show = __name##_show,                                 \
+	}
+
+/* Nothing is created, the files only exist in the kernel */
+struct dentry;
+
+static inline struct dentry *debugfs_create_dir(const char *name,
+						struct dentry *parent)
+{
+	return NULL;
+}
+static inline struct dentry *
+debugfs_create_file(const char *name, umode_t mode, struct dentry *parent,
+		    void *data, const struct file_operations *fops)
+{
+	return NULL;
+}
+static inline void debugfs_remove_recursive(struct dentry *dentry) { }
+
+// ============================================================ //
+// LEDs
+// ============================================================ //
+
+enum led_brightness {
+	LED_OFF = 0,
+	LED_ON = 1,
+	LED_HALF = 127,
+	LED_FULL = 255,
+};
+
+#define LED_RETAIN_AT_SHUTDOWN BIT(18)
+#define LED_BRIGHT_HW_CHANGED BIT(21)
+
+struct led_classdev {
+	const char *name;
+	unsigned int brightness;
+	unsigned int max_brightness;
+	unsigned long flags;
+	int (*brightness_set_blocking)(struct led_classdev *led_cdev,
+				       enum led_brightness brightness);
+	enum led_brightness (*brightness_get)(struct led_classdev *led_cdev);
+	const char *default_trigger;
+	struct device *dev;
+	int brightness_hw_changed;
+};
+
+int led_classdev_register(struct device *parent, struct led_classdev *led_cdev);
+void led_classdev_unregister(struct led_classdev *led_cdev);
+int devm_led_classdev_register(struct device *parent,
+			       struct led_classdev *led_cdev);
+int led_set_brightness_sync(struct led_classdev *led_cdev, unsigned int value);
+void led_classdev_notify_brightness_hw_changed(struct led_classdev *led_cdev,
+					       unsigned int brightness);
+
+// ============================================================ //
+// ACPI EC, DMI, firmware loading, crc32
+// ============================================================ //
+
+extern int acpi_disabled;
+
+typedef void *acpi_handle;
+typedef u32 acpi_status;
+
+#define AE_OK 0
+#define AE_NOT_EXIST 6
+#define ACPI_FAILURE(status) ((status) != AE_OK)
+#define ACPI_DEVICE_NOTIFY 0x2
+
+struct acpi_device {
+	acpi_handle handle;
+};
+
+struct acpi_bus_event {
+	const char *device_class;
+	const char *bus_id;
+	u32 type;
+	u32 data;
+};
+
+#define NOTIFY_DONE 0x0000
+
+struct notifier_block {
+	int (*notifier_call)(struct notifier_block *nb, unsigned long action,
+			     void *data);
+};
+
+/* There is no ACPI namespace in userspace; registration always succeeds */
+static inline int register_acpi_notifier(struct notifier_block *nb) { return 0; }
+static inline int unregister_acpi_notifier(struct notifier_block *nb) { return 0; }
+static inline int acpi_lid_notifier_register(struct notifier_block *nb) { return 0; }
+static inline int acpi_lid_notifier_unregister(struct notifier_block *nb) { return 0; }
+static inline struct acpi_device *
+acpi_dev_get_first_match_dev(const char *hid, const char *uid, s64 hrv)
+{
+	return NULL;
+}
+static inline void acpi_dev_put(struct acpi_device *adev) { }
+static inline acpi_status
+acpi_install_notify_handler(acpi_handle handle, u32 type,
+			    void (*handler)(acpi_handle, u32, void *),
+			    void *context)
+{
+	return AE_NOT_EXIST;
+}
+static inline acpi_status
+acpi_remove_notify_handler(acpi_handle handle, u32 type,
+			   void (*handler)(acpi_handle, u32, void *))
+{
+	return AE_NOT_EXIST;
+}
+
+int ec_read(u8 addr, u8 *val);
+int ec_write(u8 addr, u8 val);
+
+enum dmi_field {
+	DMI_NONE,
+	DMI_SYS_VENDOR,
+	DMI_PRODUCT_NAME,
+	DMI_BOARD_NAME,
+	DMI_STRING_MAX,
+};
+
+struct dmi_strmatch {
+	unsigned char slot;
+	char substr[79];
+};
+
+struct dmi_system_id {
+	int (*callback)(const struct dmi_system_id *);
+	const char *ident;
+	struct dmi_strmatch matches[4];
+	void *driver_data;
+};
+
+#define DMI_MATCH(a, b) { .slot = a, .substr = b }
+
+int dmi_check_system(const struct dmi_system_id *list);
+
+struct firmware {
+	size_t size;
+	const u8 *data;
+};
+
+int request_firmware_direct(const struct firmware **fw, const char *name,
+			    struct device *device);
+void release_firmware(const struct firmware *fw);
+
+u32 crc32_le(u32 crc, const unsigned char *p, size_t len);
+
+#endif // __MSI_EC_KSHIM__
@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <kunit/static_stub.h>
+#include <kunit/test.h>
+
+#include <stdarg.h>
+#include <time.h>
+
+#define KUNIT_MAX_SUITES 8
+#define KUNIT_MAX_STUBS 8
+
+static struct kunit_suite *suites[KUNIT_MAX_SUITES];
+static int suite_count;
+
+static struct {
+	void *real;
+	void *replacement;
+} stubs[KUNIT_MAX_STUBS];
+
+u64 ktime_get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void kunit_register_suite(struct kunit_suite *suite)
+{
+	if (suite_count < KUNIT_MAX_SUITES)
+		suites[suite_count++] = suite;
+}
+
+void *kunit_kzalloc(struct kunit *test, size_t size, gfp_t gfp)
+{
+	void *ptr;
+
+	if (test->alloc_count == KUNIT_MAX_ALLOCS)
+		return NULL;
+
+	ptr = calloc(1, size);
+	if (ptr)
+		test->allocs[test->alloc_count++] = ptr;
+	return ptr;
+}
+
+void *kunit_static_stub_address(void *real_fn_addr)
+{
+	int i;
+
+	for (i = 0; i < KUNIT_MAX_STUBS; i++)
+		if (stubs[i].real == real_fn_addr)
+			return stubs[i].replacement;
+	return NULL;
+}
+
+void __kunit_activate_static_stub(struct kunit *test, void *real_fn_addr,
+				  void *replacement_addr)
+{
+	int i;
+
+	for (i = 0; i < KUNIT_MAX_STUBS; i++) {
+		if (!stubs[i].real || stubs[i].real == real_fn_addr) {
+			stubs[i].real = real_fn_addr;
+			stubs[i].replacement = replacement_addr;
+			return;
+		}
+	}
+
+	kunit_fail(test, TRUE, __FILE__, __LINE__, "too many static stubs");
+}
+
+void kunit_fail(struct kunit *test, bool fatal, const char *file, int line,
+		const char *fmt, ...)
+{
+	va_list args;
+
+	printf("    # %s: EXPECTATION FAILED at %s:%d\n    # ", test->name,
+	       file, line);
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	printf("\n");
+
+	test->failed = TRUE;
+	if (fatal)
+		longjmp(test->abort, 1);
+}
+
+static bool run_case(struct kunit_suite *suite, struct kunit_case *c)
+{
+	struct kunit test = { .name = c->name };
+	int i;
+
+	if (suite->init && suite->init(&test) != 0)
+		return FALSE;
+
+	if (setjmp(test.abort) == 0)
+		c->run_case(&test);
+
+	if (suite->exit)
+		suite->exit(&test);
+	memset(stubs, 0, sizeof(stubs));
+
+	for (i = 0; i < test.alloc_count; i++)
+		free(test.allocs[i]);
+
+	return !test.failed;
+}
+
+int kunit_run_all(void)
+{
+	struct kunit_case *c;
+	int failures = 0;
+	int s, n;
+
+	printf("KTAP version 1\n1..%d\n", suite_count);
+
+	for (s = 0; s < suite_count; s++) {
+		for (n = 0; suites[s]->test_cases[n].run_case; n++)
+			;
+		printf("    # Subtest: %s\n    1..%d\n", suites[s]->name, n);
+
+		n = 0;
+		for (c = suites[s]->test_cases; c->run_case; c++) {
+			bool ok = run_case(suites[s], c);
+
+			printf("    %s %d %s\n", ok ? "ok" : "not ok", ++n,
+			       c->name);
+			failures += !ok;
+		}
+
+		printf("%s %d %s\n", failures ? "not ok" : "ok", s + 1,
+		       suites[s]->name);
+	}
+
+	return failures;
+}
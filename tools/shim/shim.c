@@ -0,0 +1,674 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * shim.c - Userspace implementations of the kernel APIs declared in kshim.h
+ */
+
+#include "shim.h"
+
+#include <stdarg.h>
+
+#define SHIM_MAX_DRIVERS 4
+#define SHIM_MAX_GROUPS 8
+#define SHIM_MAX_LEDS 8
+#define SHIM_MAX_DEVRES 16
+
+int shim_log_level = 4;
+int acpi_disabled;
+
+static struct platform_driver *drivers[SHIM_MAX_DRIVERS];
+
+static struct {
+	struct kobject *kobj;
+	const struct attribute_group **groups;
+} sysfs_groups[SHIM_MAX_GROUPS];
+
+static struct led_classdev *leds[SHIM_MAX_LEDS];
+
+static struct {
+	struct device *dev;
+	void (*release)(void *data);
+	void *data;
+} devres[SHIM_MAX_DEVRES];
+
+static const char *dmi_strings[DMI_STRING_MAX];
+static const char *firmware_dir;
+
+// ============================================================ //
+// Strings
+// ============================================================ //
+
+bool sysfs_streq(const char *s1, const char *s2)
+{
+	while (*s1 && *s1 == *s2) {
+		s1++;
+		s2++;
+	}
+
+	if (*s1 == *s2)
+		return TRUE;
+	if (!*s1 && *s2 == '\n' && !s2[1])
+		return TRUE;
+	if (*s1 == '\n' && !s1[1] && !*s2)
+		return TRUE;
+	return FALSE;
+}
+
+int __sysfs_match_string(const char *const *array, size_t n, const char *str)
+{
+	size_t index;
+
+	for (index = 0; index < n; index++) {
+		if (!array[index])
+			break;
+		if (sysfs_streq(array[index], str))
+			return index;
+	}
+
+	return -EINVAL;
+}
+
+int kstrtouint(const char *s, unsigned int base, unsigned int *res)
+{
+	unsigned long value;
+	char *end;
+
+	if (!*s || *s == '-' || *s == '+' || isspace((unsigned char)*s))
+		return -EINVAL;
+
+	errno = 0;
+	value = strtoul(s, &end, base);
+	if (errno || value > 0xffffffffUL)
+		return -ERANGE;
+	if (end == s || (*end == '\n' && end[1]) || (*end && *end != '\n'))
+		return -EINVAL;
+
+	*res = value;
+	return 0;
+}
+
+// ============================================================ //
+// Workqueues
+// ============================================================ //
+
+static pthread_mutex_t wq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wq_cond = PTHREAD_COND_INITIALIZER;
+static struct work_struct *wq_head, *wq_tail;
+static struct work_struct *wq_running;
+static bool wq_started;
+
+static void *wq_worker(void *arg)
+{
+	struct work_struct *work;
+
+	pthread_mutex_lock(&wq_lock);
+	for (;;) {
+		while (wq_head == NULL)
+			pthread_cond_wait(&wq_cond, &wq_lock);
+
+		work = wq_head;
+		wq_head = work->next;
+		if (wq_head == NULL)
+			wq_tail = NULL;
+		work->next = NULL;
+		work->pending = FALSE;
+		wq_running = work;
+
+		pthread_mutex_unlock(&wq_lock);
+		work->func(work);
+		pthread_mutex_lock(&wq_lock);
+
+		wq_running = NULL;
+		pthread_cond_broadcast(&wq_cond);
+	}
+
+	return NULL;
+}
+
+bool schedule_work(struct work_struct *work)
+{
+	pthread_t thread;
+
+	pthread_mutex_lock(&wq_lock);
+	if (!wq_started) {
+		pthread_create(&thread, NULL, wq_worker, NULL);
+		pthread_detach(thread);
+		wq_started = TRUE;
+	}
+
+	if (work->pending) {
+		pthread_mutex_unlock(&wq_lock);
+		return FALSE;
+	}
+
+	work->pending = TRUE;
+	work->next = NULL;
+	if (wq_tail)
+		wq_tail->next = work;
+	else
+		wq_head = work;
+	wq_tail = work;
+
+	pthread_cond_broadcast(&wq_cond);
+	pthread_mutex_unlock(&wq_lock);
+	return TRUE;
+}
+
+// Called with wq_lock held
+static bool wq_dequeue(struct work_struct *work)
+{
+	struct work_struct **link;
+	struct work_struct *prev = NULL;
+
+	if (!work->pending)
+		return FALSE;
+
+	for (link = &wq_head; *link; prev = *link, link = &(*link)->next) {
+		if (*link != work)
+			continue;
+		*link = work->next;
+		if (wq_tail == work)
+			wq_tail = prev;
+		break;
+	}
+
+	work->next = NULL;
+	work->pending = FALSE;
+	return TRUE;
+}
+
+bool cancel_work_sync(struct work_struct *work)
+{
+	bool was_pending;
+
+	pthread_mutex_lock(&wq_lock);
+	was_pending = wq_dequeue(work);
+	while (wq_running == work)
+		pthread_cond_wait(&wq_cond, &wq_lock);
+	pthread_mutex_unlock(&wq_lock);
+
+	return was_pending;
+}
+
+bool flush_work(struct work_struct *work)
+{
+	bool waited = FALSE;
+
+	pthread_mutex_lock(&wq_lock);
+	while (work->pending || wq_running == work) {
+		pthread_cond_wait(&wq_cond, &wq_lock);
+		waited = TRUE;
+	}
+	pthread_mutex_unlock(&wq_lock);
+
+	return waited;
+}
+
+void shim_flush_workqueue(void)
+{
+	pthread_mutex_lock(&wq_lock);
+	while (wq_head || wq_running)
+		pthread_cond_wait(&wq_cond, &wq_lock);
+	pthread_mutex_unlock(&wq_lock);
+}
+
+// ============================================================ //
+// Sysfs
+// ============================================================ //
+
+void sysfs_notify(struct kobject *kobj, const char *dir, const char *attr)
+{
+	pr_debug("shim: sysfs_notify %s/%s\n", kobj->name ? kobj->name : "?",
+		 attr);
+}
+
+int add_uevent_var(struct kobj_uevent_env *env, const char *format, ...)
+{
+	va_list args;
+	int len;
+
+	if (env->envp_idx >= UEVENT_NUM_ENVP)
+		return -ENOMEM;
+
+	va_start(args, format);
+	len = vsnprintf(env->buf + env->buflen,
+			sizeof(env->buf) - env->buflen, format, args);
+	va_end(args);
+
+	if (len >= (int)sizeof(env->buf) - env->buflen)
+		return -ENOMEM;
+
+	env->envp[env->envp_idx++] = env->buf + env->buflen;
+	env->buflen += len + 1;
+	return 0;
+}
+
+int sysfs_create_groups(struct kobject *kobj,
+			const struct attribute_group **groups)
+{
+	int i;
+
+	for (i = 0; i < SHIM_MAX_GROUPS; i++) {
+		if (sysfs_groups[i].kobj == NULL) {
+			sysfs_groups[i].kobj = kobj;
+			sysfs_groups[i].groups = groups;
+			return 0;
+		}
+	}
+
+	return -ENOMEM;
+}
+
+void sysfs_remove_groups(struct kobject *kobj,
+			 const struct attribute_group **groups)
+{
+	int i;
+
+	for (i = 0; i < SHIM_MAX_GROUPS; i++) {
+		if (sysfs_groups[i].kobj == kobj &&
+		    sysfs_groups[i].groups == groups) {
+			sysfs_groups[i].kobj = NULL;
+			sysfs_groups[i].groups = NULL;
+		}
+	}
+}
+
+int shim_attrs(struct shim_attr *attrs, int max)
+{
+	const struct attribute_group *const *group;
+	struct attribute **attr;
+	int count = 0;
+	umode_t mode;
+	int i;
+
+	for (i = 0; i < SHIM_MAX_GROUPS; i++) {
+		if (sysfs_groups[i].kobj == NULL)
+			continue;
+
+		for (group = sysfs_groups[i].groups; *group; group++) {
+			for (attr = (*group)->attrs; *attr; attr++) {
+				mode = (*attr)->mode;
+				if ((*group)->is_visible)
+					mode = (*group)->is_visible(
+						sysfs_groups[i].kobj, *attr,
+						attr - (*group)->attrs);
+				if (mode == 0 || count == max)
+					continue;
+
+				attrs[count].group = (*group)->name;
+				attrs[count].name = (*attr)->name;
+				attrs[count].mode = mode;
+				attrs[count].dev = container_of(
+					sysfs_groups[i].kobj, struct device,
+					kobj);
+				attrs[count].dattr = container_of(
+					*attr, struct device_attribute, attr);
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+struct shim_attr *shim_attr_find(struct shim_attr *attrs, int count,
+				 const char *group, const char *name)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if ((group == NULL) != (attrs[i].group == NULL))
+			continue;
+		if (group && strcmp(group, attrs[i].group) != 0)
+			continue;
+		if (strcmp(name, attrs[i].name) == 0)
+			return &attrs[i];
+	}
+
+	return NULL;
+}
+
+// ============================================================ //
+// debugfs
+// ============================================================ //
+
+void seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	if (m->count >= m->size)
+		return;
+
+	va_start(args, fmt);
+	len = vsnprintf(m->buf + m->count, m->size - m->count, fmt, args);
+	va_end(args);
+
+	if (len > 0)
+		m->count = m->count + len < m->size ? m->count + len : m->size;
+}
+
+// ============================================================ //
+// Managed resources
+// ============================================================ //
+
+static void devres_add(struct device *dev, void (*release)(void *), void *data)
+{
+	int i;
+
+	for (i = 0; i < SHIM_MAX_DEVRES; i++) {
+		if (devres[i].dev == NULL) {
+			devres[i].dev = dev;
+			devres[i].release = release;
+			devres[i].data = data;
+			return;
+		}
+	}
+
+	fprintf(stderr, "shim: out of devres slots\n");
+	abort();
+}
+
+// Released in reverse order of registration, like the driver core does
+static void devres_release_all(struct device *dev)
+{
+	int i;
+
+	for (i = SHIM_MAX_DEVRES - 1; i >= 0; i--) {
+		if (devres[i].dev != dev)
+			continue;
+		devres[i].release(devres[i].data);
+		devres[i].dev = NULL;
+	}
+}
+
+// ============================================================ //
+// Platform bus
+// ============================================================ //
+
+int platform_driver_register(struct platform_driver *drv)
+{
+	int i;
+
+	for (i = 0; i < SHIM_MAX_DRIVERS; i++) {
+		if (drivers[i] == NULL) {
+			drivers[i] = drv;
+			return 0;
+		}
+	}
+
+	return -ENOMEM;
+}
+
+void platform_driver_unregister(struct platform_driver *drv)
+{
+	int i;
+
+	for (i = 0; i < SHIM_MAX_DRIVERS; i++)
+		if (drivers[i] == drv)
+			drivers[i] = NULL;
+}
+
+struct platform_device *platform_device_alloc(const char *name, int id)
+{
+	struct platform_device *pdev = calloc(1, sizeof(*pdev));
+
+	if (pdev == NULL)
+		return NULL;
+
+	pdev->name = name;
+	pdev->id = id;
+	pdev->dev.kobj.name = name;
+	return pdev;
+}
+
+// Binds synchronously, like the platform bus does for a registered driver
+int platform_device_add(struct platform_device *pdev)
+{
+	int i;
+
+	for (i = 0; i < SHIM_MAX_DRIVERS; i++) {
+		if (drivers[i] == NULL ||
+		    strcmp(drivers[i]->driver.name, pdev->name) != 0)
+			continue;
+
+		if (drivers[i]->probe(pdev) < 0) {
+			devres_release_all(&pdev->dev);
+			break;
+		}
+
+		pdev->dev.driver = &drivers[i]->driver;
+		if (drivers[i]->driver.dev_groups)
+			sysfs_create_groups(&pdev->dev.kobj,
+					    drivers[i]->driver.dev_groups);
+		break;
+	}
+
+	return 0;
+}
+
+void platform_device_put(struct platform_device *pdev)
+{
+	free(pdev);
+}
+
+void platform_device_del(struct platform_device *pdev)
+{
+	struct platform_driver *drv;
+
+	if (pdev->dev.driver == NULL)
+		return;
+
+	drv = container_of(pdev->dev.driver, struct platform_driver, driver);
+	if (drv->driver.dev_groups)
+		sysfs_remove_groups(&pdev->dev.kobj, drv->driver.dev_groups);
+	if (drv->remove)
+		drv->remove(pdev);
+	devres_release_all(&pdev->dev);
+	pdev->dev.driver = NULL;
+}
+
+void platform_device_unregister(struct platform_device *pdev)
+{
+	platform_device_del(pdev);
+	platform_device_put(pdev);
+}
+
+// ============================================================ //
+// LEDs
+// ============================================================ //
+
+int led_classdev_register(struct device *parent, struct led_classdev *led_cdev)
+{
+	int i;
+
+	for (i = 0; i < SHIM_MAX_LEDS; i++) {
+		if (leds[i] == NULL) {
+			leds[i] = led_cdev;
+			led_cdev->dev = parent;
+			return 0;
+		}
+	}
+
+	return -ENOMEM;
+}
+
+void led_classdev_unregister(struct led_classdev *led_cdev)
+{
+	int i;
+
+	for (i = 0; i < SHIM_MAX_LEDS; i++) {
+		if (leds[i] == led_cdev) {
+			leds[i] = NULL;
+			led_cdev->dev = NULL;
+		}
+	}
+}
+
+static void devm_led_release(void *data)
+{
+	led_classdev_unregister(data);
+}
+
+int devm_led_classdev_register(struct device *parent,
+			       struct led_classdev *led_cdev)
+{
+	int result = led_classdev_register(parent, led_cdev);
+
+	if (result == 0)
+		devres_add(parent, devm_led_release, led_cdev);
+	return result;
+}
+
+int led_set_brightness_sync(struct led_classdev *led_cdev, unsigned int value)
+{
+	int result;
+
+	if (value > led_cdev->max_brightness)
+		value = led_cdev->max_brightness;
+
+	result = led_cdev->brightness_set_blocking(led_cdev, value);
+	if (result == 0)
+		led_cdev->brightness = value;
+	return result;
+}
+
+void led_classdev_notify_brightness_hw_changed(struct led_classdev *led_cdev,
+					       unsigned int brightness)
+{
+	if (!(led_cdev->flags & LED_BRIGHT_HW_CHANGED)) {
+		fprintf(stderr, "shim: %s has no LED_BRIGHT_HW_CHANGED flag\n",
+			led_cdev->name);
+		abort();
+	}
+
+	led_cdev->brightness_hw_changed = brightness;
+}
+
+int shim_leds(struct led_classdev **out, int max)
+{
+	int count = 0;
+	int i;
+
+	for (i = 0; i < SHIM_MAX_LEDS && count < max; i++)
+		if (leds[i])
+			out[count++] = leds[i];
+
+	return count;
+}
+
+// ============================================================ //
+// DMI
+// ============================================================ //
+
+void shim_set_dmi(enum dmi_field field, const char *value)
+{
+	dmi_strings[field] = value;
+}
+
+static bool dmi_matches(const struct dmi_system_id *dmi)
+{
+	const struct dmi_strmatch *m;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(dmi->matches); i++) {
+		m = &dmi->matches[i];
+		if (m->slot == DMI_NONE)
+			continue;
+		if (dmi_strings[m->slot] == NULL ||
+		    strstr(dmi_strings[m->slot], m->substr) == NULL)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+int dmi_check_system(const struct dmi_system_id *list)
+{
+	const struct dmi_system_id *d;
+	int count = 0;
+
+	for (d = list; d->matches[0].slot != DMI_NONE; d++) {
+		if (dmi_matches(d)) {
+			count++;
+			if (d->callback && d->callback(d))
+				break;
+		}
+	}
+
+	return count;
+}
+
+// ============================================================ //
+// Firmware loading
+// ============================================================ //
+
+void shim_set_firmware_dir(const char *dir)
+{
+	firmware_dir = dir;
+}
+
+int request_firmware_direct(const struct firmware **fw, const char *name,
+			    struct device *device)
+{
+	struct firmware *blob;
+	char path[512];
+	long size;
+	u8 *data;
+	FILE *f;
+
+	*fw = NULL;
+	if (firmware_dir == NULL)
+		return -ENOENT;
+
+	snprintf(path, sizeof(path), "%s/%s", firmware_dir, name);
+	f = fopen(path, "rb");
+	if (f == NULL)
+		return -ENOENT;
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+
+	blob = calloc(1, sizeof(*blob));
+	data = malloc(size > 0 ? size : 1);
+	if (blob == NULL || data == NULL ||
+	    fread(data, 1, size, f) != (size_t)size) {
+		free(blob);
+		free(data);
+		fclose(f);
+		return -ENOMEM;
+	}
+	fclose(f);
+
+	blob->data = data;
+	blob->size = size;
+	*fw = blob;
+	return 0;
+}
+
+void release_firmware(const struct firmware *fw)
+{
+	if (fw == NULL)
+		return;
+
+	free((void *)fw->data);
+	free((void *)fw);
+}
+
+// ============================================================ //
+// crc32
+// ============================================================ //
+
+u32 crc32_le(u32 crc, const unsigned char *p, size_t len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+
+	return crc;
+}
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+ * shim.h - Driving msi-ec.c from userspace
+ *
+ * A tool includes msi-ec.c in one translation unit (with tools/shim/include
+ * first on the include path), calls shim_module_init() and then reaches the
+ * handlers through the sysfs attributes and LED class devices the driver
+ * registered.
+ */
+
+#ifndef __MSI_EC_SHIM__
+#define __MSI_EC_SHIM__
+
+#include <kshim.h>
+
+struct shim_attr {
+	const char *group; /* NULL for the device directory */
+	const char *name;
+	umode_t mode;
+	struct device *dev;
+	struct device_attribute *dattr;
+};
+
+/* Defined by module_init()/module_exit() in the driver */
+int shim_module_init(void);
+void shim_module_exit(void);
+
+/* Visible attributes of all bound devices, returns the number found */
+int shim_attrs(struct shim_attr *attrs, int max);
+struct shim_attr *shim_attr_find(struct shim_attr *attrs, int count,
+				 const char *group, const char *name);
+
+/* Registered LED class devices, returns the number found */
+int shim_leds(struct led_classdev **leds, int max);
+
+/* Wait until all scheduled work items have run */
+void shim_flush_workqueue(void);
+
+void shim_set_dmi(enum dmi_field field, const char *value);
+void shim_set_firmware_dir(const char *dir);
+
+#endif // __MSI_EC_SHIM__
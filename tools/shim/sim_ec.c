@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "sim_ec.h"
+
+#include "../../sim_image.h"
+
+#include <sched.h>
+#include <time.h>
+
+/*
+ * Transactions are served in arrival order, like the kernel's mutexes hand
+ * the lock over to a waiter; a plain pthread mutex lets the thread that
+ * just released it take it straight back, which hides interleavings.
+ */
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_turn = PTHREAD_COND_INITIALIZER;
+static u64 sim_next_ticket;
+static u64 sim_serving;
+
+static u8 sim_regs[SIM_EC_SIZE];
+static struct sim_ec_stats sim_stats;
+
+static unsigned int sim_latency_ns;
+static unsigned int sim_jitter_ns;
+static bool sim_yield;
+static bool sim_held;
+static unsigned int sim_error_rate;
+static int sim_error_addr = -1;
+static unsigned int sim_seed_state = 1;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Sleeping is far too coarse for microsecond EC latencies, spin instead
+static void spin_ns(u64 ns)
+{
+	u64 end = now_ns() + ns;
+
+	while (now_ns() < end)
+		;
+}
+
+static void sim_acquire(void)
+{
+	u64 ticket;
+
+	pthread_mutex_lock(&sim_lock);
+	ticket = sim_next_ticket++;
+	while (ticket != sim_serving || sim_held)
+		pthread_cond_wait(&sim_turn, &sim_lock);
+	pthread_mutex_unlock(&sim_lock);
+}
+
+static void sim_release(void)
+{
+	bool yield;
+
+	pthread_mutex_lock(&sim_lock);
+	sim_serving++;
+	yield = sim_yield;
+	pthread_cond_broadcast(&sim_turn);
+	pthread_mutex_unlock(&sim_lock);
+
+	if (yield)
+		sched_yield();
+}
+
+// Called between sim_acquire() and sim_release()
+static int sim_transaction(u8 addr)
+{
+	u64 delay = sim_latency_ns;
+
+	if (sim_jitter_ns)
+		delay += rand_r(&sim_seed_state) % (sim_jitter_ns + 1);
+	if (delay)
+		spin_ns(delay);
+
+	if (sim_error_rate &&
+	    (sim_error_addr < 0 || sim_error_addr == addr) &&
+	    (unsigned int)rand_r(&sim_seed_state) % 1000 < sim_error_rate) {
+		sim_stats.errors++;
+		return -ETIME;
+	}
+
+	return 0;
+}
+
+int ec_read(u8 addr, u8 *val)
+{
+	int result;
+
+	sim_acquire();
+	sim_stats.reads++;
+	result = sim_transaction(addr);
+	if (result == 0)
+		*val = sim_regs[addr];
+	sim_release();
+
+	return result;
+}
+
+int ec_write(u8 addr, u8 val)
+{
+	int result;
+
+	sim_acquire();
+	sim_stats.writes++;
+	result = sim_transaction(addr);
+	if (result == 0)
+		sim_regs[addr] = val;
+	sim_release();
+
+	return result;
+}
+
+void sim_ec_reset(void)
+{
+	sim_acquire();
+	sim_image_seed(sim_regs);
+	memset(&sim_stats, 0, sizeof(sim_stats));
+	sim_latency_ns = 0;
+	sim_jitter_ns = 0;
+	sim_yield = FALSE;
+	sim_error_rate = 0;
+	sim_error_addr = -1;
+	sim_seed_state = 1;
+	sim_release();
+}
+
+void sim_ec_set_latency(unsigned int latency_ns, unsigned int jitter_ns)
+{
+	sim_acquire();
+	sim_latency_ns = latency_ns;
+	sim_jitter_ns = jitter_ns;
+	sim_release();
+}
+
+void sim_ec_set_yield(bool yield)
+{
+	sim_acquire();
+	sim_yield = yield;
+	sim_release();
+}
+
+// Not a transaction: it must get through while the EC is held
+void sim_ec_hold(bool hold)
+{
+	pthread_mutex_lock(&sim_lock);
+	sim_held = hold;
+	pthread_cond_broadcast(&sim_turn);
+	pthread_mutex_unlock(&sim_lock);
+}
+
+void sim_ec_set_errors(unsigned int rate_per_mille, int addr)
+{
+	sim_acquire();
+	sim_error_rate = rate_per_mille;
+	sim_error_addr = addr;
+	sim_release();
+}
+
+void sim_ec_get_stats(struct sim_ec_stats *stats)
+{
+	sim_acquire();
+	*stats = sim_stats;
+	sim_release();
+}
+
+u8 sim_ec_peek(u8 addr)
+{
+	u8 value;
+
+	sim_acquire();
+	value = sim_regs[addr];
+	sim_release();
+
+	return value;
+}
+
+void sim_ec_poke(u8 addr, u8 value)
+{
+	sim_acquire();
+	sim_regs[addr] = value;
+	sim_release();
+}
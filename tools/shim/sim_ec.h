@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+ * sim_ec.h - Simulated 256-byte EC backing ec_read()/ec_write() in userspace
+ *
+ * Same register image and knobs as the msi-ec-sim kernel module: per
+ * transaction latency and jitter (busy-waited, in nanoseconds) and error
+ * injection. Transactions are serialised by one lock, like the ACPI EC.
+ * With yield set every transaction gives up the CPU when it is done, as the
+ * kernel sleeps waiting for the EC, so that other threads get in between.
+ * While held, no transaction starts until the EC is released, so that
+ * a test can line up threads behind one in flight.
+ */
+
+#ifndef __MSI_EC_SIM_EC__
+#define __MSI_EC_SIM_EC__
+
+#include <kshim.h>
+
+struct sim_ec_stats {
+	u64 reads;
+	u64 writes;
+	u64 errors;
+};
+
+void sim_ec_reset(void);
+void sim_ec_set_latency(unsigned int latency_ns, unsigned int jitter_ns);
+void sim_ec_set_yield(bool yield);
+void sim_ec_hold(bool hold);
+void sim_ec_set_errors(unsigned int rate_per_mille, int addr);
+void sim_ec_get_stats(struct sim_ec_stats *stats);
+
+u8 sim_ec_peek(u8 addr);
+void sim_ec_poke(u8 addr, u8 value);
+
+#endif // __MSI_EC_SIM_EC__
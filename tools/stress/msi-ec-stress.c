@@ -0,0 +1,635 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi-ec-stress.c - Concurrency stress test of msi-ec against a simulated EC
+ *
+ *   msi-ec-stress [-r rounds] [-n ops] [-c threads,...] [-l latency_us]
+ *                 [-j jitter_us] [-s seed] [-v]
+ *
+ * Builds msi-ec.c on top of tools/shim like msi-ec-bench. In each round
+ * every thread stores ops random values into random writable attributes
+ * and LEDs (the preset included), all threads at once. The tool knows
+ * which register bits each store means to set, so after the round it
+ * checks every bit of the register image:
+ *
+ * - a bit some thread stored must hold the value of one of the threads'
+ *   last stores to it, whatever order they ran in;
+ * - a bit nobody stored must hold the value it had before the round.
+ *
+ * A bit that fails either check is a lost update: some read-modify-write
+ * of a neighbouring bit wrote back a stale copy of it. Only the last stores
+ * of a round can be caught this way, hence many short rounds (500 of 20
+ * stores per thread by default). The simulated EC yields the CPU after
+ * every transaction so that threads interleave even on one CPU.
+ *
+ * The rounds are run for every thread count given (1, 2, 4 and 8 by
+ * default), reporting the store latency percentiles and the throughput
+ * relative to one thread.
+ *
+ * For every thread count above one, read coalescing is checked as well:
+ * the simulated EC is held while all threads read the same register, and
+ * once every thread but the first has joined the first one's read, the
+ * EC is released. That must take exactly one EC read, whose value every
+ * thread gets.
+ *
+ * Exits 1 if any update was lost or concurrent reads were not coalesced.
+ */
+
+#include "../../msi-ec.c"
+
+#include "shim.h"
+#include "sim_ec.h"
+
+#include "../../sim_image.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STRESS_MAX_ATTRS 64
+#define STRESS_MAX_LEDS 8
+#define STRESS_MAX_TARGETS 32
+#define STRESS_MAX_THREADS 32
+#define STRESS_MAX_LISTS 16
+#define STRESS_MAX_REGS 8 /* registers written by one store */
+#define STRESS_MAX_VALUES 4
+
+enum stress_kind {
+	STRESS_ENUM,
+	STRESS_PRESET,
+	STRESS_LED,
+};
+
+// Bits one store sets: (register & mask) becomes bits
+struct stress_write {
+	u8 address;
+	u8 mask;
+	u8 bits;
+};
+
+struct stress_value {
+	char text[32];
+	struct stress_write writes[STRESS_MAX_REGS];
+	int write_count;
+};
+
+struct stress_target {
+	const char *label;
+	enum stress_kind kind;
+	struct shim_attr *attr;
+	struct led_classdev *led;
+	struct stress_value values[STRESS_MAX_VALUES];
+	int value_count;
+};
+
+/*
+ * What one thread last stored into each register bit in the current round:
+ * -1 if it did not touch the bit, else the bit's value, and the target.
+ */
+struct stress_thread {
+	pthread_t thread;
+	unsigned int seed;
+	s8 last[SIM_EC_SIZE][8];
+	const struct stress_target *last_target[SIM_EC_SIZE][8];
+	u64 *samples;
+	int sample_count;
+	int failures;
+};
+
+static struct stress_target targets[STRESS_MAX_TARGETS];
+static int target_count;
+static struct stress_thread threads[STRESS_MAX_THREADS];
+
+static int rounds = 500;
+static int ops = 20;
+static bool verbose;
+
+// Lost updates per register bit over the whole run
+static unsigned long lost[SIM_EC_SIZE][8];
+static const struct stress_target *lost_target[SIM_EC_SIZE][8];
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a;
+	u64 y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// ============================================================ //
+// Targets and the register bits their values set
+// ============================================================ //
+
+static void add_write(struct stress_value *v, int address, u8 mask, u8 bits)
+{
+	if (address < 0 || address > 0xff || v->write_count == STRESS_MAX_REGS)
+		return;
+
+	v->writes[v->write_count++] = (struct stress_write){
+		.address = address,
+		.mask = mask,
+		.bits = bits & mask,
+	};
+}
+
+static struct stress_target *new_target(const char *label,
+					enum stress_kind kind)
+{
+	struct stress_target *t;
+
+	if (target_count == STRESS_MAX_TARGETS)
+		return NULL;
+
+	t = &targets[target_count++];
+	*t = (struct stress_target){ .label = label, .kind = kind };
+	return t;
+}
+
+static void collect_enum(struct shim_attr *attr)
+{
+	struct msi_ec_enum_attr *ea =
+		container_of(attr->dattr, struct msi_ec_enum_attr, dev_attr);
+	struct stress_target *t = new_target(attr->name, STRESS_ENUM);
+	struct stress_value *v;
+	int i;
+
+	if (!t)
+		return;
+	t->attr = attr;
+
+	for (i = 0; i < ea->count && t->value_count < STRESS_MAX_VALUES; i++) {
+		if (!ea->supported[i])
+			continue;
+
+		v = &t->values[t->value_count++];
+		snprintf(v->text, sizeof(v->text), "%s\n", ea->names[i]);
+		add_write(v, *ea->address, ea->mask, ea->patterns[i]);
+	}
+}
+
+static void collect_preset(struct shim_attr *attr)
+{
+	static const char *const names[MSI_EC_PRESET_COUNT] = {
+		[MSI_EC_PRESET_SUPER_BATTERY] = "super_battery",
+		[MSI_EC_PRESET_SILENT] = "silent",
+		[MSI_EC_PRESET_BALANCED] = "balanced",
+		[MSI_EC_PRESET_HIGH_PERFORMANCE] = "high_performance",
+	};
+	struct stress_target *t = new_target(attr->name, STRESS_PRESET);
+	struct stress_value *v;
+	u8 silent_bit = BIT(conf.preset.silent_flag_bit);
+	int p, c;
+
+	if (!t)
+		return;
+	t->attr = attr;
+
+	// Mirrors preset_store()
+	for (p = 0; p < MSI_EC_PRESET_COUNT; p++) {
+		v = &t->values[t->value_count++];
+		snprintf(v->text, sizeof(v->text), "%s\n", names[p]);
+
+		for (c = 0; c < MSI_EC_PRESET_COLUMNS; c++) {
+			if (c == MSI_EC_PRESET_COLUMN_SILENT_FLAG)
+				add_write(v, conf.preset.addresses[c], silent_bit,
+					  conf.preset.values[p][c] ? silent_bit : 0);
+			else
+				add_write(v, conf.preset.addresses[c], 0xff,
+					  conf.preset.values[p][c]);
+		}
+
+		if (p == MSI_EC_PRESET_HIGH_PERFORMANCE)
+			continue;
+		add_write(v, conf.fan_mode.address,
+			  BIT(conf.fan_mode.advanced_bit), 0);
+		if (conf.fan_mode.basic_bit != MSI_EC_BIT_UNSUPP)
+			add_write(v, conf.fan_mode.address,
+				  BIT(conf.fan_mode.basic_bit), 0);
+	}
+}
+
+static void collect_led(struct led_classdev *led)
+{
+	struct stress_target *t;
+	struct stress_value *v;
+	int b;
+
+	if (!led->brightness_set_blocking)
+		return;
+
+	t = new_target(led->name, STRESS_LED);
+	if (!t)
+		return;
+	t->led = led;
+
+	for (b = 0; b <= led->max_brightness && b < STRESS_MAX_VALUES; b++) {
+		v = &t->values[t->value_count++];
+		snprintf(v->text, sizeof(v->text), "%d", b);
+
+		if (led == &micmute_led_cdev)
+			add_write(v, conf.leds.micmute_address, 0xff,
+				  b ? conf.leds.micmute_on : conf.leds.micmute_off);
+		else if (led == &mute_led_cdev)
+			add_write(v, conf.leds.mute_address, 0xff,
+				  b ? conf.leds.mute_on : conf.leds.mute_off);
+		else if (led == &msiacpi_led_kbdlight)
+			add_write(v, conf.kbd_bl.address, 0xff,
+				  conf.kbd_bl.states[b]);
+	}
+}
+
+static void collect_targets(struct shim_attr *attrs, int attr_count,
+			    struct led_classdev **leds, int led_count)
+{
+	struct msi_ec_enum_attr *ea;
+	int i;
+
+	for (i = 0; i < attr_count; i++) {
+		if (!(attrs[i].mode & 0222) || !attrs[i].dattr->store)
+			continue;
+
+		if (attrs[i].dattr == &dev_attr_preset)
+			collect_preset(&attrs[i]);
+
+		for (ea = msi_ec_enum_attrs;
+		     ea < msi_ec_enum_attrs + MSI_EC_ENUM_ATTR_COUNT; ea++)
+			if (attrs[i].dattr == &ea->dev_attr)
+				collect_enum(&attrs[i]);
+	}
+
+	for (i = 0; i < led_count; i++)
+		collect_led(leds[i]);
+}
+
+// ============================================================ //
+// Rounds
+// ============================================================ //
+
+static ssize_t store(const struct stress_target *t,
+		     const struct stress_value *v)
+{
+	if (t->kind == STRESS_LED)
+		return t->led->brightness_set_blocking(t->led, atoi(v->text));
+
+	return t->attr->dattr->store(t->attr->dev, t->attr->dattr, v->text,
+				     strlen(v->text));
+}
+
+static void *stress_thread_run(void *arg)
+{
+	struct stress_thread *thread = arg;
+	const struct stress_target *t;
+	const struct stress_value *v;
+	const struct stress_write *w;
+	u64 start;
+	int i, bit;
+
+	for (i = 0; i < ops; i++) {
+		t = &targets[rand_r(&thread->seed) % target_count];
+		v = &t->values[rand_r(&thread->seed) % t->value_count];
+
+		start = now_ns();
+		if (store(t, v) < 0) {
+			thread->failures++;
+			continue;
+		}
+		thread->samples[thread->sample_count++] = now_ns() - start;
+
+		for (w = v->writes; w < v->writes + v->write_count; w++) {
+			for (bit = 0; bit < 8; bit++) {
+				if (!(w->mask & BIT(bit)))
+					continue;
+				thread->last[w->address][bit] = !!(w->bits & BIT(bit));
+				thread->last_target[w->address][bit] = t;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+// Checks the register image after a round, returns the lost updates
+static int check_round(const u8 *before, int thread_count)
+{
+	const struct stress_target *target;
+	bool written, expected;
+	int addr, bit, t;
+	int count = 0;
+	u8 value;
+
+	for (addr = 0; addr < SIM_EC_SIZE; addr++) {
+		value = sim_ec_peek(addr);
+
+		for (bit = 0; bit < 8; bit++) {
+			written = FALSE;
+			expected = FALSE;
+			target = NULL;
+
+			for (t = 0; t < thread_count; t++) {
+				if (threads[t].last[addr][bit] < 0)
+					continue;
+				written = TRUE;
+				target = threads[t].last_target[addr][bit];
+				if (threads[t].last[addr][bit] == !!(value & BIT(bit)))
+					expected = TRUE;
+			}
+			if (!written)
+				expected = (before[addr] ^ value) & BIT(bit) ? FALSE : TRUE;
+			if (expected)
+				continue;
+
+			count++;
+			lost[addr][bit]++;
+			if (target)
+				lost_target[addr][bit] = target;
+			if (verbose)
+				printf("lost update: %#04x bit %d is %d%s%s\n", addr,
+				       bit, !!(value & BIT(bit)),
+				       target ? ", last stored by " : "",
+				       target ? target->label : "");
+		}
+	}
+
+	return count;
+}
+
+static void stress(int thread_count, double *base_ops_per_s)
+{
+	static u8 before[SIM_EC_SIZE];
+	u64 *samples, total = 0, wall = 0, start;
+	int count = 0, failures = 0, lost_count = 0;
+	double ops_per_s;
+	int r, t, i;
+
+	samples = calloc((size_t)thread_count * rounds * ops, sizeof(*samples));
+	if (!samples)
+		exit(1);
+
+	for (t = 0; t < thread_count; t++)
+		threads[t].samples = samples + (size_t)t * rounds * ops;
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < SIM_EC_SIZE; i++)
+			before[i] = sim_ec_peek(i);
+
+		for (t = 0; t < thread_count; t++) {
+			memset(threads[t].last, -1, sizeof(threads[t].last));
+			threads[t].samples += threads[t].sample_count;
+			threads[t].sample_count = 0;
+		}
+
+		start = now_ns();
+		for (t = 0; t < thread_count; t++)
+			if (pthread_create(&threads[t].thread, NULL,
+					   stress_thread_run, &threads[t]) != 0)
+				exit(1);
+		for (t = 0; t < thread_count; t++)
+			pthread_join(threads[t].thread, NULL);
+		wall += now_ns() - start;
+
+		lost_count += check_round(before, thread_count);
+	}
+
+	// Gather the samples of all threads at the start of the buffer
+	for (t = 0; t < thread_count; t++) {
+		u64 *end = threads[t].samples + threads[t].sample_count;
+		u64 *s = samples + (size_t)t * rounds * ops;
+
+		for (; s < end; s++)
+			samples[count++] = *s;
+		failures += threads[t].failures;
+		threads[t].failures = 0;
+		threads[t].sample_count = 0;
+	}
+
+	for (i = 0; i < count; i++)
+		total += samples[i];
+	qsort(samples, count, sizeof(*samples), cmp_u64);
+
+	ops_per_s = wall ? count * 1e9 / wall : 0.0;
+	if (*base_ops_per_s == 0)
+		*base_ops_per_s = ops_per_s;
+
+	printf("%7d %7d %9d %6d %6d %9.2f %9.2f %9.2f %9.2f %10.0f %7.2f\n",
+	       thread_count, rounds, count, failures, lost_count,
+	       count ? total / 1000.0 / count : 0.0,
+	       count ? samples[count / 2] / 1000.0 : 0.0,
+	       count ? samples[(count * 99) / 100] / 1000.0 : 0.0,
+	       count ? samples[(count * 999) / 1000] / 1000.0 : 0.0,
+	       ops_per_s, *base_ops_per_s ? ops_per_s / *base_ops_per_s : 0.0);
+
+	free(samples);
+}
+
+// ============================================================ //
+// Read coalescing
+// ============================================================ //
+
+#define COALESCE_TIMEOUT_NS 1000000000ULL
+
+struct coalesce_reader {
+	pthread_t thread;
+	u8 addr;
+	u8 value;
+	int result;
+};
+
+static void *coalesce_thread_run(void *arg)
+{
+	struct coalesce_reader *reader = arg;
+
+	reader->result = msi_ec_read(reader->addr, &reader->value);
+	return NULL;
+}
+
+// Returns FALSE if the concurrent reads did not share one EC read
+static bool coalesce(int thread_count)
+{
+	static struct coalesce_reader readers[STRESS_MAX_THREADS];
+	const struct msi_ec_flight *f;
+	struct sim_ec_stats before, after;
+	u8 addr = conf.cpu.rt_temp_address;
+	u64 coalesced, joined, deadline, reads;
+	bool ok = TRUE;
+	int t;
+
+	f = &flights[addr];
+	mutex_lock(&flight_lock);
+	coalesced = f->coalesced;
+	mutex_unlock(&flight_lock);
+
+	sim_ec_get_stats(&before);
+	sim_ec_hold(TRUE);
+	for (t = 0; t < thread_count; t++) {
+		readers[t] = (struct coalesce_reader){ .addr = addr };
+		if (pthread_create(&readers[t].thread, NULL, coalesce_thread_run,
+				   &readers[t]) != 0)
+			exit(1);
+	}
+
+	// Without coalescing the readers never all join, give up eventually
+	deadline = now_ns() + COALESCE_TIMEOUT_NS;
+	for (;;) {
+		mutex_lock(&flight_lock);
+		joined = f->coalesced - coalesced;
+		mutex_unlock(&flight_lock);
+		if (joined == (u64)thread_count - 1 || now_ns() > deadline)
+			break;
+		sched_yield();
+	}
+
+	sim_ec_hold(FALSE);
+	for (t = 0; t < thread_count; t++)
+		pthread_join(readers[t].thread, NULL);
+	sim_ec_get_stats(&after);
+
+	reads = after.reads - before.reads;
+	if (reads != 1) {
+		printf("%d concurrent reads of %#04x took %llu EC reads\n",
+		       thread_count, addr, (unsigned long long)reads);
+		ok = FALSE;
+	}
+	for (t = 0; t < thread_count; t++) {
+		if (readers[t].result == 0 &&
+		    readers[t].value == sim_ec_peek(addr))
+			continue;
+		printf("concurrent read %d of %#04x: result %d, value %#04x\n",
+		       t, addr, readers[t].result, readers[t].value);
+		ok = FALSE;
+	}
+
+	return ok;
+}
+
+// ============================================================ //
+// Main
+// ============================================================ //
+
+static int parse_list(const char *arg, unsigned int *values, int max)
+{
+	char *copy = strdup(arg);
+	char *save = NULL;
+	char *tok;
+	int count = 0;
+
+	for (tok = strtok_r(copy, ",", &save);
+	     tok && count < max;
+	     tok = strtok_r(NULL, ",", &save))
+		values[count++] = strtoul(tok, NULL, 10);
+
+	free(copy);
+	return count;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-r rounds] [-n ops] [-c threads,...] [-l latency_us]\n"
+		"          [-j jitter_us] [-s seed] [-v]\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	static struct shim_attr attrs[STRESS_MAX_ATTRS];
+	struct led_classdev *leds[STRESS_MAX_LEDS];
+	unsigned int counts[STRESS_MAX_LISTS] = { 1, 2, 4, 8 };
+	unsigned int latency_us = 5, jitter_us = 5;
+	unsigned int seed = 1;
+	unsigned long total_lost = 0;
+	bool coalesced = TRUE;
+	double base_ops_per_s = 0;
+	int count_count = 4;
+	int attr_count, led_count;
+	int opt, c, t, addr, bit;
+
+	while ((opt = getopt(argc, argv, "r:n:c:l:j:s:v")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'n':
+			ops = atoi(optarg);
+			break;
+		case 'c':
+			count_count = parse_list(optarg, counts, STRESS_MAX_LISTS);
+			break;
+		case 'l':
+			latency_us = strtoul(optarg, NULL, 10);
+			break;
+		case 'j':
+			jitter_us = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 10);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (rounds <= 0 || ops <= 0 || count_count == 0)
+		usage(argv[0]);
+	for (c = 0; c < count_count; c++)
+		if (counts[c] < 1 || counts[c] > STRESS_MAX_THREADS)
+			usage(argv[0]);
+
+	sim_ec_reset();
+	if (shim_module_init() < 0) {
+		fprintf(stderr, "msi-ec failed to initialise\n");
+		return 1;
+	}
+	shim_flush_workqueue();
+
+	attr_count = shim_attrs(attrs, STRESS_MAX_ATTRS);
+	led_count = shim_leds(leds, STRESS_MAX_LEDS);
+	collect_targets(attrs, attr_count, leds, led_count);
+	if (target_count == 0) {
+		fprintf(stderr, "msi-ec did not bind to the simulated EC\n");
+		shim_module_exit();
+		return 1;
+	}
+
+	sim_ec_set_latency(latency_us * 1000, jitter_us * 1000);
+	sim_ec_set_yield(TRUE);
+	for (t = 0; t < STRESS_MAX_THREADS; t++)
+		threads[t].seed = seed + t;
+
+	printf("%7s %7s %9s %6s %6s %9s %9s %9s %9s %10s %7s\n", "threads",
+	       "rounds", "stores", "errors", "lost", "mean_us", "p50_us",
+	       "p99_us", "p999_us", "stores/s", "speedup");
+	for (c = 0; c < count_count; c++)
+		stress(counts[c], &base_ops_per_s);
+	for (c = 0; c < count_count; c++)
+		if (counts[c] > 1 && !coalesce(counts[c]))
+			coalesced = FALSE;
+
+	for (addr = 0; addr < SIM_EC_SIZE; addr++) {
+		for (bit = 0; bit < 8; bit++) {
+			if (!lost[addr][bit])
+				continue;
+			total_lost += lost[addr][bit];
+			printf("lost updates at %#04x bit %d: %lu", addr, bit,
+			       lost[addr][bit]);
+			if (lost_target[addr][bit])
+				printf(" (last stored by %s)",
+				       lost_target[addr][bit]->label);
+			printf("\n");
+		}
+	}
+
+	shim_module_exit();
+	return total_lost || !coalesced ? 1 : 0;
+}